@@ -32,7 +32,11 @@ const Version
 	VER_PUBKEY_RECOVER(0, 90),
 	VER_HEADERS(0, 120),
 	DB_VER_COMPACT_UTXO(1, 1),
-	DB_VER_LATEST = DB_VER_COMPACT_UTXO;
+	DB_VER_BLOCK_FILTERS(1, 2),
+	DB_VER_ADDRESS_INDEX(1, 3),
+	DB_VER_BLOCK_UNDO(1, 4),
+	DB_VER_DOMAIN_EXPIRY(1, 5),				// Namecoin name expiry wheel, other chains only bump the version
+	DB_VER_LATEST = DB_VER_DOMAIN_EXPIRY;
 
 #define COIN_DEF_DB_KEY(name) const Span KEY_##name((const uint8_t*)#name, strlen(#name));
 
@@ -81,6 +85,9 @@ DbliteBlockChainDb::DbliteBlockChainDb(CoinEng& eng)
 	, m_tablePubkeys		("pubkeys"		, PUBKEYID_SIZE			, TableType::HashTable	, HashType::Identity)
 	, m_tablePubkeyToTxes	("pubkey_txes"	, PUBKEYTOTXES_ID_SIZE	, TableType::HashTable	, HashType::Identity)
 	, m_tableProperties		("properties"	, 0						, TableType::HashTable)
+	, m_tableBlockFilters	("block_filters", BLOCKID_SIZE			, TableType::HashTable	, HashType::Identity)		// FilterHeader || Filter
+	, m_tableAddressIndex	("address_index", ADDRESS_INDEX_KEY_SIZE, TableType::HashTable)							// pages of AddressIndexEntry
+	, m_tableUndo			("undo"			, BLOCKID_SIZE			, TableType::HashTable	, HashType::Identity)		// BlockUndo
 {
 	DefaultFileExt = ".udb";
 
@@ -318,8 +325,11 @@ bool DbliteBlockChainDb::Create(const path& p) {
 		m_tableTxes.Open(dbt, true);
 		m_tablePubkeys.Open(dbt, true);
 		m_tableProperties.Open(dbt, true);
+		m_tableBlockFilters.Open(dbt, true);
+		m_tableUndo.Open(dbt, true);
 		if (Eng.Mode == EngMode::BlockExplorer) {
 			m_tablePubkeyToTxes.Open(dbt, true);
+			m_tableAddressIndex.Open(dbt, true);
 		}
 		OnOpenTables(dbt, true);
 		dbt.Commit();
@@ -346,8 +356,14 @@ bool DbliteBlockChainDb::Open(const path& p) {
 		if (m_db.UserVersion >= VER_BLOCKS_TABLE_IS_HASHTABLE) {
 			m_tableProperties.Open(dbt);
 		}
+		if (m_db.UserVersion >= DB_VER_BLOCK_FILTERS)
+			m_tableBlockFilters.Open(dbt);
+		if (m_db.UserVersion >= DB_VER_BLOCK_UNDO)
+			m_tableUndo.Open(dbt);
 		if (Eng.Mode == EngMode::BlockExplorer) {
 			m_tablePubkeyToTxes.Open(dbt);
+			if (m_db.UserVersion >= DB_VER_ADDRESS_INDEX)
+				m_tableAddressIndex.Open(dbt);
 		}
 		OnOpenTables(dbt, false);
 	}
@@ -383,6 +399,9 @@ void DbliteBlockChainDb::Close(bool bAsync) {
 	m_tableTxes.Close();
 	m_tablePubkeys.Close();
 	m_tablePubkeyToTxes.Close();
+	m_tableBlockFilters.Close();
+	m_tableAddressIndex.Close();
+	m_tableUndo.Close();
 	m_db.AsyncClose = bAsync;
 	m_db.Close();
 
@@ -430,6 +449,16 @@ void DbliteBlockChainDb::UpgradeTo(const Version& ver) {
 			m_tableProperties.Put(dbtx, KEY_MaxHeaderHeight, Span((const uint8_t*)&h, sizeof h));
 		}
 
+		if (dbVer < DB_VER_BLOCK_FILTERS)
+			m_tableBlockFilters.Open(dbtx, true);		// stays empty: filter headers chain from Genesis, see TryUpgradeDb()
+
+		if (dbVer < DB_VER_ADDRESS_INDEX && Eng.Mode == EngMode::BlockExplorer)
+			m_tableAddressIndex.Open(dbtx, true);
+
+		if (dbVer < DB_VER_BLOCK_UNDO)
+			m_tableUndo.Open(dbtx, true);		// blocks connected before the upgrade are disconnected the old way
+
+		OnUpgradeTables(dbtx, dbVer);
 		Eng.UpgradeDb(ver);
 		m_db.SetUserVersion(ver);
 		dbtx.Commit();
@@ -440,7 +469,8 @@ void DbliteBlockChainDb::UpgradeTo(const Version& ver) {
 void DbliteBlockChainDb::TryUpgradeDb(const Version& verTarget) {
 	if (Eng.Mode != EngMode::Bootstrap) {
 		Version dbVer = CheckUserVersion();
-		if (dbVer < verTarget) {
+		Version verRecreate = Eng.BlockFilterIndexEnabled ? DB_VER_BLOCK_FILTERS : DB_VER_COMPACT_UTXO;	// the filter index can only be built by connecting blocks from Genesis
+		if (dbVer < (min)(verTarget, verRecreate)) {		// later versions only add tables
 			Recreate(dbVer);
 			return;
 		}
@@ -483,8 +513,19 @@ Blob DbliteBlockChainDb::ReadBlob(uint64_t offset, uint32_t size) {
 }
 
 void DbliteBlockChainDb::CopyTo(uint64_t offset, uint32_t size, Stream& stm) {
-	PositionOwningFileStream stmFile(m_fileBootstrap, offset, size);
-	stmFile.CopyTo(stm);
+	Span mapped = MappedSpan(offset, size);
+	if (mapped.data())
+		stm.WriteBuffer(mapped.data(), mapped.size());		// straight from the page cache, no intermediate buffer
+	else {
+		PositionOwningFileStream stmFile(m_fileBootstrap, offset, size);
+		stmFile.CopyTo(stm);
+	}
+}
+
+Span DbliteBlockChainDb::MappedSpan(uint64_t offset, uint32_t size) {
+	return offset + size <= MappedSize
+		? Span((const uint8_t*)m_viewBootstrap.Address + offset, size)
+		: Span();
 }
 
 Block DbliteBlockChainDb::LoadBlock(DbReadTransaction& dbt, int height, Stream& stmBlocks, bool bFullRead) {
@@ -975,6 +1016,16 @@ void DbliteBlockChainDb::DeleteBlock(int height, const vector<int64_t>* txids) {
 		}
 		c.Delete();
 		m_tableHashToBlock.Delete(dbt, ReducedBlockHash(hashBlock));
+		if (m_db.UserVersion >= DB_VER_BLOCK_FILTERS) {
+			DbCursor cFilter(dbt, m_tableBlockFilters);
+			if (cFilter.Get(BlockKey(height)))
+				cFilter.Delete();
+		}
+		if (m_db.UserVersion >= DB_VER_BLOCK_UNDO) {
+			DbCursor cUndo(dbt, m_tableUndo);
+			if (cUndo.Get(BlockKey(height)))
+				cUndo.Delete();
+		}
 	}
 	int32_t h = htole(height - 1);
 	m_tableProperties.Put(dbt, KEY_MaxHeight, Span((const uint8_t*)&h, sizeof h));
@@ -1125,6 +1176,312 @@ vector<int64_t> DbliteBlockChainDb::GetTxesByPubKey(const HashValue160& pubkey)
 	return r;
 }
 
+/*
+Address index: entries of each script are appended in chain order to pages of ADDRESS_INDEX_PAGE_ENTRIES,
+keyed by ScriptHash || BE PageNumber; page ADDRESS_INDEX_COUNT_PAGE keeps LE Count || LE Balance || LE Received.
+So entries are sorted by (Height, TxPos, IsInput, Index), ordinal of the entry is a stable pagination cursor.
+Count pages written before the totals were kept have only the Count, they get the totals when the script's index is emptied.
+*/
+
+const uint32_t ADDRESS_INDEX_PAGE_ENTRIES = 32,
+	ADDRESS_INDEX_COUNT_PAGE = 0xFFFFFFFF,
+	ADDRESS_INDEX_INPUT_FLAG = 0x80000000;
+const size_t ADDRESS_INDEX_ENTRY_SIZE = 4 + 4 + 4 + 8 + 32 + 4,
+	ADDRESS_INDEX_COUNT_SIZE = 4 + 8 + 8;
+
+static Blob AddressIndexKey(const HashValue& scriptHash, uint32_t nPage) {
+	uint8_t buf[ADDRESS_INDEX_KEY_SIZE];
+	memcpy(buf, scriptHash.data(), 32);
+	uint32_t beN = htobe(nPage);
+	memcpy(buf + 32, &beN, sizeof beN);
+	return Blob(buf, sizeof buf);
+}
+
+static void WriteAddressIndexEntry(uint8_t *p, const AddressIndexEntry& e) {
+	PutLeUInt32(p, uint32_t(e.Height));
+	PutLeUInt32(p + 4, e.TxPos);
+	PutLeUInt32(p + 8, e.Index | (e.IsInput ? ADDRESS_INDEX_INPUT_FLAG : 0));
+	uint64_t leValue = htole(uint64_t(e.Value));
+	memcpy(p + 12, &leValue, sizeof leValue);
+	memcpy(p + 20, e.HashTx.data(), 32);
+	PutLeUInt32(p + 52, uint32_t(e.SpentHeight));
+}
+
+static AddressIndexEntry ReadAddressIndexEntry(const uint8_t *p) {
+	AddressIndexEntry e;
+	e.Height = int32_t(GetLeUInt32(p));
+	e.TxPos = GetLeUInt32(p + 4);
+	uint32_t idx = GetLeUInt32(p + 8);
+	e.Index = idx & ~ADDRESS_INDEX_INPUT_FLAG;
+	e.IsInput = idx & ADDRESS_INDEX_INPUT_FLAG;
+	e.Value = int64_t(GetLeUInt64(p + 12));
+	e.HashTx = HashValue(Span(p + 20, 32));
+	e.SpentHeight = int32_t(GetLeUInt32(p + 52));
+	return e;
+}
+
+static bool AddressIndexEntryLess(const uint8_t *p, int height, uint32_t txPos) {
+	int h = int32_t(GetLeUInt32(p));
+	return h < height || (h == height && GetLeUInt32(p + 4) < txPos);
+}
+
+// nullopt for empty scripts, they are not indexed both as outputs and as spent prevouts of inputs
+static optional<HashValue> AddressIndexScriptHash(CoinEng& eng, const TxOut& txOut) {
+	Span script = txOut.get_ScriptPubKey();
+	if (script.empty())
+		return nullopt;
+	Address a = TxOut::CheckStandardType(script);
+	if (a.Type == AddressType::PubKey) {													// P2PK outputs are indexed under their P2PKH address
+		HashValue160 hash160 = Hash160(a.Data());
+		return AddressIndexScriptHash(Address(eng, AddressType::P2PKH, Span(hash160.data(), hash160.size()))->ToScriptPubKey());
+	}
+	return AddressIndexScriptHash(script);
+}
+
+uint32_t DbliteBlockChainDb::GetAddressIndexCount(DbReadTransaction& dbt, const HashValue& scriptHash) {
+	DbCursor c(dbt, m_tableAddressIndex);
+	return c.Get(AddressIndexKey(scriptHash, ADDRESS_INDEX_COUNT_PAGE)) ? GetLeUInt32(c.get_Data().data()) : 0;
+}
+
+void DbliteBlockChainDb::PutAddressIndexCount(DbTransaction& dbt, const HashValue& scriptHash, uint32_t n, int64_t dBalance, int64_t dReceived) {
+	Blob key = AddressIndexKey(scriptHash, ADDRESS_INDEX_COUNT_PAGE);
+	if (!n) {
+		m_tableAddressIndex.Delete(dbt, key);
+		return;
+	}
+	uint8_t buf[ADDRESS_INDEX_COUNT_SIZE] = { 0 };
+	size_t size = sizeof buf;
+	DbCursor c(dbt, m_tableAddressIndex);
+	if (c.Get(key)) {
+		Span old = c.get_Data();
+		if (old.size() < ADDRESS_INDEX_COUNT_SIZE)
+			size = old.size();								// no totals
+		else
+			memcpy(buf, old.data(), sizeof buf);
+	}
+	PutLeUInt32(buf, n);
+	if (size == ADDRESS_INDEX_COUNT_SIZE) {
+		uint64_t leBalance = htole(GetLeUInt64(buf + 4) + uint64_t(dBalance)),
+			leReceived = htole(GetLeUInt64(buf + 12) + uint64_t(dReceived));
+		memcpy(buf + 4, &leBalance, sizeof leBalance);
+		memcpy(buf + 12, &leReceived, sizeof leReceived);
+	}
+	m_tableAddressIndex.Put(dbt, key, Span(buf, size));
+}
+
+optional<AddressIndexTotals> DbliteBlockChainDb::GetAddressIndexTotals(const HashValue& scriptHash) {
+	DbReadTxRef dbt(m_db);
+	DbCursor c(dbt, m_tableAddressIndex);
+	AddressIndexTotals r = { 0, 0 };
+	if (c.Get(AddressIndexKey(scriptHash, ADDRESS_INDEX_COUNT_PAGE))) {
+		Span data = c.get_Data();
+		if (data.size() < ADDRESS_INDEX_COUNT_SIZE)
+			return nullopt;
+		r.Balance = int64_t(GetLeUInt64(data.data() + 4));
+		r.Received = int64_t(GetLeUInt64(data.data() + 12));
+	}
+	return r;
+}
+
+static void AddToTotals(const AddressIndexEntry& e, int sign, int64_t& dBalance, int64_t& dReceived) {
+	if (e.IsInput)
+		dBalance -= sign * e.Value;
+	else {
+		dBalance += sign * e.Value;
+		dReceived += sign * e.Value;
+	}
+}
+
+void DbliteBlockChainDb::AppendAddressIndex(DbTransaction& dbt, const HashValue& scriptHash, const vector<AddressIndexEntry>& entries) {
+	uint32_t n = GetAddressIndexCount(dbt, scriptHash),
+		nPage = n / ADDRESS_INDEX_PAGE_ENTRIES;
+	Blob page;
+	if (n % ADDRESS_INDEX_PAGE_ENTRIES) {
+		DbCursor c(dbt, m_tableAddressIndex);
+		if (!c.Get(AddressIndexKey(scriptHash, nPage)))
+			Throw(CoinErr::InconsistentDatabase);
+		page = Blob(c.get_Data());
+	}
+	int64_t dBalance = 0, dReceived = 0;
+	for (auto& e : entries) {
+		AddToTotals(e, 1, dBalance, dReceived);
+		size_t off = page.size();
+		page.resize(off + ADDRESS_INDEX_ENTRY_SIZE);
+		WriteAddressIndexEntry(page.data() + off, e);
+		if (!(++n % ADDRESS_INDEX_PAGE_ENTRIES)) {
+			m_tableAddressIndex.Put(dbt, AddressIndexKey(scriptHash, nPage++), page);
+			page = Blob();
+		}
+	}
+	if (page.size())
+		m_tableAddressIndex.Put(dbt, AddressIndexKey(scriptHash, nPage), page);
+	PutAddressIndexCount(dbt, scriptHash, n, dBalance, dReceived);
+}
+
+// Entries of the Tx are the tail, because blocks are disconnected in reverse order
+void DbliteBlockChainDb::TruncateAddressIndex(DbTransaction& dbt, const HashValue& scriptHash, int height, uint32_t txPos) {
+	uint32_t n = GetAddressIndexCount(dbt, scriptHash);
+	int64_t dBalance = 0, dReceived = 0;
+	DbCursor c(dbt, m_tableAddressIndex);
+	while (n) {
+		uint32_t nPage = (n - 1) / ADDRESS_INDEX_PAGE_ENTRIES;
+		Blob key = AddressIndexKey(scriptHash, nPage);
+		if (!c.Get(key))
+			Throw(CoinErr::InconsistentDatabase);
+		Blob page(c.get_Data());
+		uint32_t nInPage = n - nPage * ADDRESS_INDEX_PAGE_ENTRIES;
+		for (const uint8_t *p; nInPage && !AddressIndexEntryLess(p = page.constData() + (nInPage - 1) * ADDRESS_INDEX_ENTRY_SIZE, height, txPos); --nInPage, --n)
+			AddToTotals(ReadAddressIndexEntry(p), -1, dBalance, dReceived);
+		if (!nInPage)
+			c.Delete();
+		else {
+			page.resize(nInPage * ADDRESS_INDEX_ENTRY_SIZE);
+			c.Put(key, page);
+			break;
+		}
+	}
+	PutAddressIndexCount(dbt, scriptHash, n, dBalance, dReceived);
+}
+
+bool DbliteBlockChainDb::MarkAddressIndexSpent(DbTransaction& dbt, const HashValue& scriptHash, const OutPoint& op, int32_t spentHeight) {
+	DbCursor cTx(dbt, m_tableTxes);						// one Txes lookup per spent input to get the (height, txPos) of the prevout
+	TxDatas txDatas = FindTxDatas(cTx, Span(op.TxHash.data(), 8));
+	if (!txDatas || size_t(txDatas.Index) >= txDatas.Items.size())
+		return false;
+	const TxData& txData = txDatas.Items[txDatas.Index];
+	int height = txData.Height;
+	uint32_t txPos = txData.N;
+
+	uint32_t n = GetAddressIndexCount(dbt, scriptHash),
+		nPages = (n + ADDRESS_INDEX_PAGE_ENTRIES - 1) / ADDRESS_INDEX_PAGE_ENTRIES,
+		lo = 0, hi = nPages;
+	DbCursor c(dbt, m_tableAddressIndex);
+	while (hi - lo > 1) {						// last page starting before (height, txPos)
+		uint32_t mid = (lo + hi) / 2;
+		if (!c.Get(AddressIndexKey(scriptHash, mid)))
+			Throw(CoinErr::InconsistentDatabase);
+		if (AddressIndexEntryLess(c.get_Data().data(), height, txPos))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	for (uint32_t nPage = lo; nPage < nPages; ++nPage) {
+		Blob key = AddressIndexKey(scriptHash, nPage);
+		if (!c.Get(key))
+			Throw(CoinErr::InconsistentDatabase);
+		Blob page(c.get_Data());
+		for (size_t off = 0; off < page.size(); off += ADDRESS_INDEX_ENTRY_SIZE) {
+			uint8_t *p = page.data() + off;
+			if (AddressIndexEntryLess(p, height, txPos))
+				continue;
+			if (int32_t(GetLeUInt32(p)) != height || GetLeUInt32(p + 4) != txPos)
+				return false;
+			if (GetLeUInt32(p + 8) == uint32_t(op.Index)) {		// output entry, inputs have ADDRESS_INDEX_INPUT_FLAG
+				PutLeUInt32(p + 52, uint32_t(spentHeight));
+				c.Put(key, page);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Spent values come from the TxoMap of the block being connected; MarkAddressIndexSpent() still reads the Txes table per input
+void DbliteBlockChainDb::InsertAddressIndex(DbTransaction& dbt, const Tx& tx, uint32_t nTx, const HashValue& txHash, int height, const ITxoMap& txoMap) {
+	unordered_map<HashValue, vector<AddressIndexEntry>> entries;
+	AddressIndexEntry e;
+	e.HashTx = txHash;
+	e.Height = height;
+	e.TxPos = nTx;
+	e.SpentHeight = -1;
+	e.IsInput = false;
+	const vector<TxOut>& txOuts = tx.TxOuts();
+	for (e.Index = 0; e.Index < txOuts.size(); ++e.Index) {
+		const TxOut& txOut = txOuts[e.Index];
+		if (optional<HashValue> scriptHash = AddressIndexScriptHash(Eng, txOut)) {
+			e.Value = txOut.Value;
+			entries[scriptHash.value()].push_back(e);
+		}
+	}
+	if (!tx->IsCoinBase()) {
+		e.IsInput = true;
+		const vector<TxIn>& txIns = tx.TxIns();
+		for (e.Index = 0; e.Index < txIns.size(); ++e.Index) {
+			const OutPoint& op = txIns[e.Index].PrevOutPoint;
+			Txo txo = txoMap.Get(op);
+			if (optional<HashValue> scriptHash = AddressIndexScriptHash(Eng, txo)) {
+				e.Value = txo.Value;
+				MarkAddressIndexSpent(dbt, scriptHash.value(), op, height);
+				entries[scriptHash.value()].push_back(e);
+			}
+		}
+	}
+	for (auto& kv : entries)
+		AppendAddressIndex(dbt, kv.first, kv.second);
+}
+
+void DbliteBlockChainDb::DeleteAddressIndex(const Tx& tx, uint32_t nTx, int height) {
+	if (Eng.Mode != EngMode::BlockExplorer)
+		return;
+	DbTxRef dbt(m_db);
+	unordered_set<HashValue> scriptHashes;
+	for (auto& txOut : tx.TxOuts())
+		if (optional<HashValue> scriptHash = AddressIndexScriptHash(Eng, txOut))
+			scriptHashes.insert(scriptHash.value());
+	if (!tx->IsCoinBase()) {
+		for (auto& txIn : tx.TxIns()) {			// disconnection is rare, prevouts are read from the DB
+			Tx txPrev = Tx::FromDb(txIn.PrevOutPoint.TxHash);
+			if (optional<HashValue> scriptHash = AddressIndexScriptHash(Eng, txPrev.TxOuts().at(txIn.PrevOutPoint.Index))) {
+				MarkAddressIndexSpent(dbt, scriptHash.value(), txIn.PrevOutPoint, -1);
+				scriptHashes.insert(scriptHash.value());
+			}
+		}
+	}
+	for (auto& scriptHash : scriptHashes)
+		TruncateAddressIndex(dbt, scriptHash, height, nTx);
+	dbt.CommitIfLocal();
+}
+
+uint32_t DbliteBlockChainDb::FindAddressIndexOrdinal(const HashValue& scriptHash, int height) {
+	DbReadTxRef dbt(m_db);
+	uint32_t n = GetAddressIndexCount(dbt, scriptHash),
+		lo = 0, hi = (n + ADDRESS_INDEX_PAGE_ENTRIES - 1) / ADDRESS_INDEX_PAGE_ENTRIES;
+	if (!hi || height <= 0)
+		return 0;
+	DbCursor c(dbt, m_tableAddressIndex);
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		if (!c.Get(AddressIndexKey(scriptHash, mid)))
+			Throw(CoinErr::InconsistentDatabase);
+		if (AddressIndexEntryLess(c.get_Data().data(), height, 0))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (!c.Get(AddressIndexKey(scriptHash, lo)))
+		Throw(CoinErr::InconsistentDatabase);
+	Span page = c.get_Data();
+	uint32_t r = lo * ADDRESS_INDEX_PAGE_ENTRIES;
+	for (size_t off = 0; off < page.size() && AddressIndexEntryLess(page.data() + off, height, 0); off += ADDRESS_INDEX_ENTRY_SIZE)
+		++r;
+	return r;
+}
+
+vector<AddressIndexEntry> DbliteBlockChainDb::ReadAddressIndex(const HashValue& scriptHash, uint32_t ordinal, size_t maxCount) {
+	vector<AddressIndexEntry> r;
+	DbReadTxRef dbt(m_db);
+	uint32_t n = GetAddressIndexCount(dbt, scriptHash);
+	DbCursor c(dbt, m_tableAddressIndex);
+	while (ordinal < n && r.size() < maxCount) {
+		if (!c.Get(AddressIndexKey(scriptHash, ordinal / ADDRESS_INDEX_PAGE_ENTRIES)))
+			Throw(CoinErr::InconsistentDatabase);
+		Span page = c.get_Data();
+		for (size_t off = (ordinal % ADDRESS_INDEX_PAGE_ENTRIES) * ADDRESS_INDEX_ENTRY_SIZE; off < page.size() && r.size() < maxCount; off += ADDRESS_INDEX_ENTRY_SIZE, ++ordinal)
+			r.push_back(ReadAddressIndexEntry(page.data() + off));
+	}
+	return r;
+}
+
 vector<bool> DbliteBlockChainDb::GetCoinsByTxHash(const HashValue& hash) {
 	TxDatas txDatas = GetTxDatas(hash);
 	const TxData& txData = txDatas.Items[txDatas.Index];
@@ -1148,7 +1505,15 @@ void DbliteBlockChainDb::SaveCoinsByTxHash(const HashValue& hash, const vector<b
 	dbt.CommitIfLocal();
 }
 
+uint32_t DbliteBlockChainDb::TxOffsetOf(const TxData& txData) const {
+	return Eng.Mode == EngMode::Bootstrap ? txData.TxOffset : GetLeUInt32(txData.Data.constData());
+}
+
 void DbliteBlockChainDb::UpdateCoins(const OutPoint& op, bool bSpend, int32_t heightCur) {
+	UpdateCoins(op, bSpend, heightCur, nullptr);
+}
+
+void DbliteBlockChainDb::UpdateCoins(const OutPoint& op, bool bSpend, int32_t heightCur, BlockUndo *undo) {
 	Span txid8 = Span(op.TxHash.data(), 8);
 	DbTxRef dbt(m_db);
 	DbCursor cTxes(dbt, m_tableTxes);
@@ -1163,6 +1528,8 @@ void DbliteBlockChainDb::UpdateCoins(const OutPoint& op, bool bSpend, int32_t he
 		uint8_t* p = txData.Utxo.data();
 		if (pos >= txData.Utxo.size() || !(p[pos] & mask))
 			Throw(CoinErr::InputsAlreadySpent);
+		if (undo)
+			undo->Add(op, txData, TxOffsetOf(txData));
 		p[pos] &= ~mask;
 		size_t i;
 		for (i = txData.Utxo.size(); i-- && !p[i];)
@@ -1171,8 +1538,7 @@ void DbliteBlockChainDb::UpdateCoins(const OutPoint& op, bool bSpend, int32_t he
 			txData.Utxo.resize(i + 1);
 		if (txData.Utxo.size() == 0) {
 			if (Eng.Mode == EngMode::Bootstrap || UCFG_COIN_TXES_IN_BLOCKTABLE) {
-				uint32_t txOffset = Eng.Mode == EngMode::Bootstrap ? txData.TxOffset : GetLeUInt32(txData.Data.constData());
-				SpentTx stx = { op.TxHash, txData.Height, txOffset, txData.N };
+				SpentTx stx = { op.TxHash, txData.Height, TxOffsetOf(txData), txData.N };
 				Eng.Caches.Add(stx);
 			}
 			txData.LastSpendHeight = heightCur;
@@ -1310,14 +1676,103 @@ void DbliteBlockChainDb::InsertSpentTxOffsets(const unordered_map<HashValue, Spe
 	dbt.CommitIfLocal();
 }
 
-void DbliteBlockChainDb::SpendInputs(const Tx& tx) {
+void DbliteBlockChainDb::SpendInputs(const Tx& tx, BlockUndo *undo) {
 	if (!tx->IsCoinBase()) {
 		EXT_FOR(const TxIn& txIn, tx.TxIns()) {
-			UpdateCoins(txIn.PrevOutPoint, true, tx.Height);
+			UpdateCoins(txIn.PrevOutPoint, true, tx.Height, undo);
 		}
 	}
 }
 
+void DbliteBlockChainDb::BlockUndo::Add(const OutPoint& op, const TxData& txData, uint32_t txOffset) {
+	auto pp = m_index.insert(make_pair(op.TxHash, Items.size()));
+	if (pp.second) {
+		SpentTxOuts item = { op.TxHash, txData.Height, txOffset, txData.N };
+		Items.push_back(item);
+	}
+	Items[pp.first->second].Outs.push_back(op.Index);
+}
+
+// CompactSize(nItems) || { HashTx, CompactSize(Height), CompactSize(TxOffset), CompactSize(N), CompactSize(nOuts), CompactSize(Out)... }
+void DbliteBlockChainDb::BlockUndo::Write(BinaryWriter& wr) const {
+	CoinSerialized::WriteCompactSize(wr, Items.size());
+	for (auto& item : Items) {
+		wr << item.HashTx;
+		CoinSerialized::WriteCompactSize(wr, item.Height);
+		CoinSerialized::WriteCompactSize(wr, item.TxOffset);
+		CoinSerialized::WriteCompactSize(wr, item.N);
+		CoinSerialized::WriteCompactSize(wr, item.Outs.size());
+		for (uint32_t idx : item.Outs)
+			CoinSerialized::WriteCompactSize(wr, idx);
+	}
+}
+
+void DbliteBlockChainDb::BlockUndo::Read(const BinaryReader& rd) {
+	Items.resize(CoinSerialized::ReadCompactSize(rd));
+	for (auto& item : Items) {
+		rd >> item.HashTx;
+		item.Height = CoinSerialized::ReadCompactSize(rd);
+		item.TxOffset = CoinSerialized::ReadCompactSize(rd);
+		item.N = (uint16_t)CoinSerialized::ReadCompactSize(rd);
+		item.Outs.resize(CoinSerialized::ReadCompactSize(rd));
+		for (auto& idx : item.Outs)
+			idx = CoinSerialized::ReadCompactSize(rd);
+	}
+}
+
+bool DbliteBlockChainDb::HaveBlockUndo(int height) {
+	if (m_db.UserVersion < DB_VER_BLOCK_UNDO)
+		return false;
+	DbReadTxRef dbt(m_db);
+	DbCursor c(dbt, m_tableUndo);
+	return c.Get(BlockKey(height));
+}
+
+bool DbliteBlockChainDb::RestoreSpentCoins(int height) {
+	if (m_db.UserVersion < DB_VER_BLOCK_UNDO)
+		return false;
+	DbTxRef dbt(m_db);
+	BlockUndo undo;
+	{
+		DbCursor c(dbt, m_tableUndo);
+		if (!c.Get(BlockKey(height)))
+			return false;
+		undo.Read(BinaryReader(c.DataStream));
+	}
+	DbCursor cTxes(dbt, m_tableTxes);
+	for (auto& item : undo.Items) {
+		Span txid8(item.HashTx.data(), 8);
+		TxDatas txDatas = FindTxDatas(cTxes, txid8);
+		if (!txDatas) {															// fully spent and pruned
+			uint32_t leOffset = htole(item.TxOffset);
+			InsertTx(Tx(), item.N, TxHashesOutNums(), item.HashTx, item.Height, Span(), Span()
+				, Eng.Mode == EngMode::Bootstrap ? Span() : Span((const uint8_t*)&leOffset, 3), item.TxOffset);
+			if (!(txDatas = FindTxDatas(cTxes, txid8)))
+				Throw(CoinErr::InconsistentDatabase);
+		}
+		TxData& txData = txDatas.Items[txDatas.Index];
+		for (uint32_t idx : item.Outs) {
+			int pos = idx >> 3;
+			if (pos >= txData.Utxo.size())
+				txData.Utxo.resize(pos + 1);
+			txData.Utxo.data()[pos] |= 1 << (idx & 7);
+		}
+		PutTxDatas(cTxes, TxKey(txid8), txDatas, true);
+	}
+	dbt.CommitIfLocal();
+	return true;
+}
+
+void DbliteBlockChainDb::PruneBlockUndo(int height) {
+	if (m_db.UserVersion < DB_VER_BLOCK_UNDO)
+		return;
+	DbTxRef dbt(m_db);
+	DbCursor c(dbt, m_tableUndo);
+	if (c.Get(BlockKey(height)))
+		c.Delete();
+	dbt.CommitIfLocal();
+}
+
 void DbliteBlockChainDb::InsertHeader(const BlockHeader& header, bool bUpdateMaxHeight) {
 	int32_t height = header.Height;
 	ASSERT(height < 0xFFFFFF);
@@ -1465,8 +1920,20 @@ void DbliteBlockChainDb::InsertBlock(const Block& block, CConnectJob& job) {
 			uint32_t leOffset = htole(txOffset);
 			InsertTx(tx, (uint16_t)nTx, txHashOutNums, Coin::Hash(tx), height, Span(), CoinEng::SpendVectorToBlob(vector<bool>(tx.TxOuts().size(), true)), Span((const uint8_t*)& leOffset, 3), txOffset);
 		}
-		for (auto& tx : txes)
-			SpendInputs(tx);
+		if (Eng.Mode == EngMode::BlockExplorer)
+			for (int nTx = 0; nTx < txes.size(); ++nTx)
+				InsertAddressIndex(dbt, txes[nTx], (uint32_t)nTx, Coin::Hash(txes[nTx]), height, job.TxoMap);
+		{
+			BlockUndo undo;
+			for (auto& tx : txes)
+				SpendInputs(tx, &undo);
+			if (m_db.UserVersion >= DB_VER_BLOCK_UNDO && !undo.Items.empty()) {
+				MemoryStream msUndo;
+				BinaryWriter wrUndo(msUndo);
+				undo.Write(wrUndo);
+				m_tableUndo.Put(dbt, blockKey, msUndo);
+			}
+		}
 		break;
 	}
 
@@ -1532,6 +1999,33 @@ void DbliteBlockChainDb::SetFilter(CoinFilter* filter) {
 	}
 }
 
+optional<Blob> DbliteBlockChainDb::FindBlockFilter(int height) {
+	if (m_db.UserVersion < DB_VER_BLOCK_FILTERS)
+		return nullopt;
+	DbReadTxRef dbt(m_db);
+	DbCursor c(dbt, m_tableBlockFilters);
+	if (!c.Get(BlockKey(height)))
+		return nullopt;
+	Span data = c.get_Data();
+	return Blob(data.data() + 32, data.size() - 32);
+}
+
+optional<HashValue> DbliteBlockChainDb::FindBlockFilterHeader(int height) {
+	if (m_db.UserVersion < DB_VER_BLOCK_FILTERS)
+		return nullopt;
+	DbReadTxRef dbt(m_db);
+	DbCursor c(dbt, m_tableBlockFilters);
+	if (!c.Get(BlockKey(height)))
+		return nullopt;
+	return HashValue(c.get_Data().data());
+}
+
+void DbliteBlockChainDb::InsertBlockFilter(int height, RCSpan filter, const HashValue& filterHeader) {
+	DbTxRef dbt(m_db);
+	m_tableBlockFilters.Put(dbt, BlockKey(height), Blob(filterHeader.ToSpan()) + Blob(filter));
+	dbt.CommitIfLocal();
+}
+
 
 } // namespace Coin
 
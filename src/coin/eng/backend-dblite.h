@@ -18,6 +18,7 @@ const size_t BLOCKID_SIZE = 3;
 const size_t TXID_SIZE = 6;				// Probability of collision 1/16M
 const size_t PUBKEYID_SIZE = 5;
 const size_t PUBKEYTOTXES_ID_SIZE = 8;
+const size_t ADDRESS_INDEX_KEY_SIZE = 32 + 4;		// ScriptHash || BE PageNumber
 
 class DbliteBlockChainDb;
 }
@@ -92,7 +93,7 @@ public:
 	CoinEng& Eng;
 	mutex MtxDb;
 	DbStorage m_db;
-	DbTable m_tableBlocks, m_tableHashToBlock, m_tableTxes, m_tablePubkeys, m_tablePubkeyToTxes, m_tableProperties;
+	DbTable m_tableBlocks, m_tableHashToBlock, m_tableTxes, m_tablePubkeys, m_tablePubkeyToTxes, m_tableProperties, m_tableBlockFilters, m_tableAddressIndex, m_tableUndo;
 
 	DbliteBlockChainDb(CoinEng& eng);
 
@@ -124,7 +125,9 @@ public:
 	int GetMaxHeaderHeight() override;
 	TxHashesOutNums GetTxHashesOutNums(int height) override;
 	pair<OutPoint, TxOut> GetOutPointTxOut(int height, int idxOut) override;
-	void SpendInputs(const Tx& tx);
+
+	class BlockUndo;
+	void SpendInputs(const Tx& tx, BlockUndo *undo = nullptr);
 
 	class TxData {
 	public:
@@ -171,6 +174,25 @@ public:
 		explicit operator bool() const { return !Items.empty(); }
 	};
 
+	// Coordinates of the txes whose outputs a block spends, so that Disconnect restores them without scanning the chain for pruned TxDatas
+	class BlockUndo {
+	public:
+		struct SpentTxOuts {
+			HashValue HashTx;
+			uint32_t Height, TxOffset;
+			uint16_t N;
+			vector<uint32_t> Outs;
+		};
+
+		vector<SpentTxOuts> Items;
+
+		void Add(const OutPoint& op, const TxData& txData, uint32_t txOffset);
+		void Write(BinaryWriter& wr) const;
+		void Read(const BinaryReader& rd);
+	private:
+		unordered_map<HashValue, size_t> m_index;
+	};
+
 	Span TxKey(const HashValue& txHash) { return Span(txHash.data(), TXID_SIZE); }
 	Span TxKey(RCSpan txid8) { return Span(txid8.data(), TXID_SIZE); }
 
@@ -188,6 +210,17 @@ public:
 	void InsertPubkeyToTxes(DbTransaction& dbTx, const Tx& tx);
 	vector<int64_t> GetTxesByPubKey(const HashValue160& pubkey) override;
 
+	uint32_t GetAddressIndexCount(DbReadTransaction& dbt, const HashValue& scriptHash);
+	void PutAddressIndexCount(DbTransaction& dbt, const HashValue& scriptHash, uint32_t n, int64_t dBalance, int64_t dReceived);
+	void AppendAddressIndex(DbTransaction& dbt, const HashValue& scriptHash, const vector<AddressIndexEntry>& entries);
+	void TruncateAddressIndex(DbTransaction& dbt, const HashValue& scriptHash, int height, uint32_t txPos);
+	bool MarkAddressIndexSpent(DbTransaction& dbt, const HashValue& scriptHash, const OutPoint& op, int32_t spentHeight);
+	void InsertAddressIndex(DbTransaction& dbt, const Tx& tx, uint32_t nTx, const HashValue& txHash, int height, const ITxoMap& txoMap);
+	optional<AddressIndexTotals> GetAddressIndexTotals(const HashValue& scriptHash) override;
+	uint32_t FindAddressIndexOrdinal(const HashValue& scriptHash, int height) override;
+	vector<AddressIndexEntry> ReadAddressIndex(const HashValue& scriptHash, uint32_t ordinal, size_t maxCount) override;
+	void DeleteAddressIndex(const Tx& tx, uint32_t nTx, int height) override;
+
 	void InsertTx(const Tx& tx, uint16_t nTx, const TxHashesOutNums& hashesOutNums, const HashValue& txHash, int height, RCSpan txIns, RCSpan spend, RCSpan data, uint32_t txOffset) override;
 	void InsertSpentTxOffsets(const unordered_map<HashValue, SpentTx>& spentTxOffsets) override;
 
@@ -198,6 +231,9 @@ public:
 	void SaveCoinsByTxHash(const HashValue& hash, const vector<bool>& vec) override;
 	void UpdateCoins(const OutPoint& op, bool bSpend, int32_t heightCur) override;
 	void PruneTxo(const OutPoint& op, int32_t heightCur) override;
+	bool HaveBlockUndo(int height) override;
+	bool RestoreSpentCoins(int height) override;
+	void PruneBlockUndo(int height) override;
 
 	void BeginEngTransaction() override {
 		Throw(E_NOTIMPL);
@@ -210,6 +246,10 @@ public:
 	ptr<CoinFilter> GetFilter() override;
 	void SetFilter(CoinFilter* filter) override;
 
+	optional<Blob> FindBlockFilter(int height) override;
+	optional<HashValue> FindBlockFilterHeader(int height) override;
+	void InsertBlockFilter(int height, RCSpan filter, const HashValue& filterHeader) override;
+
 	void BeginTransaction() override {
 //		ASSERT(!m_dbt.get());
 //		m_dbt.reset(new MdbTransaction(m_db));
@@ -237,11 +277,15 @@ public:
 	vector<BlockHeader> GetBlockHeaders(const LocatorHashes& locators, const HashValue& hashStop) override;
 protected:
 	virtual void OnOpenTables(DbTransaction& dbt, bool bCreate) {}
+	virtual void OnUpgradeTables(DbTransaction& dbt, const Version& dbVer) {}
 private:
 	HashValue ReadPrevBlockHash(DbReadTransaction& dbt, int height, bool bFromBlock = false);
 	BlockHeader LoadHeader(DbReadTransaction& dbt, int height, Stream& stmBlocks, int hMaxBlock = -2);
+	void UpdateCoins(const OutPoint& op, bool bSpend, int32_t heightCur, BlockUndo *undo);
+	uint32_t TxOffsetOf(const TxData& txData) const;
 	Blob ReadBlob(uint64_t offset, uint32_t size) override;
 	void CopyTo(uint64_t offset, uint32_t size, Stream& stm) override;
+	Span MappedSpan(uint64_t offset, uint32_t size) override;
 	Block LoadBlock(DbReadTransaction& dbt, int height, Stream& stmBlocks, bool bFullRead = true);
 	bool TryToConvert(const path& p);
 	uint64_t GetBlockOffset(int height);
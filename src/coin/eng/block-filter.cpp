@@ -0,0 +1,350 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#include <el/crypto/hash.h>
+
+#include "script.h"
+#include "eng.h"
+#include "block-filter.h"
+
+namespace Coin {
+
+static uint64_t MulHigh64(uint64_t a, uint64_t b) {
+	uint64_t aLo = uint32_t(a), aHi = a >> 32,
+		bLo = uint32_t(b), bHi = b >> 32;
+	uint64_t mid1 = aHi * bLo + (aLo * bLo >> 32),
+		mid2 = aLo * bHi + uint32_t(mid1);
+	return aHi * bHi + (mid1 >> 32) + (mid2 >> 32);
+}
+
+class GcsBitWriter {
+public:
+	vector<uint8_t> Bytes;
+
+	GcsBitWriter()
+		: m_nBits(0)
+	{}
+
+	void WriteBit(bool bit) {
+		if (!(m_nBits & 7))
+			Bytes.push_back(0);
+		if (bit)
+			Bytes.back() |= 0x80 >> (m_nBits & 7);
+		++m_nBits;
+	}
+
+	void WriteBits(uint64_t v, int n) {			// MSB first
+		while (n--)
+			WriteBit((v >> n) & 1);
+	}
+
+	void GolombRiceEncode(uint64_t x, int p) {
+		for (uint64_t q = x >> p; q--;)
+			WriteBit(true);
+		WriteBit(false);
+		WriteBits(x, p);
+	}
+private:
+	size_t m_nBits;
+};
+
+class GcsBitReader {
+public:
+	GcsBitReader(const uint8_t *p, const uint8_t *end)
+		: m_p(p)
+		, m_end(end)
+		, m_nBit(0)
+	{}
+
+	bool ReadBit() {
+		if (m_p == m_end)
+			Throw(CoinErr::InconsistentDatabase);
+		bool r = (*m_p >> (7 - m_nBit)) & 1;
+		if (++m_nBit == 8) {
+			m_nBit = 0;
+			++m_p;
+		}
+		return r;
+	}
+
+	uint64_t ReadBits(int n) {
+		uint64_t r = 0;
+		while (n--)
+			r = (r << 1) | ReadBit();
+		return r;
+	}
+
+	uint64_t GolombRiceDecode(int p) {
+		uint64_t q = 0;
+		while (ReadBit())
+			++q;
+		return (q << p) | ReadBits(p);
+	}
+private:
+	const uint8_t *m_p, *m_end;
+	int m_nBit;
+};
+
+void GolombCodedSet::Init(const HashValue& hashBlock, uint64_t n) {
+	m_k0 = letoh(*(const uint64_t*)hashBlock.data());
+	m_k1 = letoh(*(const uint64_t*)(hashBlock.data() + 8));
+	m_n = n;
+	m_f = n * GCS_BASIC_M;
+}
+
+uint64_t GolombCodedSet::HashToRange(RCSpan element) const {
+	hashval hv = SipHash2_4(m_k0, m_k1).ComputeHash(element);
+	return MulHigh64(letoh(*(const uint64_t*)hv.data()), m_f);
+}
+
+GolombCodedSet::GolombCodedSet(const HashValue& hashBlock, RCSpan encoded)
+	: Encoded(encoded)
+{
+	CMemReadStream stm(Encoded);
+	Init(hashBlock, CoinSerialized::ReadCompactSize64(BinaryReader(stm)));
+}
+
+GolombCodedSet::GolombCodedSet(const HashValue& hashBlock, vector<Span>& elements) {
+	sort(elements.begin(), elements.end(), [](const Span& a, const Span& b) {
+		return lexicographical_compare(a.data(), a.data() + a.size(), b.data(), b.data() + b.size());
+	});
+	elements.erase(unique(elements.begin(), elements.end(), [](const Span& a, const Span& b) {
+		return a.size() == b.size() && !memcmp(a.data(), b.data(), a.size());
+	}), elements.end());
+
+	Init(hashBlock, elements.size());
+	vector<uint64_t> values(elements.size());
+	for (size_t i = 0; i < elements.size(); ++i)
+		values[i] = HashToRange(elements[i]);
+	sort(values.begin(), values.end());
+
+	GcsBitWriter bw;
+	uint64_t prev = 0;
+	for (auto v : values)
+		bw.GolombRiceEncode(v - exchange(prev, v), GCS_BASIC_P);
+
+	MemoryStream ms;
+	BinaryWriter wr(ms);
+	CoinSerialized::WriteCompactSize(wr, m_n);
+	if (!bw.Bytes.empty())
+		wr.Write(bw.Bytes.data(), bw.Bytes.size());
+	Encoded = Blob(ms.AsSpan());
+}
+
+bool GolombCodedSet::MatchSorted(const vector<uint64_t>& queries) const {
+	CMemReadStream stm(Encoded);
+	CoinSerialized::ReadCompactSize64(BinaryReader(stm));
+	GcsBitReader rd(Encoded.constData() + stm.Position, Encoded.constData() + Encoded.size());
+	uint64_t value = 0;
+	auto it = queries.begin(), e = queries.end();
+	for (uint64_t i = 0; i < m_n && it != e; ++i) {
+		value += rd.GolombRiceDecode(GCS_BASIC_P);
+		for (; it != e && *it < value; ++it)
+			;
+		if (it != e && *it == value)
+			return true;
+	}
+	return false;
+}
+
+bool GolombCodedSet::Match(RCSpan element) const {
+	return MatchSorted(vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool GolombCodedSet::MatchAny(const vector<Blob>& elements) const {
+	vector<uint64_t> queries(elements.size());
+	for (size_t i = 0; i < elements.size(); ++i)
+		queries[i] = HashToRange(elements[i]);
+	sort(queries.begin(), queries.end());
+	return MatchSorted(queries);
+}
+
+// Basic filter: all output scripts except OP_RETURN ones and scripts of all spent outputs
+Blob BuildBasicBlockFilter(const Block& block, const vector<Blob>& spentScripts) {
+	vector<Span> elements;
+	for (auto& tx : block.get_Txes()) {
+		for (auto& txOut : tx.TxOuts()) {
+			Span script = txOut.get_ScriptPubKey();
+			if (!script.empty() && script[0] != (uint8_t)Opcode::OP_RETURN)
+				elements.push_back(script);
+		}
+	}
+	for (auto& script : spentScripts)
+		if (script.size())
+			elements.push_back(script);
+	return GolombCodedSet(Hash(block), elements).Encoded;
+}
+
+HashValue BlockFilterHeader(RCSpan filter, const HashValue& prevHeader) {
+	HashValue ar[2] = { Hash(filter), prevHeader };
+	return Hash(Span((const uint8_t*)ar, sizeof ar));
+}
+
+bool CoinEng::get_BlockFilterIndexEnabled() {
+	if (!g_conf.BlockFilterIndex)
+		return false;
+	switch (Mode) {
+	case EngMode::Normal:
+	case EngMode::BlockExplorer:
+	case EngMode::Bootstrap:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// A DB upgraded in place without the filter index, or having it disabled for a while, has a gap which is never filled
+bool CoinEng::get_BlockFilterIndexComplete() {
+	return BlockFilterIndexEnabled && Db->FindBlockFilterHeader(BestBlockHeight());
+}
+
+// Filter headers chain from Genesis, so the index is not extended beyond a gap
+void CoinEng::IndexBlockFilter(const Block& block, const vector<Blob>& spentScripts) {
+	int height = block.Height;
+	HashValue prevHeader;
+	if (height > 0) {
+		if (optional<HashValue> o = Db->FindBlockFilterHeader(height - 1))
+			prevHeader = o.value();
+		else
+			return;
+	}
+	Blob filter = BuildBasicBlockFilter(block, spentScripts);
+	Db->InsertBlockFilter(height, filter, BlockFilterHeader(filter, prevHeader));
+}
+
+void GetCFiltersMessage::Write(ProtocolWriter& wr) const {
+	wr << FilterType << StartHeight << HashStop;
+}
+
+void GetCFiltersMessage::Read(const ProtocolReader& rd) {
+	rd >> FilterType >> StartHeight >> HashStop;
+}
+
+// Returns height of HashStop or -1 if the request can't be served
+int GetCFiltersMessage::CheckRange(int maxSize) const {
+	CoinEng& eng = Eng();
+	if (FilterType != BLOCK_FILTER_BASIC || !eng.BlockFilterIndexEnabled)
+		return -1;
+	int heightStop = eng.Db->FindHeight(HashStop);
+	if (heightStop < 0 || heightStop > eng.BestBlockHeight() || Hash(eng.Db->FindHeader(heightStop)) != HashStop)
+		return -1;
+	if (int(StartHeight) > heightStop || heightStop - int(StartHeight) >= maxSize)
+		throw PeerMisbehavingException(100);
+	return heightStop;
+}
+
+void GetCFiltersMessage::Process(Link& link) {
+	CoinEng& eng = Eng();
+	int heightStop = CheckRange(MAX_GETCFILTERS_SIZE);
+	for (int h = StartHeight; h <= heightStop; ++h) {
+		optional<Blob> filter = eng.Db->FindBlockFilter(h);
+		if (!filter)
+			break;
+		ptr<CFilterMessage> m = new CFilterMessage;
+		m->FilterType = FilterType;
+		m->HashBlock = Hash(eng.Db->FindHeader(h));
+		m->Filter = filter.value();
+		link.Send(m);
+	}
+}
+
+void GetCFHeadersMessage::Process(Link& link) {
+	CoinEng& eng = Eng();
+	int heightStop = CheckRange(MAX_GETCFHEADERS_SIZE);
+	if (heightStop < 0)
+		return;
+	ptr<CFHeadersMessage> m = new CFHeadersMessage;
+	m->FilterType = FilterType;
+	m->HashStop = HashStop;
+	if (StartHeight > 0) {
+		optional<HashValue> o = eng.Db->FindBlockFilterHeader(StartHeight - 1);
+		if (!o)
+			return;
+		m->PrevFilterHeader = o.value();
+	}
+	for (int h = StartHeight; h <= heightStop; ++h) {
+		optional<Blob> filter = eng.Db->FindBlockFilter(h);
+		if (!filter)
+			return;
+		m->FilterHashes.push_back(Hash(filter.value()));
+	}
+	link.Send(m);
+}
+
+void GetCFCheckptMessage::Write(ProtocolWriter& wr) const {
+	wr << FilterType << HashStop;
+}
+
+void GetCFCheckptMessage::Read(const ProtocolReader& rd) {
+	rd >> FilterType >> HashStop;
+}
+
+void GetCFCheckptMessage::Process(Link& link) {
+	CoinEng& eng = Eng();
+	if (FilterType != BLOCK_FILTER_BASIC || !eng.BlockFilterIndexEnabled)
+		return;
+	int heightStop = eng.Db->FindHeight(HashStop);
+	if (heightStop < 0 || heightStop > eng.BestBlockHeight() || Hash(eng.Db->FindHeader(heightStop)) != HashStop)
+		return;
+	ptr<CFCheckptMessage> m = new CFCheckptMessage;
+	m->FilterType = FilterType;
+	m->HashStop = HashStop;
+	for (int h = CFCHECKPT_INTERVAL; h <= heightStop; h += CFCHECKPT_INTERVAL) {
+		optional<HashValue> o = eng.Db->FindBlockFilterHeader(h);
+		if (!o)
+			return;
+		m->FilterHeaders.push_back(o.value());
+	}
+	link.Send(m);
+}
+
+void CFilterMessage::Write(ProtocolWriter& wr) const {
+	wr << FilterType << HashBlock;
+	CoinSerialized::WriteSpan(wr, Filter);
+}
+
+void CFilterMessage::Read(const ProtocolReader& rd) {
+	rd >> FilterType >> HashBlock;
+	Filter = CoinSerialized::ReadBlob(rd);
+}
+
+static void WriteHashes(ProtocolWriter& wr, const vector<HashValue>& hashes) {
+	CoinSerialized::WriteCompactSize(wr, hashes.size());
+	for (auto& hash : hashes)
+		wr << hash;
+}
+
+static void ReadHashes(const ProtocolReader& rd, vector<HashValue>& hashes) {
+	auto n = CoinSerialized::ReadCompactSize64(rd);
+	if (n > MAX_GETCFHEADERS_SIZE)
+		Throw(ExtErr::Protocol_Violation);
+	hashes.resize(n);
+	for (auto& hash : hashes)
+		rd >> hash;
+}
+
+void CFHeadersMessage::Write(ProtocolWriter& wr) const {
+	wr << FilterType << HashStop << PrevFilterHeader;
+	WriteHashes(wr, FilterHashes);
+}
+
+void CFHeadersMessage::Read(const ProtocolReader& rd) {
+	rd >> FilterType >> HashStop >> PrevFilterHeader;
+	ReadHashes(rd, FilterHashes);
+}
+
+void CFCheckptMessage::Write(ProtocolWriter& wr) const {
+	wr << FilterType << HashStop;
+	WriteHashes(wr, FilterHeaders);
+}
+
+void CFCheckptMessage::Read(const ProtocolReader& rd) {
+	rd >> FilterType >> HashStop;
+	ReadHashes(rd, FilterHeaders);
+}
+
+} // Coin::
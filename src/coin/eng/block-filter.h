@@ -0,0 +1,141 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// BIP158 Compact Block Filters, served by BIP157 messages
+
+#pragma once
+
+#include "coin-protocol.h"
+
+namespace Coin {
+
+const uint8_t BLOCK_FILTER_BASIC = 0;
+
+const int GCS_BASIC_P = 19;
+const uint64_t GCS_BASIC_M = 784931;
+
+const int CFCHECKPT_INTERVAL = 1000;
+const int MAX_GETCFILTERS_SIZE = 1000,
+	MAX_GETCFHEADERS_SIZE = 2000;
+
+// Golomb-Rice coded set of SipHash'ed elements. Keyed by the first 16 bytes of the block hash
+class GolombCodedSet {
+public:
+	Blob Encoded;				// CompactSize(N) || bit stream
+
+	GolombCodedSet(const HashValue& hashBlock, RCSpan encoded);
+	GolombCodedSet(const HashValue& hashBlock, vector<Span>& elements);		// elements are sorted and deduplicated in place
+
+	uint64_t get_Size() const { return m_n; }
+	DEFPROP_GET(uint64_t, Size);
+
+	bool Match(RCSpan element) const;
+	bool MatchAny(const vector<Blob>& elements) const;
+private:
+	uint64_t m_k0, m_k1;
+	uint64_t m_n, m_f;
+
+	void Init(const HashValue& hashBlock, uint64_t n);
+	uint64_t HashToRange(RCSpan element) const;
+	bool MatchSorted(const vector<uint64_t>& queries) const;
+};
+
+Blob BuildBasicBlockFilter(const Block& block, const vector<Blob>& spentScripts);
+HashValue BlockFilterHeader(RCSpan filter, const HashValue& prevHeader);
+
+class GetCFiltersMessage : public CoinMessage {		// getcfilters, getcfheaders
+	typedef CoinMessage base;
+public:
+	uint8_t FilterType;
+	uint32_t StartHeight;
+	HashValue HashStop;
+
+	GetCFiltersMessage(const char *cmd = "getcfilters")
+		: base(cmd)
+		, FilterType(BLOCK_FILTER_BASIC)
+		, StartHeight(0)
+	{}
+protected:
+	void Write(ProtocolWriter& wr) const override;
+	void Read(const ProtocolReader& rd) override;
+	void Process(Link& link) override;
+	int CheckRange(int maxSize) const;
+};
+
+class GetCFHeadersMessage : public GetCFiltersMessage {
+	typedef GetCFiltersMessage base;
+public:
+	GetCFHeadersMessage()
+		: base("getcfheaders")
+	{}
+protected:
+	void Process(Link& link) override;
+};
+
+class GetCFCheckptMessage : public CoinMessage {
+	typedef CoinMessage base;
+public:
+	uint8_t FilterType;
+	HashValue HashStop;
+
+	GetCFCheckptMessage()
+		: base("getcfcheckpt")
+		, FilterType(BLOCK_FILTER_BASIC)
+	{}
+protected:
+	void Write(ProtocolWriter& wr) const override;
+	void Read(const ProtocolReader& rd) override;
+	void Process(Link& link) override;
+};
+
+class CFilterMessage : public CoinMessage {
+	typedef CoinMessage base;
+public:
+	uint8_t FilterType;
+	HashValue HashBlock;
+	Blob Filter;
+
+	CFilterMessage()
+		: base("cfilter")
+		, FilterType(BLOCK_FILTER_BASIC)
+	{}
+protected:
+	void Write(ProtocolWriter& wr) const override;
+	void Read(const ProtocolReader& rd) override;
+};
+
+class CFHeadersMessage : public CoinMessage {
+	typedef CoinMessage base;
+public:
+	uint8_t FilterType;
+	HashValue HashStop, PrevFilterHeader;
+	vector<HashValue> FilterHashes;
+
+	CFHeadersMessage()
+		: base("cfheaders")
+		, FilterType(BLOCK_FILTER_BASIC)
+	{}
+protected:
+	void Write(ProtocolWriter& wr) const override;
+	void Read(const ProtocolReader& rd) override;
+};
+
+class CFCheckptMessage : public CoinMessage {
+	typedef CoinMessage base;
+public:
+	uint8_t FilterType;
+	HashValue HashStop;
+	vector<HashValue> FilterHeaders;
+
+	CFCheckptMessage()
+		: base("cfcheckpt")
+		, FilterType(BLOCK_FILTER_BASIC)
+	{}
+protected:
+	void Write(ProtocolWriter& wr) const override;
+	void Read(const ProtocolReader& rd) override;
+};
+
+} // Coin::
@@ -168,102 +168,69 @@ const CTxes& BlockObj::get_Txes() const {
 	return m_txes;
 }
 
-HashValue TxHashOf(const TxHashOutNum& hon, int n) {
-	return hon.HashTx;
-}
-
 HashValue BlockObj::HashFromTx(const Tx& tx, int n) const {
 	return Eng().HashFromTx(tx);
 }
 
-#if UCFG_COIN_MERKLE_FUTURES
-static HashValue HashFromTx(CoinEng *peng, const BlockObj *block, int n) {
-	CCoinEngThreadKeeper engKeeper(peng);
-	const Tx& tx = block->get_Txes()[n];
-	HashValue r = block->HashFromTx(tx, n);
-	if (tx->m_nBytesOfHash != 32)
-		tx.SetHash(r);
-	return r;
-}
-
-static HashValue WitnessHashFromTx(CoinEng *peng, const BlockObj *block, int n) {
-    if (n == 0)
-        return HashValue::Null();
-    CCoinEngThreadKeeper engKeeper(peng);
-    return WitnessHash(block->get_Txes()[n]);
-}
-#endif
-
-struct CTxHasher {
-	const BlockObj *m_block;
-#if UCFG_COIN_MERKLE_FUTURES
-	vector<future<HashValue>> *m_pfutures;
-#endif
-    CBool Witness;
-
-	HashValue operator()(const Tx& tx, int n) {
-#if UCFG_COIN_MERKLE_FUTURES
-		return (*m_pfutures)[n].get();
-#else
-        return !Witness ? m_block->HashFromTx(tx, n)
-            : n == 0 ? HashValue::Null() : WitnessHash(tx);
-#endif
-	}
-};
-
-static CCoinMerkleTree CalcTxHashes(const BlockObj& block) {
+static void CalcTxHashRange(const BlockObj& block, bool bWitness, size_t beg, size_t end, HashValue *r) {
 	const CTxes& txes = block.get_Txes();
-#if UCFG_COIN_MERKLE_FUTURES
-	vector<future<HashValue>> futures;
-#endif
-
-	CTxHasher h1 = { &block
-#if UCFG_COIN_MERKLE_FUTURES
-		, &futures
-#endif
-	};
-
-#if UCFG_COIN_MERKLE_FUTURES
-	CoinEng& eng = Eng();
-	futures.reserve(txes.size());
-	for (int i = 0; i < txes.size(); ++i)
-		futures.push_back(std::async(&Coin::HashFromTx, &eng, &block, i));
-#endif
-	return BuildMerkleTree<Coin::HashValue>(txes, h1, &HashValue::Combine);
+	for (size_t i = beg; i < end; ++i) {
+		const Tx& tx = txes[i];
+		if (bWitness)
+			r[i] = i == 0 ? HashValue::Null() : WitnessHash(tx);
+		else {
+			r[i] = block.HashFromTx(tx, int(i));
+			if (tx->m_nBytesOfHash != 32)
+				tx.SetHash(r[i]);
+		}
+	}
 }
 
-static CCoinMerkleTree CalcWitnessTxHashes(const BlockObj& block) {
-    const CTxes& txes = block.get_Txes();
-#if UCFG_COIN_MERKLE_FUTURES
-    vector<future<HashValue>> futures;
-#endif
-
-    CTxHasher h1 = { &block
-#if UCFG_COIN_MERKLE_FUTURES
-        , &futures
-#endif
-    };
-    h1.Witness = true;
+const size_t MERKLE_MIN_TXES_PER_THREAD = 256;
 
+// Tx hashes are calculated in a few contiguous ranges, one thread per range, rather than one future per Tx.
+// Tree levels are then combined by the multi-way SHA-256d kernel
+static HashValue CalcTxMerkleRoot(const BlockObj& block, bool bWitness = false) {
+	size_t n = block.get_Txes().size();
+	vector<HashValue> hashes(n);
 #if UCFG_COIN_MERKLE_FUTURES
-    CoinEng& eng = Eng();
-    futures.reserve(txes.size());
-    for (int i = 0; i < txes.size(); ++i)
-        futures.push_back(std::async(&Coin::WitnessHashFromTx, &eng, &block, i));
+	CoinEng *peng = &Eng();
+	WorkerGrant workers(*peng, n / MERKLE_MIN_TXES_PER_THREAD);
+	size_t nThreads = workers.size();
+	if (nThreads > 1) {
+		size_t chunk = (n + nThreads - 1) / nThreads;
+		vector<future<void>> futures;
+		for (size_t i = chunk; i < n; i += chunk)
+			futures.push_back(std::async(launch::async, [peng, &block, bWitness, i, chunk, n, &hashes] {
+				CCoinEngThreadKeeper engKeeper(peng);
+				CalcTxHashRange(block, bWitness, i, std::min(n, i + chunk), hashes.data());
+			}));
+		CalcTxHashRange(block, bWitness, 0, chunk, hashes.data());
+		for (auto& ft : futures)
+			ft.get();
+	} else
 #endif
-    return BuildMerkleTree<Coin::HashValue>(txes, h1, &HashValue::Combine);
+		CalcTxHashRange(block, bWitness, 0, n, hashes.data());
+	return CalcMerkleRoot(std::move(hashes));
 }
 
 HashValue BlockObj::MerkleRoot(bool bSave) const {
 	if (!bSave)
-		return (m_merkleTree = CalcTxHashes(_self)).empty() ? Coin::HashValue::Null() : m_merkleTree.back();
+		return CalcTxMerkleRoot(_self);
 	if (!m_merkleRoot) {
 		if (m_txHashesOutNums.empty())
 			get_Txes();						// to eliminate dead lock
 		EXT_LOCK (Mtx()) {
 			if (!m_merkleRoot) {
-				m_merkleTree = m_txHashesOutNums.empty() ? CalcTxHashes(_self) : BuildMerkleTree<Coin::HashValue>(m_txHashesOutNums, &TxHashOf, &HashValue::Combine);
-				m_merkleRoot = m_merkleTree.empty() ? Coin::HashValue::Null() : m_merkleTree.back();
+				if (m_txHashesOutNums.empty())
+					m_merkleRoot = CalcTxMerkleRoot(_self);
+				else {
+					vector<HashValue> hashes;
+					hashes.reserve(m_txHashesOutNums.size());
+					for (auto& hon : m_txHashesOutNums)
+						hashes.push_back(hon.HashTx);
+					m_merkleRoot = CalcMerkleRoot(std::move(hashes));
+				}
 			}
 		}
 	}
@@ -302,12 +269,26 @@ const HashValue& BlockObj::Hash() const {
 	return m_hash;
 }
 
+Blob BlockObj::PowHashData() const {
+	return EXT_BIN(Ver << PrevBlockHash << MerkleRoot() << (uint32_t)to_time_t(Timestamp) << get_DifficultyTarget() << Nonce);
+}
+
 HashValue BlockObj::PowHash() const {
 	return Eng().ChainParams.HashAlgo == HashAlgo::SCrypt
-		? ScryptHash(EXT_BIN(Ver << PrevBlockHash << MerkleRoot() << (uint32_t)to_time_t(Timestamp) << get_DifficultyTarget() << Nonce))
+		? ScryptHash(PowHashData())
 		: Hash();
 }
 
+HashValue BlockObj::CachedPowHash() const {
+	CoinEng& eng = Eng();
+	if (eng.ChainParams.HashAlgo != HashAlgo::Sha256) {
+		HashValue hash = Hash();
+		if (auto o = eng.Caches.PowHashCache.Lookup(hash))
+			return o.value();
+	}
+	return PowHash();
+}
+
 Block::Block() {
 	m_pimpl = Eng().CreateBlockObj();
 }
@@ -320,8 +301,7 @@ BlockObj::BlockObj(BlockObj& bo)
 	, m_bTxesLoaded(bo.m_bTxesLoaded)
 	, m_hash(bo.m_hash)
 	, m_txes(bo.m_txes)
-	, m_pMtx(0)
-	, m_merkleTree(bo.m_merkleTree) {
+	, m_pMtx(0) {
 }
 
 mutex& BlockObj::Mtx() const {
@@ -371,6 +351,8 @@ void BlockObj::Write(ProtocolWriter& wr) const {
 void BlockObj::Read(const ProtocolReader& rd) {
 	ReadHeader(rd, false, 0);
 	if (!rd.MayBeHeader || !rd.BaseStream.Eof()) {
+		ptr<BlockArena> arena = new BlockArena;
+		BlockArena::Keeper arenaKeeper(arena);
 		CoinSerialized::Read(rd, m_txes);
 		for (auto& tx : m_txes) {
 			tx->Timestamp = Timestamp;
@@ -421,7 +403,7 @@ BigInteger BlockObj::GetWork() const {
 
 void BlockObj::CheckPow(const Target& target) {
 	if (ProofType() == ProofOf::Work) {
-		HashValue hashPow = PowHash();
+		HashValue hashPow = CachedPowHash();
 		uint8_t ar[33];
 		memcpy(ar, hashPow.data(), 32);
 		ar[32] = 0;
@@ -553,7 +535,7 @@ void BlockObj::CheckHeader() {
 		if (eng.ChainParams.HashAlgo == HashAlgo::Sha256 || eng.ChainParams.HashAlgo == HashAlgo::Prime)
 			CheckPow(DifficultyTarget);
 		else if (Hash() != eng.ChainParams.Genesis) {
-			HashValue hash = PowHash();
+			HashValue hash = CachedPowHash();
 			uint8_t ar[33];
 			memcpy(ar, hash.data(), 32);
 			ar[32] = 0;
@@ -685,13 +667,18 @@ static TxFeeTuple RunConnectAsync(const CConnectJob *pjob, TxObj *to, bool bVeri
 		job.Eng.PatchSigHasher(sigHasher);
 
 		auto& txIns = tx.TxIns();
+		bool bCoinStake = tx->IsCoinStake();
+		vector<pair<TxOut, TxoOrigin>> stakeInputs;
 		for (int nIn = 0; nIn < txIns.size(); ++nIn) {
 			if (job.Failed)
 				break;
 
 			const TxIn& txIn = txIns[nIn];
 			const OutPoint& op = txIn.PrevOutPoint;
-			Txo txo = job.TxoMap.Get(op);
+			TxoOrigin origin;
+			Txo txo = job.TxoMap.Get(op, origin);
+			if (bCoinStake)
+				stakeInputs.push_back(make_pair(txo, origin));
 
 			if (bVerifySignature) { // Skip ECDSA signature verification when connecting blocks (fBlock=true) during initial download
 				sigHasher.m_bWitness = false;
@@ -703,6 +690,8 @@ static TxFeeTuple RunConnectAsync(const CConnectJob *pjob, TxObj *to, bool bVeri
 
 			job.Eng.CheckMoneyRange(nValueIn += txo.Value);
 		}
+		if (bCoinStake)
+			tx->CalcCoinAge(stakeInputs);
 		tx.CheckInOutValue(nValueIn, r.Fee, job.Eng.AllowFreeTxes ? 0 : tx.GetMinFee(1, false), job.DifficultyTarget);
 	} catch (RCExc) {
 		job.Failed = true;
@@ -797,8 +786,6 @@ CConnectJob::CConnectJob(CoinEng& eng)
 }
 
 void CoinEng::ConnectTx(CConnectJob& job, vector<shared_future<TxFeeTuple>>& futsTx, const Tx& tx, int height, bool bVerifySignature) {
-	if (tx->IsCoinStake())
-		tx->GetCoinAge();		// cache CoinAge, which can't be calculated in Pooled Thread
 	auto& txIns = tx.TxIns();
 	for (size_t nIn = 0; nIn < txIns.size(); ++nIn) {
 		const OutPoint& op = txIns[nIn].PrevOutPoint;
@@ -820,6 +807,10 @@ vector<shared_future<TxFeeTuple>> CoinEng::ConnectBlockTxes(CConnectJob& job, co
 
 	vector<shared_future<TxFeeTuple>> futsTx;
 	futsTx.reserve(txes.size());
+	size_t nTxos = 0;
+	for (auto& tx : txes)
+		nTxos += tx.TxIns().size() + tx.TxOuts().size();
+	job.TxoMap.Reserve(nTxos);
 	EXT_FOR(const Tx & tx, txes) {
 		HashValue hashTx = Hash(tx);
 		if (tx->IsCoinBase()) {
@@ -852,27 +843,41 @@ void CConnectJob::AsynchCheckAllSharedFutures(const vector<Tx>& txes, int height
 
 typedef pair<const HashValue160, CConnectJob::PubKeyData> PubKeyTask;
 
-static void CalcPubkeyHash(PubKeyTask *pr) {
-	if (DbPubKeyToHashValue160(pr->second.PubKey).Hash160 != pr->first)
-		pr->second.PubKey = Blob(nullptr);
+static void CalcPubkeyHashes(PubKeyTask *const *tasks, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		PubKeyTask& task = *tasks[i];
+		PubKeyHash160 pkh = DbPubKeyToHashValue160(task.second.PubKey);
+		if (pkh.Hash160 == task.first)
+			task.second.Decoded = pkh;
+		else
+			task.second.PubKey = Blob(nullptr);
+	}
 }
 
+const size_t PUBKEY_MIN_TASKS_PER_THREAD = 64;
+
+// Keys are decompressed and hashed in a few contiguous batches, one thread per batch, rather than one future per key
 void CConnectJob::Calculate() {
+	vector<PubKeyTask*> tasks;
+	for (auto& pr : Map)
+		if (pr.second.IsTask)
+			tasks.push_back(&pr);
+	size_t n = tasks.size();
 #if UCFG_COIN_USE_FUTURES
-	vector<future<void>> futures;
-	for (CMap::iterator it=Map.begin(), e=Map.end(); it!=e; ++it) {
-		if (it->second.IsTask)
-			futures.push_back(std::async(CalcPubkeyHash, &*it));   // by pointer, because async params transferred by value
-	}
-	EXT_FOR (future<void>& fut, futures) {
-		fut.wait();
-	}
-#else
-	for (CMap::iterator it=Map.begin(), e=Map.end(); it!=e; ++it) {
-		if (it->second.IsTask)
-			CalcPubkeyHash(&*it);
+	WorkerGrant workers(Eng, n / PUBKEY_MIN_TASKS_PER_THREAD);
+	size_t nThreads = workers.size();
+	if (nThreads > 1) {
+		size_t chunk = (n + nThreads - 1) / nThreads;
+		vector<future<void>> futures;
+		for (size_t i = chunk; i < n; i += chunk)
+			futures.push_back(std::async(launch::async, CalcPubkeyHashes, &tasks[i], std::min(chunk, n - i)));
+		CalcPubkeyHashes(tasks.data(), chunk);
+		for (auto& ft : futures)
+			ft.get();
+		return;
 	}
 #endif
+	CalcPubkeyHashes(tasks.data(), n);
 }
 
 void BlockHeader::Connect() const {
@@ -899,19 +904,27 @@ void BlockHeader::Connect() const {
 	UpdateLastCheckpointed();
 }
 
+static const uint8_t s_witnessCommitmentSignature[6] = { (uint8_t)Opcode::OP_RETURN, 0x24, 0xAA, 0x21, 0xA9, 0xED };
+
 const uint8_t *Block::GetWitnessCommitment() const {
     auto& txes = get_Txes();
     const uint8_t *r = nullptr;
     if (txes.empty())
         return r;
     for (auto& txOut : txes[0].TxOuts()) {
-        static const uint8_t commitmentSignature[6] = { (uint8_t)Opcode::OP_RETURN, 0x24, 0xAA, 0x21, 0xA9, 0xED };
         Span pkScript = txOut.ScriptPubKey;
-        r = pkScript.size() >= 38 && !memcmp(pkScript.data(), commitmentSignature, sizeof(commitmentSignature)) ? pkScript.data() : r;
+        r = pkScript.size() >= 38 && !memcmp(pkScript.data(), s_witnessCommitmentSignature, sizeof(s_witnessCommitmentSignature)) ? pkScript.data() : r;
     }
     return r;
 }
 
+// BIP141 commitment output with the zero witness reserved value, for the coinbase of a block template
+Blob Block::DefaultWitnessCommitmentScript() const {
+	HashValue ar[2] = { CalcTxMerkleRoot(*m_pimpl, true), HashValue::Null() };
+	HashValue hashWitness = Hash(Span((const uint8_t*)ar, sizeof ar));
+	return Blob(s_witnessCommitmentSignature, sizeof s_witnessCommitmentSignature) + Blob(hashWitness.data(), 32);
+}
+
 // BIP113
 DateTime BlockHeader::GetMedianTimePast() const {
 	CoinEng& eng = Eng();
@@ -958,7 +971,7 @@ void Block::ContextualCheck(const BlockHeader& blockPrev) {
             auto& coinbaseWitness = txes[0].TxIns()[0].Witness;
             if (coinbaseWitness.size() != 1 || coinbaseWitness[0].size() != 32)
                 Throw(CoinErr::BadWitnessNonceSize);
-            HashValue ar[2] = { CalcWitnessTxHashes(*m_pimpl).back(), HashValue(coinbaseWitness[0].data()) };
+            HashValue ar[2] = { CalcTxMerkleRoot(*m_pimpl, true), HashValue(coinbaseWitness[0].data()) };
             auto hashWitness = Hash(Span((const uint8_t*)ar, sizeof ar));
             if (hashWitness != HashValue(witnessCommitment + 6))
                 Throw(CoinErr::BadWitnessMerkleMatch);
@@ -1015,6 +1028,7 @@ void Block::Connect() const {
 		nFees = job.Fee;
 	}
 
+	bool bPubkeyCacheEnabled = eng.Caches.PubkeyCacheEnabled;
 	CBoolKeeper keepDisabledPkCache(eng.Caches.PubkeyCacheEnabled, false);
 	{
 		eng.EnsureTransactionStarted();
@@ -1037,13 +1051,9 @@ void Block::Connect() const {
 				eng.Db->UpdatePubkey(int64_t(CIdPk(it->first)), it->second.PubKey);
 		}
 
-		EXT_LOCK (eng.Caches.Mtx) {
-			for (CConnectJob::CMap::iterator it=job.Map.begin(), e=job.Map.end(); it!=e; ++it) {				//!!!? necessary to sync cache
-				if (it->second.Update) {
-					int64_t id = CIdPk(it->first);
-					eng.Caches.m_cachePkIdToPubKey.erase(id);													// faster than call CanonicalPubKey::FromCompressed()
-				}
-			}
+		for (CConnectJob::CMap::iterator it=job.Map.begin(), e=job.Map.end(); it!=e; ++it) {				//!!!? necessary to sync cache
+			if (it->second.Update)
+				eng.Caches.m_cachePkIdToPubKey.Erase(int64_t(CIdPk(it->first)));							// faster than call CanonicalPubKey::FromCompressed()
 		}
 
 		switch (eng.Mode) {
@@ -1051,6 +1061,8 @@ void Block::Connect() const {
 			eng.Db->InsertBlock(_self, job);
 			break;
 		default:
+			bool bIndexFilter = eng.BlockFilterIndexEnabled;
+			vector<Blob> spentScripts;
 			EXT_FOR (const Tx& tx, txes) {
 				if (!tx->IsCoinBase()) {
 					vector<Txo> vTxo;
@@ -1060,23 +1072,31 @@ void Block::Connect() const {
 						for (auto& txIn : txIns)
 							vTxo.push_back(job.TxoMap.Get(txIn.PrevOutPoint));
 					}
+					if (bIndexFilter)
+						for (auto& txo : vTxo)
+							spentScripts.push_back(Blob(txo.get_ScriptPubKey()));
 					eng.OnConnectInputs(tx, vTxo, true, false);
 				}
 			}
 			if (Height > 0)
 				m_pimpl->CheckCoinbaseTx(nFees);
 			eng.Db->InsertBlock(_self, job);
+			if (bIndexFilter)
+				eng.IndexBlockFilter(_self, spentScripts);
 		}
 
 		eng.OnConnectBlock(_self);
 		eng.Caches.DtBestReceived = Clock::now();
 
-		EXT_LOCK (eng.Caches.Mtx) {
-			eng.Caches.HeightToHashCache.insert(make_pair((ChainCaches::CHeightToHashCache::key_type)height, hashBlock));
-		}
+		eng.Caches.HeightToHashCache.Insert(height, hashBlock);
 
 		eng.Events.OnBlockConnectDbtx(_self);
 	}
+	if (bPubkeyCacheEnabled) {				// as in GetHash160ById(), the flag is forced off only while connecting
+		for (auto& pr : job.Map)			// keys are in the DB now, so lookups by id need not decompress them again
+			if ((pr.second.Insert || pr.second.Update) && pr.second.IsTask && !!pr.second.PubKey)
+				eng.Caches.m_cachePkIdToPubKey.Insert(int64_t(CIdPk(pr.first)), pr.second.Decoded);
+	}
 	eng.SetBestBlock(_self);
 	eng.Tree.RemovePersistentBlock(Hash(_self));
 
@@ -1090,16 +1110,15 @@ void Block::Connect() const {
 		}
 	}
 
-	EXT_LOCK(eng.Caches.Mtx) {
-		eng.Caches.HeightToHashCache.insert(make_pair((ChainCaches::CHeightToHashCache::key_type)height, hashBlock));
-		eng.Caches.HashToBlockCache.insert(make_pair(hashBlock, _self));
-	}
+	eng.Caches.HeightToHashCache.Insert(height, hashBlock);
+	eng.Caches.HashToBlockCache.Insert(hashBlock, _self);
 
 	EXT_FOR (const Tx& tx, txes) {
 		eng.Events.OnProcessTx(tx);
 	}
 
 	if (eng.Mode != EngMode::Lite && eng.Mode != EngMode::BlockParser) {
+		eng.FeeEstimator.OnBlockConnected(height, txes);
 		EXT_FOR(const Tx& tx, txes) {
 			eng.TxPool.Remove(tx);
 		}
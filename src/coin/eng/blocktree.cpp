@@ -14,10 +14,49 @@ BlockTreeItem::BlockTreeItem(const BlockHeader& header)
 {
 }
 
+static int InvertLowestOne(int n) {
+	return n & (n - 1);
+}
+
+// Any height is reachable from any higher one in O(log n) skips, see Bitcoin Core CBlockIndex::pskip
+static int GetSkipHeight(int height) {
+	return height < 2 ? 0
+		: height & 1 ? InvertLowestOne(InvertLowestOne(height - 1)) + 1
+		: InvertLowestOne(height);
+}
+
+const HeaderIndexNode *HeaderIndexNode::GetAncestor(int height) const {
+	const HeaderIndexNode *p = this;
+	while (p->Height > height) {
+		int hSkip = GetSkipHeight(p->Height),
+			hSkipPrev = GetSkipHeight(p->Height - 1);
+		if (p->Skip && (hSkip == height || (hSkip > height && !(hSkipPrev < hSkip - 2 && hSkipPrev >= height))))
+			p = p->Skip;
+		else if (p->Prev)
+			p = p->Prev;
+		else
+			break;
+	}
+	return p;
+}
+
+static const int HEADER_INDEX_DEPTH = 4032,			// below the highest added header, deeper forks are followed by PrevBlockHash
+	HEADER_INDEX_PRUNE_STEP = 1024;						// amortizes the pass over HeaderIndex
+
+static void LinkHeaderIndexNode(HeaderIndexNode& node, const HeaderIndexNode *prev) {
+	node.Prev = prev;
+	int hSkip = GetSkipHeight(node.Height);
+	const HeaderIndexNode *skip = prev ? prev->GetAncestor(hSkip) : nullptr;
+	node.Skip = skip && skip->Height == hSkip ? skip : nullptr;
+}
+
 void BlockTree::Clear() {
 	HeightLastCheckpointed = -1;
 	EXT_LOCK(Mtx) {
 		Map.clear();
+		HeaderIndex.clear();
+		HeaderIndexOrphans.clear();
+		m_heightIndexPruned = 0;
 	}
 }
 
@@ -64,33 +103,48 @@ Block BlockTree::GetBlock(const HashValue& hashBlock) const {
 }
 
 BlockHeader BlockTree::GetAncestor(const HashValue& hashBlock, int height) const {
-	BlockTreeItem item = GetHeader(hashBlock);
-	if (height == item.Height)
-		return item;
-	if (height > item.Height)
+	BlockHeader b = GetHeader(hashBlock);
+	if (height > b.Height)
 		return BlockHeader(nullptr);
-	EXT_LOCK(Mtx) {
-		while (height < item.Height - 1) {
-			if (auto o = Lookup(Map, item.PrevBlockHash))
-				item = o.value();
-			else
-				goto LAB_TRY_MAIN_CHAIN;
+	if (height < b.Height) {
+		HashValue hashIndexed = hashBlock;
+		EXT_LOCK(Mtx) {
+			auto it = HeaderIndex.find(hashBlock);
+			if (it != HeaderIndex.end())
+				hashIndexed = *it->second.GetAncestor(height)->Hash;
 		}
+		if (hashIndexed != hashBlock)
+			b = GetHeader(hashIndexed);
+		while (b.Height > height)				// the chain leaves the index above height, only the trunk continues in the DB main chain
+			b = b.IsInTrunk() ? Eng.Db->FindHeader(height) : b.GetPrevHeader();
 	}
-	return GetHeader(item.PrevBlockHash);
-LAB_TRY_MAIN_CHAIN:
-	return Eng.Db->FindHeader(height);
+	return b;
 }
 
+static const int LINEAR_COMMON_ANCESTOR_STEPS = 8;		// typical forks are short, deeper ones are bisected by height
+
 BlockHeader BlockTree::LastCommonAncestor(const HashValue& ha, const HashValue& hb) const {
 	int h = (min)(GetHeader(ha).Height, GetHeader(hb).Height);
 	ASSERT(h >= 0);
 	BlockHeader a = GetAncestor(ha, h), b = GetAncestor(hb, h);
-	while (Hash(a) != Hash(b)) {
+	for (int i = 0; i < LINEAR_COMMON_ANCESTOR_STEPS && a.Height > 0; ++i) {
+		if (Hash(a) == Hash(b))
+			return a;
 		a = a.GetPrevHeader();
 		b = b.GetPrevHeader();
 	}
-	return a;
+	if (Hash(a) == Hash(b))
+		return a;
+
+	int lo = 0, hi = a.Height;					// ancestors are equal at lo (genesis) and differ at hi
+	while (hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		if (Hash(GetAncestor(ha, mid)) == Hash(GetAncestor(hb, mid)))
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return GetAncestor(ha, lo);
 }
 
 vector<Block> BlockTree::FindNextBlocks(const HashValue& hashBlock) const {
@@ -106,12 +160,90 @@ vector<Block> BlockTree::FindNextBlocks(const HashValue& hashBlock) const {
 
 void BlockTree::Add(const BlockHeader& header) {
 	ASSERT(header.Height >= 0);
-	EXT_LOCKED(Mtx, Map[Hash(header)] = BlockTreeItem(header));
+	const HashValue& hash = Hash(header);
+	EXT_LOCK(Mtx) {
+		Map[hash] = BlockTreeItem(header);
+		if (header.Height < m_heightIndexPruned)
+			return;
+		auto pp = HeaderIndex.insert(make_pair(hash, HeaderIndexNode()));
+		if (pp.second) {
+			HeaderIndexNode& node = pp.first->second;
+			node.Hash = &pp.first->first;
+			node.Height = header.Height;
+			auto itPrev = HeaderIndex.find(header.PrevBlockHash);
+			LinkHeaderIndexNode(node, itPrev == HeaderIndex.end() ? nullptr : &itPrev->second);
+			if (!node.Prev)
+				HeaderIndexOrphans.insert(make_pair(header.PrevBlockHash, &node));
+
+			auto range = HeaderIndexOrphans.equal_range(hash);		// children added before, e.g. side-chain headers are added in descending height on reorganize
+			bool bLinkedOrphans = range.first != range.second;
+			for (auto it = range.first; it != range.second; ++it)
+				LinkHeaderIndexNode(*it->second, &node);
+			HeaderIndexOrphans.erase(range.first, range.second);
+			if (bLinkedOrphans && node.Prev)						// once per late-linked subtree: descending adds have no Prev until the last one
+				RelinkHeaderIndexSkips(node.Height);
+
+			if (header.Height - HEADER_INDEX_DEPTH >= m_heightIndexPruned + HEADER_INDEX_PRUNE_STEP)
+				PruneHeaderIndex(header.Height - HEADER_INDEX_DEPTH);
+		}
+	}
+}
+
+// Descendants of late-linked nodes were added without Skip. Ascending height, so each GetAncestor() already uses the Skips fixed below
+void BlockTree::RelinkHeaderIndexSkips(int height) {
+	vector<HeaderIndexNode*> nodes;
+	for (auto& kv : HeaderIndex) {
+		HeaderIndexNode& node = kv.second;
+		if (node.Height > height && node.Prev && !node.Skip)
+			nodes.push_back(&node);
+	}
+	sort(nodes.begin(), nodes.end(), [](const HeaderIndexNode *a, const HeaderIndexNode *b) { return a->Height < b->Height; });
+	for (auto pNode : nodes)
+		LinkHeaderIndexNode(*pNode, pNode->Prev);
+}
+
+// Evicts nodes below height and clears pointers to them, GetAncestor() continues from there by PrevBlockHash
+void BlockTree::PruneHeaderIndex(int height) {
+	for (auto it = HeaderIndexOrphans.begin(); it != HeaderIndexOrphans.end();)
+		it = it->second->Height < height ? HeaderIndexOrphans.erase(it) : next(it);
+	for (auto it = HeaderIndex.begin(); it != HeaderIndex.end();) {
+		HeaderIndexNode& node = it->second;
+		if (node.Height < height)
+			it = HeaderIndex.erase(it);
+		else {
+			if (node.Prev && node.Prev->Height < height)
+				node.Prev = nullptr;
+			if (node.Skip && node.Skip->Height < height)
+				node.Skip = nullptr;
+			++it;
+		}
+	}
+	m_heightIndexPruned = height;
 }
 
 void BlockTree::RemovePersistentBlock(const HashValue& hashBlock) {
 	EXT_LOCKED(Mtx, Map.erase(hashBlock));
 }
 
+#ifdef _DEBUG
+// it = m.erase(it) must visit every element
+static bool TestFlatHashMapEraseWhileIterating() {
+	FlatHashMap<HashValue, int> m;
+	for (int i = 0; i < 1000; ++i)
+		m[Hash(Span((const uint8_t*)&i, sizeof i))] = i;
+	int nVisited = 0;
+	for (auto it = m.begin(); it != m.end(); ++nVisited)
+		it = it->second & 1 ? next(it) : m.erase(it);
+	ASSERT(nVisited == 1000 && m.size() == 500);
+	for (auto& kv : m)
+		ASSERT(kv.second & 1);
+	for (auto it = m.begin(); it != m.end();)
+		it = m.erase(it);
+	ASSERT(m.empty());
+	return true;
+}
+
+static bool s_bTestedFlatHashMap = TestFlatHashMapEraseWhileIterating();
+#endif
 
 } // Coin::
@@ -147,10 +147,12 @@ void AuxPow::Check(const Block& blockAux) {
 ChainCaches::ChainCaches()
 	: m_bestHeader(nullptr)
 	, m_bestBlock(nullptr)
-	, HashToBlockCache(64)
+	, HashToBlockCache(g_conf.BlockCacheSize)
 	, HeightToHashCache(1024)
-	, HashToTxCache(1024)		// Number of Txes in the block usually >256
-	, m_cachePkIdToPubKey(4096) // should be more than usual value (Txes per Block)
+	, HashToTxCache(g_conf.TxCacheSize)
+	, m_relayHashToTx(g_conf.TxCacheSize)
+	, PowHashCache(4096)		// 2 HeadersMessages of MAX_HEADERS_RESULTS
+	, m_cachePkIdToPubKey(g_conf.PubKeyCacheSize)
 	, PubkeyCacheEnabled(true)
 	, OrphanBlocks(BLOCK_DOWNLOAD_WINDOW) {
 }
@@ -163,4 +165,17 @@ void ChainCaches::Add(const SpentTx& stx) {
 	}
 }
 
+static void TraceCacheStats(const char *name, const CacheStats& stats, size_t size) {
+	TRC(2, name << ": " << size << " entries, " << stats.aHits << " hits, " << stats.aMisses << " misses, " << stats.aEvictions << " evictions");
+}
+
+void ChainCaches::TraceStats() {
+	TraceCacheStats("Blocks", HashToBlockCache.Stats, HashToBlockCache.size());
+	TraceCacheStats("HeightToHash", HeightToHashCache.Stats, HeightToHashCache.size());
+	TraceCacheStats("Txes", HashToTxCache.Stats, HashToTxCache.size());
+	TraceCacheStats("RelayTxes", m_relayHashToTx.Stats, m_relayHashToTx.size());
+	TraceCacheStats("PowHashes", PowHashCache.Stats, PowHashCache.size());
+	TraceCacheStats("PubKeys", m_cachePkIdToPubKey.Stats, m_cachePkIdToPubKey.size());
+}
+
 } // namespace Coin
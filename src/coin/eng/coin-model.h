@@ -56,6 +56,7 @@ public:
 		, NODE_BLOOM = 4
 		, NODE_WITNESS = 8
 		, NODE_XTHIN = 16
+		, NODE_COMPACT_FILTERS = 64
 		, NODE_NETWORK_LIMITED = 0x400;
 
 	static String ToString(uint64_t s);
@@ -198,6 +199,11 @@ template <> struct hash<Coin::OutPoint> {
 	}
 };
 } // namespace std
+
+#include "flat-hash-map.h"
+#include "sharded-lru.h"
+#include "net-stats.h"
+
 namespace Coin {
 
 COIN_CLASS uint8_t TryParseDestination(RCSpan pkScript, Span& hash160, Span& pubkey);
@@ -278,8 +284,40 @@ public:
 	void Push(const Value& v);
 };
 
+// Block-scoped bump allocator for variable-size parts of transactions, replacing a heap allocation per script.
+// Owned by every TxObj read while it was current, so it is freed with the last Tx of the block.
+class BlockArena : public Object {
+public:
+	typedef InterlockedPolicy interlocked_policy;
+
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	BlockArena()
+		: m_p(nullptr)
+		, m_cbFree(0)
+	{}
+
+	uint8_t *Allocate(size_t size);
+
+	class Keeper : noncopyable {		// makes the arena current for reading in this thread
+	public:
+		Keeper(BlockArena *arena);
+		~Keeper();
+	private:
+		BlockArena *m_prev;
+	};
+private:
+	vector<unique_ptr<uint8_t[]>> m_chunks;
+	uint8_t *m_p;
+	size_t m_cbFree;
+};
+
+extern EXT_THREAD_PTR(BlockArena) t_pBlockArena;
+
 class COIN_CLASS TxIn { // Keep this struct small without VTBL
 	mutable Blob m_script;
+	const uint8_t *m_pArenaScript;		// scriptSig allocated in the BlockArena of the owning TxObj, m_script is empty then
+	uint32_t m_cbArenaScript;
 	Blob m_sig;
 	const TxObj* m_pTxo;
 	TxOutBase PrevTxOut;
@@ -294,11 +332,39 @@ public:
 
 	TxIn()
 		: m_script(nullptr)
+		, m_pArenaScript(nullptr)
+		, m_cbArenaScript(0)
 		, m_pTxo(0)
 		, Sequence(UINT_MAX)
 		, RecoverPubKeyType(0) {
 	}
 
+	// A copy owns its script, it may outlive the BlockArena. Moves keep the arena script, they are within the owning TxObj
+	TxIn(const TxIn& v)
+		: m_script(v.Script())
+		, m_pArenaScript(nullptr)
+		, m_cbArenaScript(0)
+		, m_sig(v.m_sig)
+		, m_pTxo(v.m_pTxo)
+		, PrevTxOut(v.PrevTxOut)
+		, Witness(v.Witness)
+		, PrevOutPoint(v.PrevOutPoint)
+		, Sequence(v.Sequence)
+		, RecoverPubKeyType(v.RecoverPubKeyType) {
+	}
+
+	TxIn(TxIn&&) = default;
+
+	TxIn& operator=(const TxIn& v) {
+		if (this != &v) {
+			TxIn t(v);
+			_self = std::move(t);
+		}
+		return _self;
+	}
+
+	TxIn& operator=(TxIn&&) = default;
+
 	bool IsFinal() const {
 		return Sequence == numeric_limits<uint32_t>::max();
 	}
@@ -306,11 +372,12 @@ public:
 #if UCFG_COIN_USE_NORMAL_MODE
 	Span Script() const;
 #else
-	Span Script() const { return m_script; }
+	Span Script() const { return m_pArenaScript ? Span(m_pArenaScript, m_cbArenaScript) : Span(m_script); }
 #endif
 
 	void put_Script(RCSpan script) {
 		m_script = script;
+		m_pArenaScript = nullptr;
 	}
 
     unsigned CountWitnessSigOps() const;
@@ -341,6 +408,12 @@ public:
 	}
 };
 
+// Where a spent output comes from: PoS coin age needs these instead of reloading the previous tx
+struct TxoOrigin {
+	DateTime TxTimestamp;
+	int32_t Height = -1;					// -1 for outputs of the block being connected
+};
+
 class COIN_CLASS TxObj : public Object, public CoinSerialized {
 	typedef TxObj class_type;
 
@@ -354,6 +427,7 @@ public:
 	DateTime LockTimestamp;
 
 	mutable vector<TxIn> m_txIns;
+	ptr<BlockArena> m_arena;
 	uint32_t LockBlock;
 	int32_t Height;
 #if UCFG_COIN_TXES_IN_BLOCKTABLE
@@ -384,6 +458,9 @@ public:
 	virtual int64_t GetCoinAge() const {
 		Throw(E_NOTIMPL);
 	}
+	virtual void CalcCoinAge(const vector<pair<TxOut, TxoOrigin>>& inputs) const {		// caches GetCoinAge() from already loaded inputs
+	}
+	virtual DateTime get_TxTimestamp() const { return DateTime(); }
 	void ReadTxIns(const DbReader& rd) const;
 	virtual String GetComment() const {
 		return nullptr;
@@ -495,6 +572,7 @@ public:
 	unsigned GetP2SHSigOpCount(const ITxoMap& txoMap) const;
 	bool IsNewerThan(const Tx& txOld) const;
 	void WriteTxIns(DbWriter& wr) const;
+	Tx DetachedFromArena() const;				// before the Tx is published to caches, the pool or relay, where it may outlive its Block
 
 	const vector<TxOut>& TxOuts() const { return m_pimpl->TxOuts; }
 	vector<TxOut>& TxOuts() { return m_pimpl->TxOuts; }
@@ -634,7 +712,6 @@ class COIN_CLASS BlockObj : public BlockBase {
 	typedef BlockObj class_type;
 
 	mutable mutex* volatile m_pMtx;
-	mutable CCoinMerkleTree m_merkleTree;
 public:
 	mutable CTxes m_txes;
 	ptr<Coin::AuxPow> AuxPow;
@@ -657,6 +734,8 @@ public:
 	~BlockObj();
 	virtual const Coin::HashValue& Hash() const;
 	virtual Coin::HashValue PowHash() const;
+	Coin::HashValue CachedPowHash() const;
+	Blob PowHashData() const;
 	Coin::HashValue MerkleRoot(bool bSave = true) const override;
 
 //!!!R	virtual void Write(DbWriter& wr) const;
@@ -823,6 +902,7 @@ public:
 	void Check(bool bCheckMerkleRoot) const;
 	void Check() const;
     const uint8_t *GetWitnessCommitment() const;
+	Blob DefaultWitnessCommitmentScript() const;
     void ContextualCheck(const BlockHeader& blockPrev);
 	void Connect() const override;
 	void Disconnect() const;
@@ -917,26 +997,20 @@ struct SpentTx {
 
 class ChainCaches {
 public:
-	mutex Mtx;
-
-	LruMap<HashValue, Block> HashToBlockCache;
+	WaitTimedMutex<mutex> Mtx;			// guards orphans, best headers and spent txes. The LRU caches below lock their own shards
 
-	typedef LruMap<uint32_t, HashValue> CHeightToHashCache;
-	CHeightToHashCache HeightToHashCache;
-
-	typedef LruMap<HashValue, Tx> CHashToTxCache;
-	CHashToTxCache HashToTxCache;
+	ShardedLruCache<HashValue, Block> HashToBlockCache;
+	ShardedLruCache<uint32_t, HashValue> HeightToHashCache;
+	ShardedLruCache<HashValue, Tx> HashToTxCache;
 
 	DateTime DtBestReceived;
 
 	typedef LruMap<HashValue, Block> COrphanMap;
 	COrphanMap OrphanBlocks;
 
-	typedef LruMap<HashValue, Tx> CRelayHashToTx;
-	CRelayHashToTx m_relayHashToTx;
-
-	typedef LruMap<int64_t, PubKeyHash160> CCachePkIdToPubKey;
-	CCachePkIdToPubKey m_cachePkIdToPubKey;
+	ShardedLruCache<HashValue, Tx> m_relayHashToTx;
+	ShardedLruCache<HashValue, HashValue> PowHashCache;			// BlockHash -> PowHash, precomputed in parallel for header batches
+	ShardedLruCache<int64_t, PubKeyHash160> m_cachePkIdToPubKey;
 	bool PubkeyCacheEnabled;
 
 	BlockHeader m_bestHeader, m_bestBlock;
@@ -946,6 +1020,7 @@ public:
 
 	ChainCaches();
 	void Add(const SpentTx& stx);
+	void TraceStats();
 
 	friend class CoinEng;
 };
@@ -1007,7 +1082,7 @@ class CFutureTxMap : public ITxMap {
 	CoinEng& m_eng;
 
 	mutable mutex m_mtx;
-	unordered_map<HashValue, shared_future<TxFeeTuple>> m_map;
+	FlatHashMap<HashValue, shared_future<TxFeeTuple>> m_map;
 	//----
 public:
 	CFutureTxMap(CoinEng& eng) : m_eng(eng) {}
@@ -1022,33 +1097,56 @@ public:
 
 typedef TxOut Txo;
 
+uint64_t CompressAmount(uint64_t n);
+uint64_t DecompressAmount(uint64_t x);
+
+// UTXO record: varint CompressAmount(Value), template byte, then the 20/32-byte hash of a P2PKH/P2SH/P2WPKH/P2WSH script or the raw script.
+// Standard outputs take at most 43 bytes and stay in the inline buffer
+class CompactTxo {
+public:
+	enum { RAW, P2PKH, P2SH, P2WPKH, P2WSH };
+
+	CompactTxo() {}
+	explicit CompactTxo(const TxOut& txOut);
+	TxOut ToTxOut() const;
+
+	Span get_Data() const { return m_data; }
+	DEFPROP_GET(Span, Data);
+private:
+	AutoBlob<44> m_data;
+};
+
 interface ITxoMap {
 	virtual Txo Get(const OutPoint& op) const = 0;
 };
 
+// Outputs of the current block are stored inline, only DB lookups need futures
 class TxoMap : public ITxoMap {
 	CoinEng& m_eng;
 
+public:
+	struct LoadedTxo {
+		CompactTxo Txo;
+		TxoOrigin Origin;
+	};
+private:
 	struct Entry {
-		shared_future<Txo> Ft;
-		CBool InCurrentBlock;
-
-		Entry() {}
-
-		Entry(shared_future<Txo>&& ft, bool inCurrentBlock)
-			: Ft(move(ft))
-			, InCurrentBlock(inCurrentBlock)
-		{}
+		CompactTxo Txo;
+		TxoOrigin Origin;
+		shared_future<LoadedTxo> Ft;			// valid() for outputs loaded from the DB
+		bool InCurrentBlock = false;
 	};
 
 	mutable mutex m_mtx;
-	mutable unordered_map<OutPoint, Entry> m_map;
+	FlatHashMap<OutPoint, Entry> m_map;
 	//----
 public:
 	TxoMap(CoinEng& eng) : m_eng(eng) {}
+	void Reserve(size_t n);
 	void Add(const OutPoint& op, int height);
 	void AddAllOuts(const HashValue& hashTx, const Tx& tx);
 	Txo Get(const OutPoint& op) const override;
+	Txo Get(const OutPoint& op, TxoOrigin& origin) const;
 };
 
 class CoinsView : public ITxMap, public ITxoMap {
@@ -1065,7 +1163,7 @@ public:
 	Txo Get(const OutPoint& op) const override;
 	void Add(const Tx& tx) override;
 private:
-	mutable unordered_map<OutPoint, bool> m_outPoints;
+	mutable FlatHashMap<OutPoint, bool> m_outPoints;
 
 	friend void swap(CoinsView& x, CoinsView& y);
 };
@@ -1086,6 +1184,7 @@ public:
 
 	struct PubKeyData {
 		Blob PubKey;
+		PubKeyHash160 Decoded;			// set by Calculate() for verified tasks, warms ChainCaches::m_cachePkIdToPubKey after the block is committed
 		CBool Insert, Update, IsTask;
 
 		PubKeyData()
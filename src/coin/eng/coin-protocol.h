@@ -33,7 +33,10 @@ public:
 		, MAX_INV_SZ			= 50000
 		, MAX_ADDR_SZ			= 1000
 		, MAX_LOCATOR_SZ		= 101
-		, MAX_HEADERS_RESULTS = 2000;
+		, MAX_HEADERS_RESULTS = 2000
+		, INVENTORY_BROADCAST_MAX = 1000					// tx invs per trickle
+		, INVENTORY_BROADCAST_INTERVAL_MS = 5000			// mean of the Poisson trickle timer for inbound links, halved for outbound
+		, KNOWN_INVENTORY_ELEMENTS = 50000;
 };
 
 struct SMessageHeader {
@@ -43,6 +46,7 @@ struct SMessageHeader {
 };
 
 class CoinEng;
+class InvMessage;
 
 ENUM_CLASS(InventoryType) {
 	MSG_TX 						= 1
@@ -85,6 +89,22 @@ protected:
 	};
 } namespace Coin {
 
+// Approximate set of the most recent inventories, kept in 3 rotating generations of nElements/2 each.
+// Never forgets the last nElements/2 insertions; fixed size, no allocations after construction
+class InventoryRollingBloom {
+public:
+	InventoryRollingBloom(unsigned nElements, double fpRate);
+	void insert(const Inventory& inv);
+	bool count(const Inventory& inv) const;
+private:
+	vector<uint64_t> m_data;			// pairs of words hold the low and high bits of 2-bit generation numbers
+	uint64_t m_k0, m_k1;
+	unsigned m_nEntriesPerGeneration, m_nEntriesThisGeneration, m_nHashFuncs;
+	int m_generation;
+
+	uint64_t HashInv(const Inventory& inv) const;
+};
+
 class Link : public P2P::Link {
 	typedef P2P::Link base;
 public:
@@ -95,10 +115,12 @@ public:
 		HashBlockBestKnown,
 		HashBestHeaderSent;
 
-	LruCache<Inventory> KnownInvertorySet;
+	InventoryRollingBloom KnownInvertorySet;
 
 	typedef unordered_set<Inventory> CInvertorySetToSend;
-	CInvertorySetToSend InvertorySetToSend;
+	CInvertorySetToSend InvertorySetToSend;				// blocks, sent on the next OnPeriodic
+	unordered_map<HashValue, int64_t> TxInvToSend;		// txid -> FeeRatePerKB, trickled
+	DateTime NextTxInvSend;
 	//---- Under Mtx
 
 	Block m_curMerkleBlock;						// accessed in Link thread
@@ -106,6 +128,8 @@ public:
 
 	//-- locked by Eng.Mtx
 	BlocksInFlightList BlocksInFlight;
+	double BlocksPerSecond = 0, BlockLatencyMs = 0;		// EWMA, 0 until the first block is received
+	DateTime DtLastBlockReceived;
 	//----
 
 	mutex MtxFilter;
@@ -128,6 +152,7 @@ public:
 
 	Link(P2P::NetManager& netManager, thread_group& tr);
 	void Push(const Inventory& inv);
+	void PushTx(const HashValue& hashTx, int64_t feeRatePerKB);
 	void Send(ptr<P2P::Message> msg) override;
 	void UpdateBlockAvailability(const HashValue& hashBlock);
 	void RequestHeaders();
@@ -137,6 +162,7 @@ protected:
 	void OnPeriodic(const DateTime& now) override;
 private:
 	void SetHashBlockBestKnown(const HashValue& hash);
+	void TrickleTxInvs(InvMessage& m, const DateTime& now);
 };
 
 class VersionMessage : public CoinMessage {
@@ -47,6 +47,8 @@ public:
 	Rpc(Coin::WalletEng& walletEng);
 	static void Register(RCString name, MF0 mf);
 	static void Register(RCString name, MF1 mf);
+	static void Register(RCString name, MF2 mf);
+	static void RegisterMany(RCString name, MFN mf);		// MFN and MF1 are the same type, so it can't be an overload
 	static bool RegisterRpcHandlers();
 
 	void GetBlockCount(JsonTextWriter& wr);
@@ -56,6 +58,20 @@ protected:
 
 	VarValue GetBlockchainInfo();
 	VarValue GetBlockHash(const VarValue& varHeight);
+	VarValue GetNetStats();
+	VarValue GetResourceUsage();
+
+	VarValue GetBlock(const VarValue& params);
+	VarValue GetBlockHeader(const VarValue& params);
+	VarValue GetRawTransaction(const VarValue& params);
+	VarValue GetTxOut(const VarValue& params);
+	VarValue GetRawMempool(const VarValue& params);
+	VarValue EstimateSmartFee(const VarValue& params);
+	VarValue GetBlockTemplate(const VarValue& params);
+
+	VarValue GetAddressTxIds(const VarValue& query);
+	VarValue GetAddressUtxos(const VarValue& query);
+	VarValue GetAddressBalance(const VarValue& query);
 
 };
 
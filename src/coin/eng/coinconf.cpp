@@ -29,7 +29,13 @@ CoinConf::CoinConf() {
 	EXT_CONF_OPTION(RpcThreads, 4);
 	EXT_CONF_OPTION(Server);
 	EXT_CONF_OPTION(KeyPool, DEFAULT_KEYPOOL_SIZE);
+	EXT_CONF_OPTION(TxConfirmTarget, 6, "blocks within which sent transactions should be confirmed, the wallet pays the estimated fee for it");
 	EXT_CONF_OPTION(Testnet);
+	EXT_CONF_OPTION(BlockFilterIndex, false, "maintain BIP158 compact block filters");
+	EXT_CONF_OPTION(ValidationThreads, 2, "threads processing received messages, 0 processes them on the peer's thread");
+	EXT_CONF_OPTION(BlockCacheSize, 64, "recently used blocks kept in memory");
+	EXT_CONF_OPTION(TxCacheSize, 1024, "recently used and relayed transactions kept in memory, should exceed Txes per Block");
+	EXT_CONF_OPTION(PubKeyCacheSize, 4096, "recently used public keys kept in memory, should exceed Txes per Block");
 }
 
 AddressType CoinConf::ToAddressType(RCString s) {
@@ -361,16 +361,54 @@ bool CoinDb::get_PeersDatabaseExists() {
 	return exists(DbPeersFilePath);
 }
 
+ptr<CoinFilter> CoinDb::CreateKeyFilter(double falsePostitiveRate, uint32_t tweak, uint8_t flags) {
+	EXT_LOCK(MtxDb) {
+		ptr<CoinFilter> r = new CoinFilter((max)(1, int(Hash160ToKey.size() * 2 + P2SHToKey.size())), falsePostitiveRate, tweak, flags);
+		for (auto& kv : Hash160ToKey) {
+			r->Insert(kv.first);
+			r->Insert(kv.second.PubKey.Data);
+		}
+		for (auto& kv : P2SHToKey)
+			r->Insert(kv.first);
+		return r;
+	}
+}
+
+static Blob MakeScript(RCSpan prefix, RCSpan data, RCSpan suffix) {
+	return Blob(prefix) + Blob(data) + Blob(suffix);
+}
+
+// Standard scriptPubKeys payable to our keys, to be matched against BIP158 block filters
+vector<Blob> CoinDb::GetMyScriptPubKeys() {
+	static const uint8_t
+		P2PKH_PREFIX[] = { (uint8_t)Opcode::OP_DUP, (uint8_t)Opcode::OP_HASH160, 20 },
+		P2PKH_SUFFIX[] = { (uint8_t)Opcode::OP_EQUALVERIFY, (uint8_t)Opcode::OP_CHECKSIG },
+		P2WPKH_PREFIX[] = { 0, 20 },
+		P2SH_PREFIX[] = { (uint8_t)Opcode::OP_HASH160, 20 },
+		P2SH_SUFFIX[] = { (uint8_t)Opcode::OP_EQUAL },
+		CHECKSIG[] = { (uint8_t)Opcode::OP_CHECKSIG };
+	vector<Blob> r;
+	EXT_LOCK(MtxDb) {
+		r.reserve(Hash160ToKey.size() * 3 + P2SHToKey.size());
+		for (auto& kv : Hash160ToKey) {
+			Span hash160(kv.first.data(), kv.first.size());
+			Span pubKey = kv.second.PubKey.Data;
+			uint8_t cbPubKey = (uint8_t)pubKey.size();
+			r.push_back(MakeScript(Span(P2PKH_PREFIX, sizeof P2PKH_PREFIX), hash160, Span(P2PKH_SUFFIX, sizeof P2PKH_SUFFIX)));
+			r.push_back(MakeScript(Span(P2WPKH_PREFIX, sizeof P2WPKH_PREFIX), hash160, Span()));
+			r.push_back(MakeScript(Span(&cbPubKey, 1), pubKey, Span(CHECKSIG, sizeof CHECKSIG)));
+		}
+		for (auto& kv : P2SHToKey)
+			r.push_back(MakeScript(Span(P2SH_PREFIX, sizeof P2SH_PREFIX), Span(kv.first.data(), kv.first.size()), Span(P2SH_SUFFIX, sizeof P2SH_SUFFIX)));
+	}
+	return r;
+}
+
 void CoinDb::UpdateFilter() {
-	Filter = new CoinFilter(Hash160ToKey.size() * 2, 0.0000001, Ext::Random().Next(), CoinFilter::BLOOM_UPDATE_ALL);
+	Filter = CreateKeyFilter(0.0000001, Ext::Random().Next(), CoinFilter::BLOOM_UPDATE_ALL);
 	DtEarliestKey = Clock::now();
-	for (auto& kv : Hash160ToKey) {
-		Filter->Insert(kv.first);
-		Filter->Insert(kv.second.PubKey.Data);
+	for (auto& kv : Hash160ToKey)
 		DtEarliestKey = (min)(DtEarliestKey, kv.second->Timestamp);
-	}
-	for (auto& kv : P2SHToKey)
-		Filter->Insert(kv.first);
 	ASSERT(IsFilterValid(Filter));
 }
 
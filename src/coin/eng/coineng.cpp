@@ -304,6 +304,7 @@ void CoinEng::Close() {
 	Events.OnCloseDatabase();
 
 	Db->Close();
+	Caches.TraceStats();
 }
 
 ptr<IBlockChainDb> CoinEng::CreateBlockChainDb() {
@@ -315,16 +316,13 @@ ptr<IBlockChainDb> CoinEng::CreateBlockChainDb() {
 }
 
 void CoinEng::ClearByHeightCaches() {
-	EXT_LOCKED(Caches.Mtx, Caches.HeightToHashCache.clear());
+	Caches.HeightToHashCache.clear();
 }
 
 Block CoinEng::GetBlockByHeight(uint32_t height) {
-	EXT_LOCK(Caches.Mtx) {
-		ChainCaches::CHeightToHashCache::iterator it = Caches.HeightToHashCache.find(height);
-		if (it != Caches.HeightToHashCache.end())
-			if (auto oblock = Lookup(Caches.HashToBlockCache, it->second.first))
-				return oblock.value();
-	}
+	if (auto ohash = Caches.HeightToHashCache.Lookup(height))
+		if (auto oblock = Caches.HashToBlockCache.Lookup(ohash.value()))
+			return oblock.value();
 	Block block = Db->FindBlock(height);
 
 #ifdef X_DEBUG //!!!D
@@ -335,17 +333,15 @@ Block CoinEng::GetBlockByHeight(uint32_t height) {
 
 	ASSERT(block.Height == height);
 	HashValue hashBlock = Hash(block);
-	EXT_LOCK(Caches.Mtx) {
-		Caches.HeightToHashCache.insert(make_pair((ChainCaches::CHeightToHashCache::key_type)height, hashBlock));
-		Caches.HashToBlockCache.insert(make_pair(hashBlock, block));
-	}
+	Caches.HeightToHashCache.Insert(height, hashBlock);
+	Caches.HashToBlockCache.Insert(hashBlock, block);
 	return block;
 }
 
 BlockHeader CoinEng::FindHeader(const HashValue& hash) {
+	if (auto ob = Caches.HashToBlockCache.Lookup(hash))
+		return ob.value();
 	EXT_LOCK(Caches.Mtx) {
-		if (auto ob = Lookup(Caches.HashToBlockCache, hash))
-			return ob.value();
 		ChainCaches::COrphanMap::iterator it = Caches.OrphanBlocks.find(hash);
 		if (it != Caches.OrphanBlocks.end())
 			return it->second.first;
@@ -354,16 +350,12 @@ BlockHeader CoinEng::FindHeader(const HashValue& hash) {
 }
 
 Block CoinEng::LookupBlock(const HashValue& hash) {
-	EXT_LOCK(Caches.Mtx) {
-		if (auto ob = Lookup(Caches.HashToBlockCache, hash))
-			return ob.value();
-	}
+	if (auto ob = Caches.HashToBlockCache.Lookup(hash))
+		return ob.value();
 	Block r(nullptr);
 	if (r = Db->FindBlock(hash)) {
-		EXT_LOCK(Caches.Mtx) {
-			Caches.HeightToHashCache.insert(make_pair((ChainCaches::CHeightToHashCache::key_type)r.Height, hash));
-			Caches.HashToBlockCache.insert(make_pair(hash, r));
-		}
+		Caches.HeightToHashCache.Insert(r.Height, hash);
+		Caches.HashToBlockCache.Insert(hash, r);
 	}
 	return r;
 }
@@ -739,6 +731,7 @@ void CoinEng::OnPeriodicMsgLoop(const DateTime& now) {
 			CommitTransactionIfStarted();
 
 			Events.OnPeriodic(now);
+			NetStats.OnPeriodic(now);
 		}
 	}
 }
@@ -764,6 +757,7 @@ void MsgLoopThread::Execute() {
 						CCoinEngThreadKeeper engKeeper(&eng);
 						eng.OnPeriodicMsgLoop(now);
 					}
+					m_cdb.Governor.Rebalance();
 				}
 			}
 		}
@@ -787,11 +781,113 @@ void CoinEng::Misbehaving(P2P::Message* m, int howMuch, RCString command, RCStri
 	}
 }
 
+void ValidationQueue::Push(P2P::Message *m) {
+	P2P::Link *link = &*m->LinkPtr;
+	unique_lock<mutex> lk(m_mtx);
+	m_cvNotFull.wait(lk, [this, link] { return m_bStopped || m_links[link].Messages.size() < MAX_MESSAGES_PER_LINK; });
+	if (!m_bStopped) {
+		LinkQueue& q = m_links[link];
+		q.Messages.push_back(m);
+		if (!q.Busy && q.Messages.size() == 1) {
+			m_ready.push_back(link);
+			m_cvNotEmpty.notify_one();
+		}
+	}
+}
+
+ptr<P2P::Message> ValidationQueue::Pop() {
+	unique_lock<mutex> lk(m_mtx);
+	m_cvNotEmpty.wait(lk, [this] { return m_bStopped || !m_ready.empty(); });
+	if (m_bStopped)
+		return nullptr;
+	LinkQueue& q = m_links[m_ready.front()];
+	m_ready.pop_front();
+	q.Busy = true;
+	ptr<P2P::Message> r = q.Messages.front();
+	q.Messages.pop_front();
+	m_cvNotFull.notify_all();				// waiters are of different Links
+	return r;
+}
+
+void ValidationQueue::Done(P2P::Link *link) {
+	EXT_LOCK(m_mtx) {
+		auto it = m_links.find(link);
+		if (it == m_links.end())
+			return;
+		if (it->second.Messages.empty())
+			m_links.erase(it);
+		else {
+			it->second.Busy = false;
+			m_ready.push_back(link);
+			m_cvNotEmpty.notify_one();
+		}
+	}
+}
+
+void ValidationQueue::Stop() {
+	EXT_LOCK(m_mtx) {
+		m_bStopped = true;
+		m_links.clear();
+		m_ready.clear();
+	}
+	m_cvNotEmpty.notify_all();
+	m_cvNotFull.notify_all();
+}
+
+// Done() must follow every Pop(), otherwise the Link's queue is never served again
+class ValidationDoneKeeper : noncopyable {
+	ValidationQueue& m_queue;
+	P2P::Link *m_link;
+public:
+	ValidationDoneKeeper(ValidationQueue& queue, P2P::Link *link)
+		: m_queue(queue)
+		, m_link(link)
+	{}
+
+	~ValidationDoneKeeper() {
+		m_queue.Done(m_link);
+	}
+};
+
+void ValidationThread::Execute() {
+	Name = "ValidationThread";
+
+	while (!m_bStop) {
+		ptr<P2P::Message> m = Queue.Pop();
+		if (!m)
+			break;
+		ptr<P2P::Link> link = m->LinkPtr;
+		ValidationDoneKeeper doneKeeper(Queue, &*link);
+		try {
+			Eng.ProcessMessage(m.get());
+		} catch (RCExc ex) {						// on the Link thread this exception would close the Link
+			TRC(2, ex.what());
+			link->Stop();
+		} catch (const std::exception& ex) {		// e.g. out_of_range or bad_alloc caused by one peer must not stop the thread serving all Links
+			TRC(2, ex.what());
+			link->Stop();
+		}
+	}
+}
+
 void CoinEng::OnMessage(P2P::Message* m) {
+	if (!Runned)
+		return;
+	if (m_validationQueue) {
+		m_validationQueue->Push(m);
+		return;
+	}
+	ProcessMessage(m);
+}
+
+void CoinEng::ProcessMessage(P2P::Message* m) {
 	if (!Runned)
 		return;
 	CCoinEngThreadKeeper engKeeper(this);
 	P2P::Link& link = *m->LinkPtr;
+	auto cm = dynamic_cast<CoinMessage*>(m);
+	if (cm)
+		cm->ParsePayload();						// parse errors close the Link, as on the Link thread
 	try {
 		//		DBG_LOCAL_IGNORE_CONDITION(CoinErr::TxPrematureSpend);
 		DBG_LOCAL_IGNORE_CONDITION(CoinErr::IncorrectProofOfWork);
@@ -801,7 +897,7 @@ void CoinEng::OnMessage(P2P::Message* m) {
 		DBG_LOCAL_IGNORE_CONDITION(CoinErr::BadPrevBlock);
 		DBG_LOCAL_IGNORE_CONDITION(CoinErr::VersionMessageMustBeFirst);
 
-		if (auto cm = dynamic_cast<CoinMessage*>(m))
+		if (cm)
 			cm->Trace((Link&)link, false);
 
 		if (!link.PeerVersion) {
@@ -814,6 +910,7 @@ void CoinEng::OnMessage(P2P::Message* m) {
 			} else if (!dynamic_cast<VersionMessage*>(m))
 				Throw(CoinErr::VersionMessageMustBeFirst);
 		}
+		MessageProcessTimer timer(NetStats.Of(cm ? cm->Cmd : ""));
 		m->ProcessMsg(link);
 	} catch (const DbException&) {
 		EXT_LOCK(Mtx) {
@@ -928,19 +1025,13 @@ ptr<P2P::Message> CoinEng::RecvMessage(P2P::Link& link, const BinaryReader& rd)
 		Throw(ExtErr::Protocol_Violation);
 
 	DBG_LOCAL_IGNORE_CONDITION(CoinErr::Misbehaving);
-	ptr<CoinMessage> m = CoinMessage::ReadFromStream(clink, rd);
-	if (m) {
-		TRC(6, ChainParams.Symbol << " " << link.Peer->get_EndPoint() << " " << *m);
-	}
-
+	ptr<CoinMessage> m = CoinMessage::ReadFromStream(clink, rd, bool(m_validationQueue));		// Read() may depend on the Link state set by earlier messages, so it is done in order on the ValidationThread
 	return m.get();
 }
 
 Block CoinEng::GetPrevBlockPrefixSuffixFromMainTree(const Block& block) {
-	EXT_LOCK(Caches.Mtx) {
-		if (auto ob = Lookup(Caches.HashToBlockCache, block.PrevBlockHash))
-			return ob.value();
-	}
+	if (auto ob = Caches.HashToBlockCache.Lookup(block.PrevBlockHash))
+		return ob.value();
 	return Db->FindBlockPrefixSuffix(block.Height - 1);
 }
 
@@ -962,7 +1053,7 @@ void CoinEng::Push(const TxInfo& txInfo) {
 			if (clink.RelayTxes && txInfo.FeeRatePerKB >= clink.MinFeeRate) {
 				EXT_LOCK(clink.MtxFilter) {
 					if (txInfo.FeeRatePerKB >= clink.MinFeeRate && (!clink.Filter || clink.Filter->IsRelevantAndUpdate(txInfo.Tx)))
-						clink.Push(Inventory(InventoryType::MSG_TX, Hash(txInfo.Tx)));
+						clink.PushTx(Hash(txInfo.Tx), txInfo.FeeRatePerKB);
 				}
 			}
 		}
@@ -988,7 +1079,7 @@ void CoinEng::Relay(const TxInfo& txInfo) {
 	TRC(TRC_LEVEL_TX_MESSAGE, hash);
 
 	if (!txInfo.Tx->IsCoinBase() && !HaveTxInDb(hash)) {
-		EXT_LOCKED(Caches.Mtx, Caches.m_relayHashToTx.insert(make_pair(hash, txInfo.Tx)));
+		Caches.m_relayHashToTx.Insert(hash, txInfo.Tx.DetachedFromArena());
 		Push(txInfo);
 	}
 }
@@ -1246,9 +1337,14 @@ void CoinEng::Start() {
 		m_cdb.Events += this;
 	}
 
+	m_validationQueue.reset(g_conf.ValidationThreads ? new ValidationQueue : nullptr);
+	for (int i = 0; i < g_conf.ValidationThreads; ++i)
+		(new ValidationThread(_self, *m_validationQueue))->Start();
+
 	Net::Start();
 	EXT_LOCK(m_cdb.MtxNets) {
 		m_cdb.m_nets.push_back(this);
+		m_cdb.Governor.Register(_self);
 		m_cdb.Events += this;
 	}
 	m_cdb.Start();
@@ -1286,6 +1382,7 @@ void CoinEng::Stop() {
 	EXT_LOCK(m_cdb.MtxNets) {
 		m_cdb.Events -= this;
 		Ext::Remove(m_cdb.m_nets, this);
+		m_cdb.Governor.Unregister(_self);
 	}
 #if UCFG_COIN_USE_IRC
 	if (ChannelClient)
@@ -1313,12 +1410,12 @@ void GetDataMessage::Process(Link& link) {
 			if (eng.Mode == EngMode::Lite || eng.Mode == EngMode::Normal)
 				break;		// Low performance in NormalMode
 
-			if (eng.Mode == EngMode::Bootstrap && link.HasWitness && bool(inv.Type & InventoryType::MSG_WITNESS_FLAG)) {
-				if (auto o = eng.Db->FindBlockOffset(inv.HashValue)) {
+			if (eng.Mode == EngMode::Bootstrap && !eng.ChainParams.AuxPowEnabled && (inv.Type == InventoryType::MSG_BLOCK || inv.Type == InventoryType::MSG_WITNESS_BLOCK)) {
+				if (auto o = eng.Db->FindBlockOffset(inv.HashValue)) {		// served from raw bootstrap bytes, witness stripped on the fly for legacy requests
 					ptr<BlockMessage> m = new BlockMessage(Block(nullptr));
 					m->Offset = o.value().first;
 					m->Size = o.value().second;
-					m->WitnessAware = true;
+					m->WitnessAware = link.HasWitness && bool(inv.Type & InventoryType::MSG_WITNESS_FLAG);
 					link.Send(m);
 					break;
 				}
@@ -1365,10 +1462,8 @@ void GetDataMessage::Process(Link& link) {
 		case InventoryType::MSG_WITNESS_TX:
 			{
 				ptr<TxMessage> m;
-				EXT_LOCK(eng.Caches.Mtx) {
-					if (auto otx = Lookup(eng.Caches.m_relayHashToTx, inv.HashValue))
-						m = new TxMessage(otx.value());
-				}
+				if (auto otx = eng.Caches.m_relayHashToTx.Lookup(inv.HashValue))
+					m = new TxMessage(otx.value());
 				if (m) {
 					m->WitnessAware = bool(inv.Type & InventoryType::MSG_WITNESS_FLAG);
 					link.Send(m);
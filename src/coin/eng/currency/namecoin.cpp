@@ -24,13 +24,19 @@ const Version VER_NAMECOIN_DOMAINS(0, 81);
 
 #if UCFG_COIN_COINCHAIN_BACKEND == COIN_BACKEND_DBLITE
 
+const size_t DOMAIN_EXPIRY_KEY_SIZE = 4 + 16;			// BE Height || SHA256(name)[0..16]
+
+// Names are kept in the chain DB and written in the transaction of the connecting block.
+// The expiry wheel orders names by the height of their last update, so expiring names costs O(expired)
 class NamecoinDbliteDb : public DbliteBlockChainDb, public INamecoinDb {
 	typedef DbliteBlockChainDb base;
 public:
-	DbTable m_tableDomains;
+	DbTable m_tableDomains, m_tableDomainExpiry;
 
-	NamecoinDbliteDb()
-		: m_tableDomains("domains", 0, TableType::HashTable)
+	NamecoinDbliteDb(CoinEng& eng)
+		: base(eng)
+		, m_tableDomains("domains", 0, TableType::HashTable)								// name -> DomainData
+		, m_tableDomainExpiry("domain_expiry", DOMAIN_EXPIRY_KEY_SIZE, TableType::BTree)	// ExpiryKey() -> name
 	{
 	}
 protected:
@@ -38,20 +44,38 @@ protected:
 		base::OnOpenTables(dbt, bCreate);
 		if (bCreate || m_db.UserVersion >= VER_NAMECOIN_DOMAINS)
 			m_tableDomains.Open(dbt, bCreate);
+		if (bCreate || m_db.UserVersion >= DB_VER_DOMAIN_EXPIRY)
+			m_tableDomainExpiry.Open(dbt, bCreate);
 	}
 
-	int GetNameHeight(RCSpan cbufName, int heightExpired) override {
+	void OnUpgradeTables(DbTransaction& dbt, const Version& dbVer) override {
+		base::OnUpgradeTables(dbt, dbVer);
+		if (dbVer < DB_VER_DOMAIN_EXPIRY) {					// one pass over the names indexed before, expired ones are swept by the next block
+			m_tableDomainExpiry.Open(dbt, true);
+			for (DbCursor c(dbt, m_tableDomains); c.SeekToNext();)
+				m_tableDomainExpiry.Put(dbt, ExpiryKey(letoh(*(uint32_t*)c.get_Data().data()), c.get_Key()), c.get_Key());
+		}
+	}
+
+	static Blob ExpiryKey(uint32_t height, RCSpan cbufName) {
+		Blob r(0, DOMAIN_EXPIRY_KEY_SIZE);
+		*(uint32_t*)r.data() = htobe(height);
+		memcpy(r.data() + 4, SHA256().ComputeHash(cbufName).data(), DOMAIN_EXPIRY_KEY_SIZE - 4);
+		return r;
+	}
+
+	int GetNameHeight(RCSpan cbufName, int heightExpired) override {		// expired names stay until the wheel reaches them
 		DbReadTxRef dbt(m_db);
 		DbCursor c(dbt, m_tableDomains);
 		if (c.SeekToKey(cbufName)) {
-			int r = (int)letoh(*(uint32_t*)c.get_Data().P);
+			int r = (int)letoh(*(uint32_t*)c.get_Data().data());
 			if (r > heightExpired)
 				return r;
-			c.Delete();
 		}
 		return -1;
 	}
 
+	// Runs in its own read-only snapshot when called outside block connect, so it takes neither MtxDb nor the engine mutex
 	DomainData Resolve(RCString domain) override {
 		DomainData r;
 		const char *pDomain = domain;
@@ -66,22 +90,24 @@ protected:
 	void PutDomainData(RCString domain, uint32_t height, const HashValue& hashTx, RCString addressData, bool bInsert) override {
 		const char *pDomain = domain;
 		Span cbufName(pDomain, strlen(pDomain));
-		if (!bInsert && GetNameHeight(cbufName, -1) < 0)
+		DbTxRef dbt(m_db);
+		DbCursor c(dbt, m_tableDomains);
+		if (c.SeekToKey(cbufName))			// also an expired name not swept yet
+			m_tableDomainExpiry.Delete(dbt, ExpiryKey(letoh(*(uint32_t*)c.get_Data().data()), cbufName));
+		else if (!bInsert)
 			Throw(CoinErr::InconsistentDatabase);
 		DomainData dd;
 		dd.Height = height;
 		dd.AddressData = addressData;
-		DbTxRef dbt(m_db);
-		m_tableDomains.Put(dbt, cbufName, EXT_BIN(dd), bInsert);
+		m_tableDomains.Put(dbt, cbufName, EXT_BIN(dd));
+		m_tableDomainExpiry.Put(dbt, ExpiryKey(height, cbufName), cbufName);
 	}
 
 	void OptionalDeleteExpiredDomains(uint32_t height) override {
-		if (height & 0xFFF)
-			return;
 		DbTxRef dbt(m_db);
-		for (DbCursor c(dbt, m_tableDomains); c.SeekToNext();) {
-			if (letoh(*(uint32_t*)c.get_Data().P) <= height)
-				c.Delete();
+		for (DbCursor c(dbt, m_tableDomainExpiry); c.SeekToFirst() && betoh(*(uint32_t*)c.get_Key().data()) <= height;) {
+			m_tableDomains.Delete(dbt, c.get_Data());
+			c.Delete();
 		}
 	}
 };
@@ -171,7 +197,7 @@ protected:
 		}
 	}
 
-	void OptionalDeleteExpiredDomains(uint32_t height) override {
+	void OptionalDeleteExpiredDomains(uint32_t heightExpired) override {
 		if (ResolverMode) {
 			if (!(heightExpired & 0xFF)) {
 				SqliteCommand(EXT_STR("DELETE FROM domains WHERE height <= " << heightExpired), m_db)
@@ -455,8 +481,19 @@ void NamecoinEng::OnDisconnectInputs(const Tx& tx) {
 }
 
 
+void NamecoinEng::TryUpgradeDb() {
+	Version dbVer = Db->CheckUserVersion();
+	if (dbVer < VER_NAMECOIN_DOMAINS)
+		Db->Recreate(dbVer);
+	base::TryUpgradeDb();
+}
+
 ptr<IBlockChainDb> NamecoinEng::CreateBlockChainDb() {
+#if UCFG_COIN_COINCHAIN_BACKEND == COIN_BACKEND_DBLITE
+	return new NamecoinDbType(_self);
+#else
 	return new NamecoinDbType;
+#endif
 }
 
 INamecoinDb& NamecoinEng::NamecoinDb() {
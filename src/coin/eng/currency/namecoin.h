@@ -51,7 +51,7 @@ public:
 
 interface INamecoinDb {
 	virtual int GetNameHeight(const ConstBuf& cbufName, int heightExpired) =0;
-	virtual void OptionalDeleteExpiredDomains(uint32_t height) =0;
+	virtual void OptionalDeleteExpiredDomains(uint32_t heightExpired) =0;		// called for every connected block
 	virtual DomainData Resolve(RCString domain) =0;
 	virtual void PutDomainData(RCString domain, uint32_t height, const HashValue& hashTx, RCString addressData, bool bInsert) =0;
 };
@@ -66,11 +66,7 @@ public:
 
 	INamecoinDb& NamecoinDb();
 protected:
-	void TryUpgradeDb() override {
-		if (Db->CheckUserVersion() < VER_NAMECOIN_DOMAINS)
-			Db->Recreate();
-		base::TryUpgradeDb();
-	}
+	void TryUpgradeDb() override;
 
 	void OnCheck(const Tx& tx) override;
 	void OnConnectInputs(const Tx& tx, const vector<Tx>& vTxPrev, bool bBlock, bool bMiner) override;
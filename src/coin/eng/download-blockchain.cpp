@@ -13,10 +13,8 @@ bool CoinEng::HaveAllBlocksUntil(const HashValue& hash) {
 	BlockTreeItem bti = Tree.FindInMap(hash);
 	if (bti && !bti->IsHeaderOnly())
 		return true;
-	EXT_LOCK(Caches.Mtx) {
-		if (Caches.HashToBlockCache.count(hash))
-			return true;
-	}
+	if (Caches.HashToBlockCache.Contains(hash))
+		return true;
 	return Db->HaveBlock(hash);
 }
 
@@ -66,12 +64,41 @@ bool CoinEng::IsInitialBlockDownload() {
 	}
 }
 
+static const double DOWNLOAD_EWMA_ALPHA = 0.2;
+
+void BlockDownloadScheduler::OnReceived(Link& link, const QueuedBlockItem& qbi, const DateTime& now) {
+	double latencyMs = (double)duration_cast<milliseconds>(now - qbi.DtGetdataReq).count(),
+		intervalMs = (double)duration_cast<milliseconds>(now - std::max(qbi.DtGetdataReq, link.DtLastBlockReceived)).count(),
+		rate = 1000 / std::max(intervalMs, 1.0);
+	link.DtLastBlockReceived = now;
+	link.BlockLatencyMs = link.BlockLatencyMs == 0 ? latencyMs : link.BlockLatencyMs + DOWNLOAD_EWMA_ALPHA * (latencyMs - link.BlockLatencyMs);
+	link.BlocksPerSecond = link.BlocksPerSecond == 0 ? rate : link.BlocksPerSecond + DOWNLOAD_EWMA_ALPHA * (rate - link.BlocksPerSecond);
+	m_avgBlocksPerSecond = m_avgBlocksPerSecond == 0 ? rate : m_avgBlocksPerSecond + DOWNLOAD_EWMA_ALPHA / 4 * (rate - m_avgBlocksPerSecond);
+}
+
+// Unmeasured links get the default quota, others from 1/4 to 2x of it proportionally to their share of the average throughput
+int BlockDownloadScheduler::QuotaFor(const Link& link) const {
+	if (link.BlocksPerSecond == 0 || m_avgBlocksPerSecond == 0)
+		return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+	double k = std::min(std::max(link.BlocksPerSecond / m_avgBlocksPerSecond, 0.25), 2.0);
+	return std::max(1, int(MAX_BLOCKS_IN_TRANSIT_PER_PEER * k));
+}
+
+// A request is moved when it is older than both the timeout and 3 round-trips of its link, and the new link is measurably faster
+bool BlockDownloadScheduler::ShouldReassign(const Link& from, const Link& to, const QueuedBlockItem& qbi, const DateTime& now) const {
+	if (&from == &to || to.BlocksPerSecond == 0 || to.BlocksPerSecond <= from.BlocksPerSecond)
+		return false;
+	TimeSpan age = now - qbi.DtGetdataReq;
+	return age > BLOCK_REASSIGN_TIMEOUT && age > milliseconds(int64_t(3 * from.BlockLatencyMs));
+}
+
 bool CoinEng::MarkBlockAsReceived(const HashValue& hashBlock) {
 	EXT_LOCK(Mtx) {
 		auto it = MapBlocksInFlight.find(hashBlock);
 		if (it != MapBlocksInFlight.end()) {
 			BlocksInFlightList::iterator itInFlight = it->second;
 			Coin::Link& link = itInFlight->Link;
+			Downloads.OnReceived(link, *itInFlight, Clock::now());
 			link.DtStallingSince = DateTime();
 			link.BlocksInFlight.erase(itInFlight);
 			MapBlocksInFlight.erase(it);
@@ -82,7 +109,11 @@ bool CoinEng::MarkBlockAsReceived(const HashValue& hashBlock) {
 }
 
 void CoinEng::MarkBlockAsInFlight(GetDataMessage& mGetData, Link& link, const Inventory& inv) {
-	MarkBlockAsReceived(inv.HashValue);
+	auto it = MapBlocksInFlight.find(inv.HashValue);
+	if (it != MapBlocksInFlight.end()) {					// reassigned from a slower link, must not count as received
+		it->second->Link.BlocksInFlight.erase(it->second);
+		MapBlocksInFlight.erase(it);
+	}
 	MapBlocksInFlight[inv.HashValue] = link.BlocksInFlight.insert(link.BlocksInFlight.end(), QueuedBlockItem(link, inv.HashValue, Clock::now()));
 
 	InventoryType invType = Mode == EngMode::Lite
@@ -140,6 +171,10 @@ void InvMessage::Process(Link& link) {
 
 	HashValue hashLastInvBlock;
 
+	EXT_LOCK(link.Mtx) {
+		for (auto& inv : Invs)
+			link.KnownInvertorySet.insert(inv);			// don't announce back what the peer already has
+	}
 
 	EXT_FOR(const Inventory& inv, Invs) {
 #ifdef _DEBUG
@@ -201,7 +236,57 @@ void InvMessage::Process(Link& link) {
 	}
 }
 
+static void CalcPowHashes(CoinEng *peng, const BlockHeader *headers, size_t n, HashValue *r) {
+	CCoinEngThreadKeeper engKeeper(peng);
+	if (peng->ChainParams.HashAlgo == HashAlgo::SCrypt) {
+		vector<uint8_t> data(n * 80);
+		for (size_t i = 0; i < n; ++i)
+			memcpy(&data[i * 80], headers[i]->PowHashData().constData(), 80);
+		ScryptHashes(data.data(), n, r);
+	} else {
+		for (size_t i = 0; i < n; ++i)
+			r[i] = headers[i]->PowHash();
+	}
+}
+
+// Memory-hard PoW hashes of the batch are calculated on all cores before sequential Accept() of each header
+void CoinEng::PrecomputePowHashes(const vector<BlockHeader>& headers) {
+	if (ChainParams.HashAlgo == HashAlgo::Sha256 || ChainParams.HashAlgo == HashAlgo::Prime)
+		return;
+
+	vector<BlockHeader> todo;
+	vector<HashValue> hashes;
+	for (auto& header : headers) {
+		if (header->AuxPow || header->ProofType() != ProofOf::Work)
+			continue;
+		HashValue hash = Hash(header);
+		if (!Tree.FindHeader(hash) && !Caches.PowHashCache.Contains(hash)) {
+			todo.push_back(header);
+			hashes.push_back(hash);
+		}
+	}
+	if (todo.size() < 2)
+		return;
+
+	vector<HashValue> powHashes(todo.size());
+	WorkerGrant workers(_self, todo.size());
+	size_t nThreads = workers.size(),
+		chunk = (todo.size() + nThreads - 1) / nThreads;
+	if (ChainParams.HashAlgo == HashAlgo::SCrypt)
+		chunk = (chunk + ScryptLanes() - 1) / ScryptLanes() * ScryptLanes();		// keep all lanes of the kernel busy
+	vector<future<void>> futures;
+	for (size_t i = 0; i < todo.size(); i += chunk)
+		futures.push_back(std::async(launch::async, CalcPowHashes, this, &todo[i], std::min(chunk, todo.size() - i), &powHashes[i]));
+	for (auto& ft : futures)
+		ft.get();
+
+	for (size_t i = 0; i < todo.size(); ++i)
+		Caches.PowHashCache.Insert(hashes[i], powHashes[i]);
+}
+
 BlockHeader CoinEng::ProcessNewBlockHeaders(const vector<BlockHeader>& headers, Link* link) {
+	PrecomputePowHashes(headers);
+
 	BlockHeader headerLast;
 	for (size_t i = 0; i < headers.size(); ++i) {
 		if (BlockHeader headerPrev = exchange(headerLast, headers[i]))
@@ -264,7 +349,7 @@ void Link::RequestBlocks() {
 
 	bool bFetch = IsPreferredDownload || (0 == eng.aPreferredDownloadPeers.load() && !IsClient && !IsOneShot);
 
-	int count = MAX_BLOCKS_IN_TRANSIT_PER_PEER - (int)EXT_LOCKED(eng.Mtx, BlocksInFlight.size());
+	int count = EXT_LOCKED(eng.Mtx, eng.Downloads.QuotaFor(_self) - (int)BlocksInFlight.size());
 	if (IsClient || ((!bFetch || IsLimitedNode) && eng.IsInitialBlockDownload()) || count <= 0 || !HashBlockBestKnown)
 		return;
 
@@ -284,60 +369,81 @@ void Link::RequestBlocks() {
 	HashValue prevHashBlockLastCommon = HashBlockLastCommon;
 	TRC(4, "HashBlockLastCommon: " << bti.Height << "/" << HashBlockLastCommon << "     HashBlockBestKnown: " << btiBestKnown.Height << "/" << HashBlockBestKnown);
 
-	int nWindowEnd = bti.Height + BLOCK_DOWNLOAD_WINDOW,
+	int nWindowStart = bti.Height + 1,
+		nWindowEnd = bti.Height + BLOCK_DOWNLOAD_WINDOW,
 		nMaxHeight = (min)(btiBestKnown.Height, nWindowEnd + 1);
 
-	Link *staller = 0, *waitingFor = 0;
+	DateTime now = Clock::now();
+	unordered_set<Link*> stallers;
+	Link *waitingFor = 0;
+	bool bWindowBlocked = false;
 	ptr<GetDataMessage> mGetData;
-	while (bti.Height < nMaxHeight) {
-		typedef map<int, HashValue> CHeight2Value;
-		CHeight2Value height2hash;
-
+	auto request = [&](const HashValue& hash) {
+		if (!mGetData)
+			mGetData = new GetDataMessage;
+		eng.MarkBlockAsInFlight(*mGetData, _self, Inventory(InventoryType::MSG_BLOCK, hash));
+		return (int)mGetData->Invs.size() >= count;
+	};
+	for (bool bDone = false; !bDone && bti.Height < nMaxHeight;) {
 		int nToFetch = (min)(nMaxHeight - bti.Height, (max)(128, count - (mGetData ? (int)mGetData->Invs.size() : 0)));
-		BlockHeader cur = bti = eng.Tree.GetAncestor(HashBlockBestKnown, bti.Height+nToFetch);
-		height2hash.insert(make_pair(cur.Height, Hash(cur)));
-		for (int i = 1; i < nToFetch; ++i) {
-			height2hash.insert(make_pair(cur.Height - 1, cur.PrevBlockHash));
-			cur = cur.GetPrevHeader();
+		BlockHeader cur = bti = eng.Tree.GetAncestor(HashBlockBestKnown, bti.Height + nToFetch);
+		int hFirst = bti.Height - nToFetch + 1;
+		vector<HashValue> hashes(nToFetch);						// hashes[i] is at height hFirst + i
+		hashes[nToFetch - 1] = Hash(cur);
+		for (int i = nToFetch - 1; i > 0; --i) {
+			hashes[i - 1] = cur.PrevBlockHash;
+			if (i > 1)
+				cur = cur.GetPrevHeader();
 		}
 
-		EXT_FOR(const CHeight2Value::value_type& pp, height2hash) {
-			if (eng.HaveBlock(pp.second)) {
-				if (eng.HaveAllBlocksUntil(pp.second))
-					HashBlockLastCommon = pp.second;
-			} else {
-				EXT_LOCK(eng.Mtx) {
-					CoinEng::CMapBlocksInFlight::iterator it = eng.MapBlocksInFlight.find(pp.second);
-					if (it != eng.MapBlocksInFlight.end()) {
-						if (!waitingFor) {
-							waitingFor = &it->second->Link;
-							TRC(4, "Stall waiting for " << pp.first << " " << pp.second << " from " << waitingFor->Peer->EndPoint.Address);
-						}
-					} else if (pp.first > nWindowEnd) {
-						if (!mGetData && waitingFor != this)
-							staller = waitingFor;
-						break;
-					} else {
-						if (!mGetData)
-							mGetData = new GetDataMessage;
-						eng.MarkBlockAsInFlight(*mGetData, _self, Inventory(InventoryType::MSG_BLOCK, pp.second));
-						if (mGetData && mGetData->Invs.size() == count)
-							goto LAB_OUT_LOOP;
+		vector<int> missing;
+		for (int i = 0; i < nToFetch; ++i) {
+			if (!eng.HaveBlock(hashes[i]))
+				missing.push_back(i);
+			else if (eng.HaveAllBlocksUntil(hashes[i]))
+				HashBlockLastCommon = hashes[i];
+		}
+
+		EXT_LOCK(eng.Mtx) {											// once per batch, not per hash
+			for (int i : missing) {
+				int height = hFirst + i;
+				const HashValue& hash = hashes[i];
+				CoinEng::CMapBlocksInFlight::iterator it = eng.MapBlocksInFlight.find(hash);
+				if (it != eng.MapBlocksInFlight.end()) {
+					Link& other = it->second->Link;
+					if (!waitingFor) {
+						waitingFor = &other;
+						TRC(4, "Stall waiting for " << height << " " << hash << " from " << waitingFor->Peer->EndPoint.Address);
 					}
-				}
+					if (height < nWindowStart + MAX_BLOCKS_IN_TRANSIT_PER_PEER && &other != this) {		// blocks the ordered connect
+						if (eng.Downloads.ShouldReassign(other, _self, *it->second, now)) {
+							TRC(3, "Reassigning " << height << " from " << other.Peer->EndPoint.Address << " to " << Peer->EndPoint.Address);
+							if (bDone = request(hash))
+								break;
+						} else
+							stallers.insert(&other);
+					}
+				} else if (height > nWindowEnd) {
+					bWindowBlocked = !mGetData && waitingFor != this;
+					bDone = true;
+					break;
+				} else if (bDone = request(hash))
+					break;
 			}
 		}
+	}
 
-		if (EXT_LOCKED(eng.Mtx, BlocksInFlight.empty()) && staller) {
+	if (bWindowBlocked && EXT_LOCKED(eng.Mtx, BlocksInFlight.empty())) {		// every link holding the window base is marked, not only the first one
+		for (Link *staller : stallers) {
 			EXT_LOCK(staller->Mtx) {
 				if (staller->DtStallingSince == DateTime()) {
-					staller->DtStallingSince = Clock::now();
+					staller->DtStallingSince = now;
 					TRC(3, "Stall started " << staller->Peer->get_EndPoint());
 				}
 			}
 		}
 	}
-LAB_OUT_LOOP:
+
 	if (prevHashBlockLastCommon != HashBlockLastCommon) {
 		TRC(4, "Updated HashBlockLastCommon: " << eng.BlockStringId(HashBlockLastCommon));
 	}
@@ -34,6 +34,8 @@ using P2P::Peer;
 #endif
 
 #include "crypter.h"
+#include "resource-governor.h"
+#include "fee-estimator.h"
 
 using P2P::NetManager;
 
@@ -55,6 +57,10 @@ extern const Version
 	VER_PUBKEY_RECOVER,
 	VER_HEADERS,
 	DB_VER_COMPACT_UTXO,
+	DB_VER_BLOCK_FILTERS,
+	DB_VER_ADDRESS_INDEX,
+	DB_VER_BLOCK_UNDO,
+	DB_VER_DOMAIN_EXPIRY,
 	DB_VER_LATEST;
 
 struct QueuedBlockItem {
@@ -67,6 +73,16 @@ struct QueuedBlockItem {
 
 typedef list<QueuedBlockItem> BlocksInFlightList;
 
+// Shares the BLOCK_DOWNLOAD_WINDOW between links by their measured throughput and latency. All methods are called under CoinEng::Mtx
+class BlockDownloadScheduler {
+public:
+	void OnReceived(Coin::Link& link, const QueuedBlockItem& qbi, const DateTime& now);
+	int QuotaFor(const Coin::Link& link) const;
+	bool ShouldReassign(const Coin::Link& from, const Coin::Link& to, const QueuedBlockItem& qbi, const DateTime& now) const;
+private:
+	double m_avgBlocksPerSecond = 0;		// EWMA over all links
+};
+
 class CoinPeer : public P2P::Peer {
 public:
 	CoinPeer() { m_services = NodeServices::NODE_NETWORK; }
@@ -231,6 +247,7 @@ public:
 
 	mutex MtxMiner;
 	unique_ptr<BitcoinMiner> Miner;
+	ptr<Thread> StakeMinter;
 #endif
 	WalletBase(CoinEng & eng) : m_eng(&eng), Speed(0) {}
 
@@ -280,6 +297,7 @@ public:
 	void Write(BinaryWriter& wr) const override;
 	void Read(const BinaryReader& rd) override;
 	bool IsRelevantAndUpdate(const Tx& tx);
+	bool MatchesScript(RCSpan script) const { return FindScriptData(script).data(); }
 
 protected:
 	size_t Hash(RCSpan cbuf, int n) const override;
@@ -319,6 +337,7 @@ public:
 	ptr<Coin::MsgLoopThread> MsgLoopThread;
 
 	Coin::IrcManager IrcManager;
+	ResourceGovernor Governor;
 
 	array<uint8_t, 8> Salt;
 	String m_masterPassword;
@@ -342,6 +361,8 @@ public:
 	bool get_PeersDatabaseExists();
 	DEFPROP_GET(bool, PeersDatabaseExists);
 
+	ptr<CoinFilter> CreateKeyFilter(double falsePostitiveRate, uint32_t tweak, uint8_t flags);
+	vector<Blob> GetMyScriptPubKeys();
 	void UpdateFilter();
 	void LoadKeys(RCString password = nullptr);
 	void Load();
@@ -409,7 +430,8 @@ public:
 		: Cmd(cmd)
 	{}
 
-	static ptr<CoinMessage> ReadFromStream(Link& link, const BinaryReader& rd);
+	static ptr<CoinMessage> ReadFromStream(Link& link, const BinaryReader& rd, bool bDeferParse = false);
+	void ParsePayload();				// on the ValidationThread, when ReadFromStream() deferred parsing
 	virtual void Write(ProtocolWriter& wr) const;
     virtual void Read(const ProtocolReader& rd);
 	virtual void Trace(Coin::Link& link, bool bSend) const;
@@ -418,6 +440,10 @@ protected:
 	virtual void Process(Coin::Link& link) {}
 	void ProcessMsg(P2P::Link& link) override;
 private:
+	Blob m_payload;
+	CBool m_bDeferredPayload;
+
+	void ReadPayload(Link& link, RCSpan payload);
     void Write(BinaryWriter& wr) const override { Write((ProtocolWriter&)wr); }
     void Read(const BinaryReader& rd) override { Read((const ProtocolReader&)rd); }
 
@@ -454,6 +480,24 @@ public:
 	int FindHeightInMainChain(bool bFullBlocks = false) const;
 };
 
+struct AddressIndexEntry {		// ordered by (Height, TxPos, IsInput, Index) for each script
+	HashValue HashTx;
+	int64_t Value;				// of the spent TxOut for inputs
+	int32_t Height;
+	uint32_t TxPos;				// index of the Tx in its block
+	uint32_t Index;				// TxOut index for outputs, TxIn index for inputs
+	int32_t SpentHeight;		// outputs only, -1 if unspent
+	bool IsInput;
+};
+
+struct AddressIndexTotals {
+	int64_t Balance, Received;
+};
+
+inline HashValue AddressIndexScriptHash(RCSpan scriptPubKey) {
+	return HashValue(SHA256().ComputeHash(scriptPubKey));
+}
+
 class IBlockChainDb : public InterlockedObject, public ITransactionable {
 public:
 	CInt<int> m_nCheckpont;
@@ -507,6 +551,9 @@ public:
 	virtual void SaveCoinsByTxHash(const HashValue& hash, const vector<bool>& vec) = 0;
 	virtual void UpdateCoins(const OutPoint& op, bool bSpend, int32_t heightCur);
 	virtual void PruneTxo(const OutPoint& op, int32_t heightCur) {}
+	virtual bool HaveBlockUndo(int height) { return false; }
+	virtual bool RestoreSpentCoins(int height) { return false; }		// unspends all inputs of the block from its undo record; false if there is no record
+	virtual void PruneBlockUndo(int height) {}
 
 	virtual void BeginEngTransaction() = 0;
 	virtual void SetProgressHandler(int (*pfn)(void*), void* p = 0, int n = 1) = 0;
@@ -526,9 +573,20 @@ public:
 	virtual void SetLastPrunedHeight(int32_t height) {}
 	virtual Blob ReadBlob(uint64_t offset, uint32_t size) { return Blob();  }
 	virtual void CopyTo(uint64_t offset, uint32_t size, Stream& stm) { }
+	virtual Span MappedSpan(uint64_t offset, uint32_t size) { return Span(); }		// empty if the range is not memory-mapped
 
 	virtual ptr<CoinFilter> GetFilter() =0;
 	virtual void SetFilter(CoinFilter *filter) = 0;
+
+	virtual optional<Blob> FindBlockFilter(int height) { return nullopt; }		// BIP158 basic filter
+	virtual optional<HashValue> FindBlockFilterHeader(int height) { return nullopt; }
+	virtual void InsertBlockFilter(int height, RCSpan filter, const HashValue& filterHeader) {}
+
+	// Address index, maintained only in EngMode::BlockExplorer
+	virtual uint32_t FindAddressIndexOrdinal(const HashValue& scriptHash, int height) { Throw(E_NOTIMPL); }	// first entry with Height >= height
+	virtual vector<AddressIndexEntry> ReadAddressIndex(const HashValue& scriptHash, uint32_t ordinal, size_t maxCount) { Throw(E_NOTIMPL); }
+	virtual void DeleteAddressIndex(const Tx& tx, uint32_t nTx, int height) {}
+	virtual optional<AddressIndexTotals> GetAddressIndexTotals(const HashValue& scriptHash) { return nullopt; }	// nullopt if the script was indexed before totals were kept
 };
 
 ptr<IBlockChainDb> CreateBlockChainDb();
@@ -550,18 +608,33 @@ struct BlockTreeItem : public BlockHeader { // may be full block too
 	*/
 };
 
+// Ancestry of a header added to BlockTree, with a skip pointer to the ancestor at GetSkipHeight(Height) for O(log n) GetAncestor.
+// Guarded by BlockTree::Mtx: Prev is linked when the parent is added after the node, nodes deeper than HEADER_INDEX_DEPTH are evicted
+struct HeaderIndexNode {
+	const HashValue *Hash;						// key of BlockTree::HeaderIndex
+	const HeaderIndexNode *Prev, *Skip;			// nullptr where the chain leaves the index
+	int Height;
+
+	const HeaderIndexNode *GetAncestor(int height) const;		// the lowest indexed ancestor if the chain leaves the index above height
+};
+
 class BlockTree {
 public:
 	CoinEng& Eng;
 	mutable mutex Mtx;
-	typedef unordered_map<HashValue, BlockTreeItem> CMap; //!!!TODO change to unordered_set<BlockTreeItem> to save space
+	typedef FlatHashMap<HashValue, BlockTreeItem> CMap;
 	CMap Map;
+	typedef unordered_map<HashValue, HeaderIndexNode> CHeaderIndex;		// element addresses are stable
+	CHeaderIndex HeaderIndex;
+	typedef unordered_multimap<HashValue, HeaderIndexNode*> CHeaderIndexOrphans;
+	CHeaderIndexOrphans HeaderIndexOrphans;		// nodes without Prev by their PrevBlockHash
 	int HeightLastCheckpointed;
 	//----
 
 	BlockTree(CoinEng& eng)
 		: Eng(eng)
 		, HeightLastCheckpointed(-1)
+		, m_heightIndexPruned(0)
 	{}
 
 	void Clear();
@@ -577,6 +650,11 @@ public:
 	vector<Block> FindNextBlocks(const HashValue& hashBlock) const;
 	void Add(const BlockHeader& header);
 	void RemovePersistentBlock(const HashValue& hashBlock);
+private:
+	int m_heightIndexPruned;					// HeaderIndex has no nodes below
+
+	void RelinkHeaderIndexSkips(int height);
+	void PruneHeaderIndex(int height);
 };
 
 class EngEvents : IEngEvents {
@@ -616,15 +694,15 @@ class TxPool {
 public:
 	CoinEng& Eng;
 
-	recursive_mutex Mtx;
+	WaitTimedMutex<recursive_mutex> Mtx;
 
-	typedef unordered_map<HashValue, TxInfo> CHashToTxInfo;
+	typedef FlatHashMap<HashValue, TxInfo> CHashToTxInfo;
 	CHashToTxInfo m_hashToTxInfo;
 
-	typedef unordered_map<OutPoint, Tx> COutPointToNextTx;
+	typedef FlatHashMap<OutPoint, Tx> COutPointToNextTx;
 	COutPointToNextTx m_outPointToNextTx;
 
-	typedef unordered_map<HashValue, Tx> CHashToOrphan;
+	typedef FlatHashMap<HashValue, Tx> CHashToOrphan;
 	CHashToOrphan m_hashToOrphan;
 
 	typedef unordered_multimap<HashValue, HashValue> CHashToHash;
@@ -647,7 +725,10 @@ public:
 	String AddressType, ChangeType;
 	int RpcPort, RpcThreads;
 	int KeyPool;
-	bool Checkpoints, Server, AcceptNonStdTxn, Testnet;
+	int TxConfirmTarget;
+	int ValidationThreads;
+	int BlockCacheSize, TxCacheSize, PubKeyCacheSize;		// entries
+	bool Checkpoints, Server, AcceptNonStdTxn, Testnet, BlockFilterIndex;
 
 	CoinConf();
 	Coin::AddressType GetAddressType() { return ToAddressType(AddressType); }
@@ -673,21 +754,24 @@ public:
 
 	Coin::ChainParams ChainParams;
 
-	recursive_mutex Mtx;
+	WaitTimedMutex<recursive_mutex> Mtx;
 
 	ptr<IBlockChainDb> Db;
 	uint64_t OffsetInBootstrap, NextOffsetInBootstrap;
 
 	BlockTree Tree;
 	class TxPool TxPool;
+	class FeeEstimator FeeEstimator;
 
-	typedef unordered_map<HashValue, BlocksInFlightList::iterator> CMapBlocksInFlight;
+	typedef FlatHashMap<HashValue, BlocksInFlightList::iterator> CMapBlocksInFlight;
 	CMapBlocksInFlight MapBlocksInFlight;
+	BlockDownloadScheduler Downloads;
 	//----
 
 	std::exception_ptr CriticalException;
 
 	ChainCaches Caches;
+	class NetStats NetStats;
 
 	EngEvents Events;
 
@@ -720,6 +804,8 @@ private:
 
 	mutex m_mtxThreadStateChange;
 
+	unique_ptr<ValidationQueue> m_validationQueue;				// shared by ValidationThreads, fixed while Runned
+
 	mutex m_mtxVerNonce;
 	typedef unordered_map<uint64_t, ptr<P2P::Link>> CNonce2link;
 	CNonce2link m_nonce2link;
@@ -796,6 +882,14 @@ public:
 
 	HashValue WitnessHashFromTx(const Tx& tx) { return HashFromTx(tx, true); }
 
+	bool get_BlockFilterIndexEnabled();
+	DEFPROP_GET(bool, BlockFilterIndexEnabled);
+
+	bool get_BlockFilterIndexComplete();			// has filters from Genesis to the best block
+	DEFPROP_GET(bool, BlockFilterIndexComplete);
+
+	void IndexBlockFilter(const Block& block, const vector<Blob>& spentScripts);
+
 	virtual void OnCheck(const Tx& tx) {}
 	virtual void OnConnectInputs(const Tx& tx, const vector<Txo>& vTxo, bool bBlock, bool bMiner) {}
 	virtual void OnConnectBlock(const Block& block) {}
@@ -813,6 +907,7 @@ public:
 	bool MarkBlockAsReceived(const HashValue& hashBlock);
 	void MarkBlockAsInFlight(GetDataMessage& mGetData, Link& link, const Inventory& inv);
 	void OnPeriodicMsgLoop(const DateTime& now) override;
+	void PrecomputePowHashes(const vector<BlockHeader>& headers);
 	BlockHeader ProcessNewBlockHeaders(const vector<BlockHeader>& headers, Link *link);
 	CoinPeer* CreatePeer() override;
 	JumpAction TryJumpToBlockchain(int sym, Link *link);
@@ -866,8 +961,14 @@ public:
     virtual CoinMessage* CreateBlockTransactionsMessage();
     virtual CoinMessage* CreateSendCompactBlockMessage();
     virtual CoinMessage* CreateCompactBlockMessage();
+	virtual CoinMessage* CreateGetCFiltersMessage();
+	virtual CoinMessage* CreateGetCFHeadersMessage();
+	virtual CoinMessage* CreateGetCFCheckptMessage();
 
 	virtual TxObj* CreateTxObj() { return new TxObj; }
+#if UCFG_COIN_GENERATE
+	virtual Thread *CreateStakeMinter(WalletBase& wallet) { return nullptr; }		// PoS engines mint blocks with the wallet's coins
+#endif
 	virtual bool CreateDb();
 	virtual bool OpenDb();
 	path GetBootstrapPath();
@@ -903,6 +1004,7 @@ protected:
 	void SavePeers() override;
 
 	void OnMessage(P2P::Message* m) override;
+	void ProcessMessage(P2P::Message* m);
 	void OnPingTimeout(P2P::Link& link) override;
 	void AddLink(P2P::LinkBase* link) override;
 	void OnCloseLink(P2P::LinkBase& link) override;
@@ -1020,6 +1122,50 @@ protected:
 	void Execute() override;
 };
 
+// Received messages between Link threads and ValidationThreads, queued per Link.
+// Messages of a Link are parsed and processed in order, at most one at a time; Links with pending messages are served round-robin by any ValidationThread.
+// A Link thread blocks only while its own queue is full.
+class ValidationQueue : noncopyable {
+public:
+	static const size_t MAX_MESSAGES_PER_LINK = 64;
+
+	void Push(P2P::Message *m);
+	ptr<P2P::Message> Pop();			// nullptr after Stop()
+	void Done(P2P::Link *link);			// the message returned by Pop() is processed
+	void Stop();
+private:
+	struct LinkQueue {
+		deque<ptr<P2P::Message>> Messages;
+		bool Busy = false;
+	};
+
+	mutex m_mtx;
+	condition_variable m_cvNotEmpty, m_cvNotFull;
+	unordered_map<P2P::Link*, LinkQueue> m_links;		// messages keep their Links alive
+	deque<P2P::Link*> m_ready;							// not Busy and have Messages
+	bool m_bStopped = false;
+};
+
+class ValidationThread : public Thread {
+	typedef Thread base;
+public:
+	CoinEng& Eng;
+	ValidationQueue& Queue;
+
+	ValidationThread(CoinEng& eng, ValidationQueue& queue)
+		: base(&eng.m_tr)
+		, Eng(eng)
+		, Queue(queue)
+	{}
+
+	void Stop() override {
+		m_bStop = true;
+		Queue.Stop();
+	}
+protected:
+	void Execute() override;
+};
+
 class CoinEngApp : public CAppBase {
 	typedef CoinEngApp class_type;
 
@@ -0,0 +1,112 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#include "eng.h"
+
+namespace Coin {
+
+FeeEstimator::FeeEstimator() {
+	for (double bound = FEE_ESTIMATE_MIN_BUCKET_FEE_RATE; bound < FEE_ESTIMATE_MAX_BUCKET_FEE_RATE; bound *= FEE_ESTIMATE_BUCKET_SPACING)
+		m_bucketBounds.push_back(bound);
+	m_bucketBounds.push_back(numeric_limits<double>::infinity());
+	size_t n = m_bucketBounds.size();
+	m_txCount.resize(n);
+	m_feeRateSum.resize(n);
+	m_failCount.resize(n);
+	m_confirmed.assign(FEE_ESTIMATE_MAX_TARGET, vector<double>(n));
+}
+
+int FeeEstimator::BucketOf(uint64_t feeRatePerKB) const {
+	return int(lower_bound(m_bucketBounds.begin(), m_bucketBounds.end(), double(feeRatePerKB)) - m_bucketBounds.begin());
+}
+
+void FeeEstimator::OnTxAdded(const HashValue& hashTx, uint64_t feeRatePerKB, int height) {
+	TrackedTx ttx = { feeRatePerKB, height, BucketOf(feeRatePerKB) };
+	EXT_LOCK(m_mtx) {
+		if (m_tracked.insert(make_pair(hashTx, ttx)).second) {
+			if (m_heightToTracked.empty() || m_heightToTracked.back().first != height)
+				m_heightToTracked.push_back(make_pair(height, vector<HashValue>()));
+			m_heightToTracked.back().second.push_back(hashTx);
+		}
+	}
+}
+
+void FeeEstimator::OnTxRemoved(const HashValue& hashTx) {
+	EXT_LOCK(m_mtx) {
+		m_tracked.erase(hashTx);
+	}
+}
+
+void FeeEstimator::OnBlockConnected(int height, const CTxes& txes) {
+	EXT_LOCK(m_mtx) {
+		for (size_t b = 0; b < m_bucketBounds.size(); ++b) {
+			m_txCount[b] *= FEE_ESTIMATE_DECAY;
+			m_feeRateSum[b] *= FEE_ESTIMATE_DECAY;
+			m_failCount[b] *= FEE_ESTIMATE_DECAY;
+			for (auto& confirmed : m_confirmed)
+				confirmed[b] *= FEE_ESTIMATE_DECAY;
+		}
+		for (auto& tx : txes) {
+			auto it = m_tracked.find(Hash(tx));
+			if (it == m_tracked.end())
+				continue;
+			const TrackedTx& ttx = it->second;
+			int blocks = std::max(1, height - ttx.Height);
+			if (blocks <= FEE_ESTIMATE_MAX_TARGET) {
+				m_txCount[ttx.Bucket] += 1;
+				m_feeRateSum[ttx.Bucket] += double(ttx.FeeRatePerKB);
+				for (int target = blocks; target <= FEE_ESTIMATE_MAX_TARGET; ++target)
+					m_confirmed[target - 1][ttx.Bucket] += 1;
+			}
+			m_tracked.erase(it);
+		}
+		for (; !m_heightToTracked.empty() && m_heightToTracked.front().first <= height - FEE_ESTIMATE_MAX_TARGET; m_heightToTracked.pop_front()) {
+			for (auto& hashTx : m_heightToTracked.front().second) {
+				auto it = m_tracked.find(hashTx);
+				if (it != m_tracked.end()) {
+					m_failCount[it->second.Bucket] += 1;
+					m_tracked.erase(it);
+				}
+			}
+		}
+	}
+}
+
+// Going down from the highest fee rate, buckets are joined into ranges with sufficient data.
+// The estimate is the average fee rate of the last range in which enough Txes were connected within target blocks
+optional<int64_t> FeeEstimator::Estimate(int target) {
+	target = std::min(std::max(target, 1), FEE_ESTIMATE_MAX_TARGET);
+	const double sufficient = FEE_ESTIMATE_SUFFICIENT_TXS_PER_BLOCK / (1 - FEE_ESTIMATE_DECAY);
+	optional<int64_t> r;
+	EXT_LOCK(m_mtx) {
+		const vector<double>& confirmed = m_confirmed[target - 1];
+		double nConfirmed = 0, nTxes = 0, nFailed = 0, feeRateSum = 0;
+		for (int b = int(m_bucketBounds.size()) - 1; b >= 0; --b) {
+			nConfirmed += confirmed[b];
+			nTxes += m_txCount[b];
+			nFailed += m_failCount[b];
+			feeRateSum += m_feeRateSum[b];
+			if (nTxes + nFailed >= sufficient) {
+				if (nConfirmed / (nTxes + nFailed) < FEE_ESTIMATE_SUCCESS_RATIO)
+					break;
+				r = int64_t(feeRateSum / nTxes);
+				nConfirmed = nTxes = nFailed = feeRateSum = 0;
+			}
+		}
+	}
+	return r;
+}
+
+optional<int64_t> FeeEstimator::EstimateSmart(int target, int& blocks) {
+	for (blocks = std::min(std::max(target, 1), FEE_ESTIMATE_MAX_TARGET); blocks <= FEE_ESTIMATE_MAX_TARGET; ++blocks)
+		if (optional<int64_t> r = Estimate(blocks))
+			return r;
+	blocks = target;
+	return nullopt;
+}
+
+} // Coin::
@@ -0,0 +1,48 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Fee rate estimate from the history of TxPool entries: each Tx is put into a bucket by its fee rate when it enters the pool,
+// and the number of blocks until it is connected is counted for that bucket. Counters decay exponentially per block,
+// so an estimate is one pass over the buckets
+
+#pragma once
+
+namespace Coin {
+
+const int FEE_ESTIMATE_MAX_TARGET = 25;					// blocks
+const double FEE_ESTIMATE_DECAY = 0.998,				// per block, half-life is ~350 blocks
+	FEE_ESTIMATE_SUCCESS_RATIO = 0.85,
+	FEE_ESTIMATE_SUFFICIENT_TXS_PER_BLOCK = 0.1,
+	FEE_ESTIMATE_BUCKET_SPACING = 1.1,
+	FEE_ESTIMATE_MIN_BUCKET_FEE_RATE = 1000,			// per KB
+	FEE_ESTIMATE_MAX_BUCKET_FEE_RATE = 1e7;
+
+class FeeEstimator : noncopyable {
+public:
+	FeeEstimator();
+	void OnTxAdded(const HashValue& hashTx, uint64_t feeRatePerKB, int height);		// height of the best block when the Tx entered the pool
+	void OnTxRemoved(const HashValue& hashTx);
+	void OnBlockConnected(int height, const CTxes& txes);			// before the Txes are removed from the pool
+
+	optional<int64_t> Estimate(int target);							// fee rate per KB, nullopt when there is not enough data
+	optional<int64_t> EstimateSmart(int target, int& blocks);		// tries longer targets when target has not enough data
+private:
+	struct TrackedTx {
+		uint64_t FeeRatePerKB;
+		int Height;
+		int Bucket;
+	};
+
+	mutex m_mtx;
+	vector<double> m_bucketBounds;									// upper fee rate of each bucket, the last one is unbounded
+	vector<double> m_txCount, m_feeRateSum, m_failCount;			// decayed, per bucket
+	vector<vector<double>> m_confirmed;								// [target - 1][bucket], decayed counts of Txes connected within target blocks
+	unordered_map<HashValue, TrackedTx> m_tracked;
+	deque<pair<int, vector<HashValue>>> m_heightToTracked;			// Txes still in the pool after FEE_ESTIMATE_MAX_TARGET blocks are counted as failed
+
+	int BucketOf(uint64_t feeRatePerKB) const;
+};
+
+} // Coin::
@@ -0,0 +1,326 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Swiss-table style open-addressing hash map for keys which are already uniformly random: HashValue, OutPoint.
+// One control byte per slot: EMPTY, DELETED, or 7 bits of the hash (H2) for full slots. Groups of 16 control bytes are probed with one SSE2 compare.
+// Unlike unordered_map, inserting may move elements: iterators and references are invalidated by any insertion, by erase only for the erased element
+
+#pragma once
+
+#if UCFG_PLATFORM_X64
+#	include <emmintrin.h>
+#endif
+
+namespace Coin {
+
+// First 8 bytes of the key, mixed with a per-process salt, so that peers can't aim at particular groups
+inline uint64_t FlatHashSalt() {
+	static const uint64_t s_salt = [] {
+		uint64_t r;
+		GetSystemURandomReader() >> r;
+		return r | 1;
+	}();
+	return s_salt;
+}
+
+template <class K> struct FlatKeyHash;
+
+template <> struct FlatKeyHash<HashValue> {
+	uint64_t operator()(const HashValue& key) const {
+		uint64_t v;
+		memcpy(&v, key.data(), sizeof v);
+		return (v ^ FlatHashSalt()) * 0x9E3779B97F4A7C15ULL;
+	}
+};
+
+template <> struct FlatKeyHash<OutPoint> {
+	uint64_t operator()(const OutPoint& key) const {
+		uint64_t v;
+		memcpy(&v, key.TxHash.data(), sizeof v);
+		return (v ^ FlatHashSalt() ^ (uint64_t(uint32_t(key.Index)) << 40)) * 0x9E3779B97F4A7C15ULL;
+	}
+};
+
+template <class K, class V, class H = FlatKeyHash<K>>
+class FlatHashMap {
+	static const int GROUP_SIZE = 16;
+	static const int8_t CTRL_EMPTY = -128, CTRL_DELETED = -2;		// full slots are 0..127
+
+	struct BitMask {
+		uint32_t Mask;
+
+		explicit operator bool() const { return Mask != 0; }
+		int Lowest() const {
+			int r = 0;
+			for (uint32_t m = Mask; !(m & 1); m >>= 1)
+				++r;
+			return r;
+		}
+		void ClearLowest() { Mask &= Mask - 1; }
+	};
+
+	struct Group {
+		const int8_t *Ctrl;
+
+#if UCFG_PLATFORM_X64
+		BitMask Match(int8_t h2) const {
+			__m128i ctrl = _mm_loadu_si128((const __m128i*)Ctrl);
+			return BitMask{ (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))) };
+		}
+
+		BitMask MatchEmptyOrDeleted() const {			// EMPTY and DELETED are the only negative values below -1
+			__m128i ctrl = _mm_loadu_si128((const __m128i*)Ctrl);
+			return BitMask{ (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)) };
+		}
+#else
+		BitMask Match(int8_t h2) const {
+			uint32_t r = 0;
+			for (int i = 0; i < GROUP_SIZE; ++i)
+				r |= uint32_t(Ctrl[i] == h2) << i;
+			return BitMask{ r };
+		}
+
+		BitMask MatchEmptyOrDeleted() const {
+			uint32_t r = 0;
+			for (int i = 0; i < GROUP_SIZE; ++i)
+				r |= uint32_t(Ctrl[i] < -1) << i;
+			return BitMask{ r };
+		}
+#endif
+		BitMask MatchEmpty() const { return Match(CTRL_EMPTY); }
+	};
+public:
+	typedef K key_type;
+	typedef V mapped_type;
+	typedef pair<const K, V> value_type;
+
+	template <class M, class T>
+	class Iterator {
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef FlatHashMap::value_type value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T *pointer;
+		typedef T& reference;
+
+		Iterator(M *m = nullptr, size_t i = 0) : m_m(m), m_i(i) { SkipFree(); }
+		template <class M2, class T2> Iterator(const Iterator<M2, T2>& it) : m_m(it.m_m), m_i(it.m_i) {}
+
+		T& operator*() const { return m_m->m_slots[m_i]; }
+		T *operator->() const { return &m_m->m_slots[m_i]; }
+		Iterator& operator++() { ++m_i; SkipFree(); return *this; }
+		Iterator operator++(int) { Iterator r = *this; ++*this; return r; }
+		bool operator==(const Iterator& it) const { return m_i == it.m_i; }
+		bool operator!=(const Iterator& it) const { return m_i != it.m_i; }
+	private:
+		M *m_m;
+		size_t m_i;
+
+		void SkipFree() {
+			if (m_m)
+				for (; m_i < m_m->m_capacity && m_m->m_ctrl[m_i] < 0; ++m_i)
+					;
+		}
+
+		template <class, class> friend class Iterator;
+		friend class FlatHashMap;
+	};
+
+	typedef Iterator<FlatHashMap, value_type> iterator;
+	typedef Iterator<const FlatHashMap, const value_type> const_iterator;
+
+	FlatHashMap() {}
+
+	FlatHashMap(const FlatHashMap& x) {
+		reserve(x.size());
+		for (auto& v : x)
+			insert(v);
+	}
+
+	FlatHashMap(FlatHashMap&& x) noexcept {
+		swap(*this, x);
+	}
+
+	~FlatHashMap() {
+		clear();
+		FreeStorage();
+	}
+
+	FlatHashMap& operator=(FlatHashMap x) {
+		swap(*this, x);
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, m_capacity); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, m_capacity); }
+
+	iterator find(const K& key) { return iterator(this, FindIndex(key)); }
+	const_iterator find(const K& key) const { return const_iterator(this, FindIndex(key)); }
+	size_t count(const K& key) const { return FindIndex(key) != m_capacity; }
+
+	V& at(const K& key) {
+		size_t i = FindIndex(key);
+		if (i == m_capacity)
+			throw out_of_range("FlatHashMap::at");
+		return m_slots[i].second;
+	}
+
+	const V& at(const K& key) const { return const_cast<FlatHashMap*>(this)->at(key); }
+
+	pair<iterator, bool> insert(const value_type& v) {
+		return emplace(v.first, v.second);
+	}
+
+	template <class KK, class VV>
+	pair<iterator, bool> insert(pair<KK, VV>&& v) {
+		return emplace(std::forward<KK>(v.first), std::forward<VV>(v.second));
+	}
+
+	template <class KK, class... A>
+	pair<iterator, bool> emplace(KK&& key, A&&... args) {
+		uint64_t h = H()(key);
+		size_t i = FindIndex(key, h);
+		if (i != m_capacity)
+			return make_pair(iterator(this, i), false);
+		i = PrepareInsert(h);
+		new(&m_slots[i]) value_type(piecewise_construct, forward_as_tuple(std::forward<KK>(key)), forward_as_tuple(std::forward<A>(args)...));
+		return make_pair(iterator(this, i), true);
+	}
+
+	V& operator[](const K& key) {
+		return emplace(key).first->second;
+	}
+
+	size_t erase(const K& key) {
+		size_t i = FindIndex(key);
+		if (i == m_capacity)
+			return 0;
+		EraseAt(i);
+		return 1;
+	}
+
+	iterator erase(const_iterator it) {
+		EraseAt(it.m_i);
+		return iterator(this, it.m_i);			// the slot is free now, the constructor skips to the next element
+	}
+
+	iterator erase(iterator it) {
+		return erase(const_iterator(it));
+	}
+
+	void clear() {
+		for (size_t i = 0; i < m_capacity; ++i)
+			if (m_ctrl[i] >= 0) {
+				m_slots[i].~value_type();
+				m_ctrl[i] = CTRL_EMPTY;
+			}
+		m_size = m_deleted = 0;
+	}
+
+	void reserve(size_t n) {
+		size_t cap = GROUP_SIZE;
+		while (cap * 7 / 8 < n)
+			cap *= 2;
+		if (cap > m_capacity)
+			Rehash(cap);
+	}
+
+	friend void swap(FlatHashMap& x, FlatHashMap& y) noexcept {
+		std::swap(x.m_ctrl, y.m_ctrl);
+		std::swap(x.m_slots, y.m_slots);
+		std::swap(x.m_capacity, y.m_capacity);
+		std::swap(x.m_size, y.m_size);
+		std::swap(x.m_deleted, y.m_deleted);
+	}
+private:
+	int8_t *m_ctrl = nullptr;
+	value_type *m_slots = nullptr;
+	size_t m_capacity = 0, m_size = 0, m_deleted = 0;		// capacity is 0 or a power of 2 >= GROUP_SIZE
+
+	static int8_t H2(uint64_t h) { return int8_t(h & 0x7F); }
+
+	// Quadratic probing over whole groups, visits every group because the number of groups is a power of 2
+	template <class F>
+	size_t Probe(uint64_t h, F f) const {
+		size_t mask = m_capacity / GROUP_SIZE - 1, g = size_t(h >> 7) & mask;
+		for (size_t step = 1; ; g = (g + step++) & mask) {
+			size_t r = f(g * GROUP_SIZE, Group{ m_ctrl + g * GROUP_SIZE });
+			if (r != SIZE_MAX)
+				return r;
+		}
+	}
+
+	size_t FindIndex(const K& key) const { return FindIndex(key, H()(key)); }
+
+	size_t FindIndex(const K& key, uint64_t h) const {
+		if (!m_capacity)
+			return 0;
+		int8_t h2 = H2(h);
+		return Probe(h, [&](size_t base, Group group) {
+			for (BitMask m = group.Match(h2); m; m.ClearLowest()) {
+				size_t i = base + m.Lowest();
+				if (m_slots[i].first == key)
+					return i;
+			}
+			return group.MatchEmpty() ? m_capacity : SIZE_MAX;
+		});
+	}
+
+	size_t PrepareInsert(uint64_t h) {
+		if ((m_size + m_deleted + 1) > m_capacity * 7 / 8)
+			Rehash(m_size + 1 > m_capacity * 7 / 16 ? (std::max)(m_capacity * 2, (size_t)GROUP_SIZE) : m_capacity);	// same size just drops tombstones
+		size_t i = Probe(h, [](size_t base, Group group) {
+			BitMask m = group.MatchEmptyOrDeleted();
+			return m ? base + m.Lowest() : SIZE_MAX;
+		});
+		if (m_ctrl[i] == CTRL_DELETED)
+			--m_deleted;
+		m_ctrl[i] = H2(h);
+		++m_size;
+		return i;
+	}
+
+	void EraseAt(size_t i) {
+		m_slots[i].~value_type();
+		m_ctrl[i] = CTRL_DELETED;
+		--m_size;
+		++m_deleted;
+	}
+
+	void FreeStorage() {
+		delete[] m_ctrl;
+		::operator delete(m_slots);
+		m_ctrl = nullptr;
+		m_slots = nullptr;
+		m_capacity = 0;
+	}
+
+	void Rehash(size_t cap) {
+		int8_t *oldCtrl = m_ctrl;
+		value_type *oldSlots = m_slots;
+		size_t oldCap = m_capacity;
+
+		m_ctrl = new int8_t[cap];
+		memset(m_ctrl, CTRL_EMPTY, cap);
+		m_slots = (value_type*)::operator new(cap * sizeof(value_type));
+		m_capacity = cap;
+		m_size = m_deleted = 0;
+		for (size_t i = 0; i < oldCap; ++i)
+			if (oldCtrl[i] >= 0) {
+				uint64_t h = H()(oldSlots[i].first);
+				new(&m_slots[PrepareInsert(h)]) value_type(std::move(oldSlots[i]));
+				oldSlots[i].~value_type();
+			}
+		delete[] oldCtrl;
+		::operator delete(oldSlots);
+	}
+};
+
+} // Coin::
@@ -247,9 +247,16 @@ void WalletBase::RegisterForMining(WalletBase* wallet) {
 		Miner.reset(new EmbeddedMiner(*(Wallet*)wallet));
 	}
 	dynamic_cast<EmbeddedMiner*>(Miner.get())->RegisterForMining();
+	if (!StakeMinter && (StakeMinter = m_eng->CreateStakeMinter(*wallet)))
+		StakeMinter->Start();
 }
 
 void WalletBase::UnregisterForMining(WalletBase* wallet) {
+	if (StakeMinter) {
+		StakeMinter->Stop();
+		StakeMinter->Join();
+		StakeMinter = nullptr;
+	}
 	if (Miner.get()) {
 		dynamic_cast<EmbeddedMiner*>(Miner.get())->UnregisterForMining();
 		EXT_LOCKED(MtxMiner, Miner.reset());
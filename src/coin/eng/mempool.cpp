@@ -20,13 +20,17 @@ TxInfo::TxInfo(const class Tx& tx, uint32_t serializationSize)
 {
 }
 
-void TxPool::Add(const TxInfo& txInfo) {
+void TxPool::Add(const TxInfo& txInfoArg) {
+	TxInfo txInfo = txInfoArg;
+	txInfo.Tx = txInfoArg.Tx.DetachedFromArena();
+	HashValue hash = Hash(txInfo.Tx);
 	EXT_LOCK (Mtx) {
-		m_hashToTxInfo[Hash(txInfo.Tx)] = txInfo;
+		m_hashToTxInfo[hash] = txInfo;
 		EXT_FOR (const TxIn& txIn, txInfo.Tx.TxIns()) {
 			m_outPointToNextTx.insert(make_pair(txIn.PrevOutPoint, txInfo.Tx));
 		}
 	}
+	Eng.FeeEstimator.OnTxAdded(hash, txInfo.FeeRatePerKB, Eng.BestBlockHeight());
 }
 
 void TxPool::Remove(const Tx& tx) {
@@ -36,6 +40,7 @@ void TxPool::Remove(const Tx& tx) {
 		}
 		m_hashToTxInfo.erase(Hash(tx));
 	}
+	Eng.FeeEstimator.OnTxRemoved(Hash(tx));
 }
 
 void TxPool::EraseOrphanTx(const HashValue& hash) {
@@ -55,7 +60,7 @@ void TxPool::EraseOrphanTx(const HashValue& hash) {
 
 void TxPool::AddOrphan(const Tx& tx) {
 	HashValue hash = Hash(tx);
-	if (m_hashToOrphan.insert(make_pair(hash, tx)).second) {
+	if (m_hashToOrphan.insert(make_pair(hash, tx.DetachedFromArena())).second) {
 		EXT_FOR(const TxIn& txIn, tx.TxIns()) {
 			m_prevHashToOrphanHash.insert(make_pair(txIn.PrevOutPoint.TxHash, hash));
 		}
@@ -175,8 +180,10 @@ void TxPool::OnTxMessage(const Tx& tx) {
 		for (int i = 0; i < vQueue.size(); ++i) {
 			HashValue hash = vQueue[i];
 			pair<TxPool::CHashToHash::iterator, TxPool::CHashToHash::iterator> range = m_prevHashToOrphanHash.equal_range(hash);
-			for (TxPool::CHashToHash::iterator j = range.first; j != range.second; ++j)
-				AddToPool(m_hashToOrphan[j->second], vQueue);
+			for (TxPool::CHashToHash::iterator j = range.first; j != range.second; ++j) {
+				Tx orphan = m_hashToOrphan[j->second];			// copy, the flat map moves its elements on insertion
+				AddToPool(orphan, vQueue);
+			}
 			EraseOrphanTx(hash);
 		}
 	}
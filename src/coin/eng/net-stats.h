@@ -0,0 +1,120 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Per-command P2P counters: bytes, deserialize/Process time, time waiting for the engine mutexes.
+// Counters are striped by thread, each stripe on its own cache line, so concurrent Link threads don't share lines
+
+#pragma once
+
+namespace Coin {
+
+const int NETSTATS_STRIPES = 8,
+	NETSTATS_HIST_BUCKETS = 20;				// log2 of microseconds: [0..1us], (1..2], ... (2^18..inf)
+
+// Nanoseconds this thread spent blocked in WaitTimedMutex::lock()
+inline int64_t& ThreadLockWaitNs() {
+	static thread_local int64_t s_ns;
+	return s_ns;
+}
+
+template <class M>
+class WaitTimedMutex : public M {
+public:
+	void lock() {
+		if (!M::try_lock()) {
+			auto t0 = std::chrono::steady_clock::now();
+			M::lock();
+			ThreadLockWaitNs() += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+		}
+	}
+};
+
+struct MessageStatsSnapshot {
+	uint64_t Received, Sent, BytesIn, BytesOut, DeserializeUs, ProcessUs, LockWaitUs;
+	uint64_t ProcessHist[NETSTATS_HIST_BUCKETS];
+
+	MessageStatsSnapshot() {
+		memset(this, 0, sizeof(*this));
+	}
+};
+
+class MessageStats {
+	struct DECLSPEC_ALIGN(64) Stripe {
+		atomic<uint64_t> Received, Sent, BytesIn, BytesOut, DeserializeUs, ProcessUs, LockWaitUs;
+		atomic<uint64_t> ProcessHist[NETSTATS_HIST_BUCKETS];
+
+		Stripe() {
+			Received = Sent = BytesIn = BytesOut = DeserializeUs = ProcessUs = LockWaitUs = 0;
+			for (auto& a : ProcessHist)
+				a = 0;
+		}
+	};
+
+	Stripe m_stripes[NETSTATS_STRIPES];
+
+	Stripe& Local() {
+		static atomic<int> s_aNext;
+		static thread_local int s_idx = s_aNext++ % NETSTATS_STRIPES;
+		return m_stripes[s_idx];
+	}
+public:
+	void OnReceived(size_t bytes, int64_t deserializeUs) {
+		Stripe& s = Local();
+		s.Received.fetch_add(1, memory_order_relaxed);
+		s.BytesIn.fetch_add(bytes, memory_order_relaxed);
+		s.DeserializeUs.fetch_add(deserializeUs, memory_order_relaxed);
+	}
+
+	void OnSent(size_t bytes) {
+		Stripe& s = Local();
+		s.Sent.fetch_add(1, memory_order_relaxed);
+		s.BytesOut.fetch_add(bytes, memory_order_relaxed);
+	}
+
+	void OnProcessed(int64_t processUs, int64_t lockWaitUs) {
+		Stripe& s = Local();
+		s.ProcessUs.fetch_add(processUs, memory_order_relaxed);
+		s.LockWaitUs.fetch_add(lockWaitUs, memory_order_relaxed);
+		int bucket = 0;
+		for (uint64_t us = processUs; us > 1 && bucket < NETSTATS_HIST_BUCKETS - 1; us = (us + 1) / 2)
+			++bucket;
+		s.ProcessHist[bucket].fetch_add(1, memory_order_relaxed);
+	}
+
+	MessageStatsSnapshot Snapshot() const;
+};
+
+// Entries for all registered commands are created in the constructor, so lookups need no lock
+class NetStats {
+public:
+	NetStats();
+	MessageStats& Of(const char *cmd);
+	vector<pair<String, MessageStatsSnapshot>> Snapshot() const;
+	void OnPeriodic(const DateTime& now);		// dumps to the trace every NETSTATS_DUMP_INTERVAL
+private:
+	unordered_map<String, unique_ptr<MessageStats>> m_map;
+	MessageStats m_other;						// unknown commands
+	DateTime m_dtNextDump;
+};
+
+// Measures Process() of one message: wall time and time blocked on WaitTimedMutex'es
+class MessageProcessTimer {
+	MessageStats& m_stats;
+	std::chrono::steady_clock::time_point m_t0;
+	int64_t m_lockWaitNs0;
+public:
+	MessageProcessTimer(MessageStats& stats)
+		: m_stats(stats)
+		, m_t0(std::chrono::steady_clock::now())
+		, m_lockWaitNs0(ThreadLockWaitNs())
+	{}
+
+	~MessageProcessTimer() {
+		int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_t0).count();
+		m_stats.OnProcessed(us, (ThreadLockWaitNs() - m_lockWaitNs0) / 1000);
+	}
+};
+
+} // Coin::
@@ -22,6 +22,8 @@ const int
 	BLOCK_DOWNLOAD_WINDOW = 1024;					// at least 1024 is recommended for some non-sorted bootstrap.dat files
 
 const seconds BLOCK_STALLING_TIMEOUT = seconds(2);			// seconds
+const seconds BLOCK_REASSIGN_TIMEOUT = seconds(5);			// minimal age of a request before it may move to a faster link
+const seconds NETSTATS_DUMP_INTERVAL = seconds(600);
 
 static const int64_t
 	DEFAULT_TRANSACTION_MINFEE = 1000,
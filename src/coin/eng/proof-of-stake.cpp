@@ -28,28 +28,46 @@ static TimeSpan GetStakeModifierSelectionInterval() {
 
 static const TimeSpan STAKE_MODIFIER_SELECTION_INTERVAL = GetStakeModifierSelectionInterval();
 
+BigInteger PosTxObj::CentSecondsOf(int64_t value, const TxoOrigin& origin) const {
+	PosEng& eng = (PosEng&)Eng();
+	if (Timestamp < origin.TxTimestamp)
+		Throw(CoinErr::TimestampViolation);
+	if (origin.Height < 0 || eng.GetBlockTimestamp(origin.Height)+TimeSpan::FromDays(30) > Timestamp)		// outputs of the current block are always too recent
+		return 0;
+	return BigInteger(value) * duration_cast<seconds>(Timestamp-origin.TxTimestamp).count() / (eng.ChainParams.CoinValue / 100);
+}
+
+void PosTxObj::CalcCoinAge(const vector<pair<TxOut, TxoOrigin>>& inputs) const {
+	BigInteger centSecond = 0;
+	for (auto& input : inputs)
+		centSecond += CentSecondsOf(input.first.Value, input.second);
+	m_coinAge = explicit_cast<int64_t>(centSecond / (100 * 24*60*60));
+}
+
 int64_t PosTxObj::GetCoinAge() const {
 	if (m_coinAge == numeric_limits<uint64_t>::max()) {
-		CoinEng& eng = Eng();
-
-		BigInteger centSecond = 0;
-		if (Tx((PosTxObj*)this).IsCoinBase())
+		if (IsCoinBase())
 			m_coinAge = 0;
-		else {
+		else {																	// not connected through TxoMap, e.g. mempool txes
+			vector<pair<TxOut, TxoOrigin>> inputs;
 			EXT_FOR (const TxIn& txIn, TxIns()) {
 				Tx txPrev = Tx::FromDb(txIn.PrevOutPoint.TxHash);
-				DateTime dtPrev = ((PosTxObj*)txPrev.m_pimpl.get())->Timestamp;
-				if (Timestamp < dtPrev)
-					Throw(CoinErr::TimestampViolation);
-				if (eng.GetBlockByHeight(txPrev.Height).get_Timestamp()+TimeSpan::FromDays(30) <= Timestamp)
-					centSecond += BigInteger(txPrev.TxOuts()[txIn.PrevOutPoint.Index].Value) * duration_cast<seconds>(Timestamp-dtPrev).count() / (eng.ChainParams.CoinValue / 100);
+				TxoOrigin origin;
+				origin.TxTimestamp = txPrev->get_TxTimestamp();
+				origin.Height = txPrev.Height;
+				inputs.push_back(make_pair(txPrev.TxOuts()[txIn.PrevOutPoint.Index], origin));
 			}
-			m_coinAge = explicit_cast<int64_t>(centSecond / (100 * 24*60*60));
+			CalcCoinAge(inputs);
 		}
 	}
 	return m_coinAge;
 }
 
+bool PosTxObj::IsCoinStake() const {
+	const vector<TxIn>& txIns = TxIns();
+	return !txIns.empty() && !txIns[0].PrevOutPoint.IsNull() && TxOuts.size() >= 2 && TxOuts[0].IsEmpty();		// the empty first output marks the coinstake
+}
+
 int64_t GetProofOfStakeReward(int64_t coinAge) {
 	CoinEng& eng = Eng();
 	return eng.ChainParams.CoinValue * eng.ChainParams.AnnualPercentageRate * coinAge * 33 / (100*(365*33 + 8));
@@ -124,25 +142,36 @@ PosEng::StakeModifierItem PosEng::GetStakeModifierItem(int height) {
 			PosBlockObj& pos = PosBlockObj::Of(b);
 			r = StakeModifierItem(pos.Timestamp, pos.StakeModifier);
 			StakeModifierCache.insert(make_pair(height, r));
+			if (BlockTimestamps.size() <= height)
+				BlockTimestamps.resize(height + 1);
+			BlockTimestamps[height] = (uint32_t)to_time_t(pos.Timestamp);
 		}
 	}
 	return r;
 }
 
+DateTime PosEng::GetBlockTimestamp(int height) {
+	EXT_LOCK(MtxStakeModifierCache) {
+		if (height < BlockTimestamps.size() && BlockTimestamps[height])
+			return DateTime::from_time_t(BlockTimestamps[height]);
+	}
+	return GetStakeModifierItem(height).Timestamp;
+}
+
 PosEng::StakeModifierItem PosEng::GetLastStakeModifier(const HashValue& hashBlock, int height) {
-	EXT_LOCK(Caches.Mtx) {
-		Block b(nullptr);
-		for (HashValue hash=hashBlock; ; hash=b.PrevBlockHash, --height) {
-			if (!Lookup(Caches.HashToBlockCache, hash, b)) {
-				BlockTreeItem bti = Tree.FindInMap(hash);
-				if (!bti || bti.IsHeaderOnly)
-					break;
-				b = Block(bti.m_pimpl);
-			}
-			PosBlockObj& pos = PosBlockObj::Of(b);
-			if (!!pos.StakeModifier)
-				return StakeModifierItem(pos.Timestamp, pos.StakeModifier);
+	Block b(nullptr);
+	for (HashValue hash=hashBlock; ; hash=b.PrevBlockHash, --height) {
+		if (auto ob = Caches.HashToBlockCache.Lookup(hash))
+			b = ob.value();
+		else {
+			BlockTreeItem bti = Tree.FindInMap(hash);
+			if (!bti || bti.IsHeaderOnly)
+				break;
+			b = Block(bti.m_pimpl);
 		}
+		PosBlockObj& pos = PosBlockObj::Of(b);
+		if (!!pos.StakeModifier)
+			return StakeModifierItem(pos.Timestamp, pos.StakeModifier);
 	}
 	for (; height>=0; --height) {
 		StakeModifierItem item = GetStakeModifierItem(height);
@@ -187,6 +216,24 @@ void PosBlockObj::WriteKernelStakeModifier(BinaryWriter& wr, const Block& blockP
 	wr << item.StakeModifier.get();
 }
 
+uint32_t PosBlockObj::TxOffsetInBlock(const Block& block, const HashValue& hashTx) {
+	MemoryStream msBlock;
+	ProtocolWriter wr(msBlock);
+	block.WriteHeader(wr);
+	CoinSerialized::WriteCompactSize(wr, block.get_Txes().size());
+	EXT_FOR (const Tx& t, block.get_Txes()) {
+		if (Coin::Hash(t) == hashTx)
+			return uint32_t(Span(msBlock).size());
+		wr << t;
+	}
+	Throw(CoinErr::TxNotFound);
+}
+
+void PosBlockObj::WriteKernelPrefix(BinaryWriter& wr, const Block& blockFrom, const OutPoint& prevOut, const DateTime& dtPrev) const {
+	WriteKernelStakeModifier(wr, blockFrom);
+	wr << (uint32_t)to_time_t(blockFrom.get_Timestamp()) << TxOffsetInBlock(blockFrom, prevOut.TxHash) << (uint32_t)to_time_t(dtPrev) << uint32_t(prevOut.Index);
+}
+
 HashValue PosBlockObj::HashProofOfStake() const {
 	if (!m_hashProofOfStake) {
 		CoinEng& eng = Eng();
@@ -201,9 +248,9 @@ HashValue PosBlockObj::HashProofOfStake() const {
 			Throw(CoinErr::TimestampViolation);
 		VerifySignature(txPrev, tx, 0);
 
-		Block blockPrev = eng.GetBlockByHeight(txPrev.Height);
-		if (blockPrev.get_Timestamp()+TimeSpan::FromDays(30) > dtTx)
+		if (((PosEng&)eng).GetBlockTimestamp(txPrev.Height)+TimeSpan::FromDays(30) > dtTx)
 			Throw(CoinErr::CoinsAreTooRecent);
+		Block blockPrev = eng.GetBlockByHeight(txPrev.Height);			// the kernel needs its header and the tx offset
 
 		int64_t val = txPrev.TxOuts()[txIn.PrevOutPoint.Index].Value;
 		int64_t nTimeWeight = CorrectTimeWeight(dtTx, duration_cast<seconds>(std::min(dtTx-dtPrev, TimeSpan::FromDays(90))).count());
@@ -213,21 +260,8 @@ HashValue PosBlockObj::HashProofOfStake() const {
 
 		MemoryStream ms;
 		BinaryWriter wr(ms);
-		WriteKernelStakeModifier(wr, blockPrev);
-
-		wr << (uint32_t)to_time_t(blockPrev.get_Timestamp());
-		MemoryStream msBlock;
-		ProtocolWriter wrPrev(msBlock);
-		blockPrev.WriteHeader(wrPrev);
-		CoinSerialized::WriteCompactSize(wrPrev, blockPrev.get_Txes().size());
-		EXT_FOR (const Tx& t, blockPrev.get_Txes()) {
-			if (Coin::Hash(t) == txIn.PrevOutPoint.TxHash) {
-				wr << uint32_t(Span(msBlock).size());
-				break;
-			}
-			wrPrev << t;
-		}
-		wr << (uint32_t)to_time_t(dtPrev) << uint32_t(txIn.PrevOutPoint.Index) << (uint32_t)to_time_t(dtTx);
+		WriteKernelPrefix(wr, blockPrev, txIn.PrevOutPoint, dtPrev);
+		wr << (uint32_t)to_time_t(dtTx);
 		HashValue h = Coin::Hash(ms);
 
 		uint8_t ar[33];
@@ -297,7 +331,7 @@ void PosBlockObj::Check(bool bCheckMerkleRoot) {
 	base::Check(bCheckMerkleRoot);
 
 	for (int i = 2; i < txes.size(); ++i)
-		if (txes[i].IsCoinStake())
+		if (txes[i]->IsCoinStake())
 			Throw(CoinErr::CoinstakeInWrongPos);
 
 	CheckCoinbaseTimestamp();
@@ -464,7 +498,10 @@ PosEng::PosEng(CoinDb& cdb)
 
 void PosEng::ClearByHeightCaches() {
 	base::ClearByHeightCaches();
-	EXT_LOCKED(MtxStakeModifierCache, StakeModifierCache.clear());
+	EXT_LOCK(MtxStakeModifierCache) {
+		StakeModifierCache.clear();
+		BlockTimestamps.clear();
+	}
 }
 
 int64_t PosEng::GetSubsidy(int height, const HashValue& prevBlockHash, double difficulty, bool bForCheck) {
@@ -22,6 +22,9 @@ public:
 	{}
 
 	int64_t GetCoinAge() const override;
+	bool IsCoinStake() const override;
+	void CalcCoinAge(const vector<pair<TxOut, TxoOrigin>>& inputs) const override;
+	DateTime get_TxTimestamp() const override { return Timestamp; }
 protected:
 	PosTxObj *Clone() const override { return new PosTxObj(_self); }
 
@@ -36,6 +39,8 @@ protected:
 	void CheckCoinStakeReward(int64_t reward, const Target& target) const override;
 private:
 	mutable int64_t m_coinAge;
+
+	BigInteger CentSecondsOf(int64_t value, const TxoOrigin& origin) const;
 };
 
 class PosBlockObj : public BlockObj {
@@ -84,7 +89,7 @@ public:
 	void ReadDbSuffix(const BinaryReader& rd) override;
 
 	ProofOf ProofType() const override {
-		return get_Txes().size() > 1 && get_Txes()[1].IsCoinStake() ? ProofOf::Stake : ProofOf::Work;
+		return get_Txes().size() > 1 && get_Txes()[1]->IsCoinStake() ? ProofOf::Stake : ProofOf::Work;
 	}
 
 	Coin::HashValue Hash() const override;
@@ -111,6 +116,8 @@ public:
 	virtual int64_t CorrectTimeWeight(DateTime dtTx, int64_t nTimeWeight) const;
 	void WriteKernelStakeModifierV05(DateTime dtTx, BinaryWriter& wr, const Block& blockPrev) const;
 	virtual void WriteKernelStakeModifier(BinaryWriter& wr, const Block& blockPrev) const;
+	void WriteKernelPrefix(BinaryWriter& wr, const Block& blockFrom, const OutPoint& prevOut, const DateTime& dtPrev) const;	// the kernel without the coinstake timestamp
+	static uint32_t TxOffsetInBlock(const Block& block, const HashValue& hashTx);
 	HashValue HashProofOfStake() const;
 	bool VerifySignatureByTxOut(const TxOut& txOut);
 	void CheckSignature() override;
@@ -152,12 +159,17 @@ public:
 		{}
 	};
 	LruMap<int, StakeModifierItem> StakeModifierCache;
+	vector<uint32_t> BlockTimestamps;						// by height, 0 if not loaded yet; guarded by MtxStakeModifierCache
 
 	PosEng(CoinDb& cdb);
 
 	StakeModifierItem GetStakeModifierItem(int height);
+	DateTime GetBlockTimestamp(int height);
 	StakeModifierItem GetLastStakeModifier(const HashValue& hashBlock, int height);
 	virtual int64_t GetProofOfStakeReward(int64_t coinAge, const Target& target, const DateTime& dt);
+#if UCFG_COIN_GENERATE
+	Thread *CreateStakeMinter(WalletBase& wallet) override;
+#endif
 protected:
 	void ClearByHeightCaches() override;
 	int64_t GetMaxSubsidy() { return ChainParams.InitBlockValue * ChainParams.CoinValue; }
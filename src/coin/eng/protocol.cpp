@@ -15,6 +15,7 @@ using namespace Ext::Crypto;
 
 #include "coin-protocol.h"
 #include "eng.h"
+#include "block-filter.h"
 
 namespace Coin {
 
@@ -80,6 +81,9 @@ static MessageClassFactoryBase
     s_factoryCompactBlock("cmpctblock"  , &CoinEng::CreateCompactBlockMessage),
     s_factoryGetBlockTransactions("getblocktxn" , &CoinEng::CreateGetBlockTransactionsMessage),
     s_factoryBlockTransactions("blocktxn"  , &CoinEng::CreateBlockTransactionsMessage),
+	s_factoryGetCFilters("getcfilters"	, &CoinEng::CreateGetCFiltersMessage),
+	s_factoryGetCFHeaders("getcfheaders", &CoinEng::CreateGetCFHeadersMessage),
+	s_factoryGetCFCheckpt("getcfcheckpt", &CoinEng::CreateGetCFCheckptMessage),
 
 	s_factoryCheckPoint	("checkpoint"	, &CoinEng::CreateCheckPointMessage	);		// PPCoin
 
@@ -185,6 +189,9 @@ CoinMessage* CoinEng::CreateGetBlockTransactionsMessage() { return new GetBlockT
 CoinMessage* CoinEng::CreateBlockTransactionsMessage() { return new BlockTransactionsMessage(); }
 CoinMessage* CoinEng::CreateSendCompactBlockMessage() { return new SendCompactBlockMessage(); }
 CoinMessage* CoinEng::CreateCompactBlockMessage() { return new CompactBlockMessage(); }
+CoinMessage* CoinEng::CreateGetCFiltersMessage() { return new GetCFiltersMessage(); }
+CoinMessage* CoinEng::CreateGetCFHeadersMessage() { return new GetCFHeadersMessage(); }
+CoinMessage* CoinEng::CreateGetCFCheckptMessage() { return new GetCFCheckptMessage(); }
 
 CoinMessage *CoinEng::CreateCheckPointMessage() {
 	return new CoinMessage("checkpoint");
@@ -202,14 +209,65 @@ String NodeServices::ToString(uint64_t s) {
 		os << " NODE_WITNESS";
 	if (s & NODE_XTHIN)
 		os << " NODE_XTHIN";
+	if (s & NODE_COMPACT_FILTERS)
+		os << " NODE_COMPACT_FILTERS";
 	if (s & NODE_NETWORK_LIMITED)
 		os << " NODE_NETWORK_LIMITED";
-	if (s & ~(NODE_NETWORK | NODE_GETUTXO | NODE_BLOOM | NODE_WITNESS | NODE_XTHIN | NODE_NETWORK_LIMITED))
+	if (s & ~(NODE_NETWORK | NODE_GETUTXO | NODE_BLOOM | NODE_WITNESS | NODE_XTHIN | NODE_COMPACT_FILTERS | NODE_NETWORK_LIMITED))
 		os << " " << hex << showbase << s;
 	return os.str();
 }
 
-ptr<CoinMessage> CoinMessage::ReadFromStream(Link& link, const BinaryReader& rd) {
+NetStats::NetStats() {
+	for (auto& kv : MessageClassFactoryBase::s_map)
+		m_map[kv.first].reset(new MessageStats);
+}
+
+MessageStats& NetStats::Of(const char *cmd) {
+	auto it = m_map.find(cmd);
+	return it == m_map.end() ? m_other : *it->second;
+}
+
+MessageStatsSnapshot MessageStats::Snapshot() const {
+	MessageStatsSnapshot r;
+	for (auto& s : m_stripes) {
+		r.Received += s.Received;
+		r.Sent += s.Sent;
+		r.BytesIn += s.BytesIn;
+		r.BytesOut += s.BytesOut;
+		r.DeserializeUs += s.DeserializeUs;
+		r.ProcessUs += s.ProcessUs;
+		r.LockWaitUs += s.LockWaitUs;
+		for (int i = 0; i < NETSTATS_HIST_BUCKETS; ++i)
+			r.ProcessHist[i] += s.ProcessHist[i];
+	}
+	return r;
+}
+
+vector<pair<String, MessageStatsSnapshot>> NetStats::Snapshot() const {
+	vector<pair<String, MessageStatsSnapshot>> r;
+	for (auto& kv : m_map) {
+		MessageStatsSnapshot s = kv.second->Snapshot();
+		if (s.Received || s.Sent)
+			r.push_back(make_pair(kv.first, s));
+	}
+	MessageStatsSnapshot s = m_other.Snapshot();
+	if (s.Received || s.Sent)
+		r.push_back(make_pair(String("other"), s));
+	return r;
+}
+
+void NetStats::OnPeriodic(const DateTime& now) {
+	if (now < m_dtNextDump)
+		return;
+	m_dtNextDump = now + NETSTATS_DUMP_INTERVAL;
+	for (auto& kv : Snapshot()) {
+		const MessageStatsSnapshot& s = kv.second;
+		TRC(2, kv.first << ": recv " << s.Received << "/" << s.BytesIn << "B, sent " << s.Sent << "/" << s.BytesOut << "B, deserialize " << s.DeserializeUs << "us, process " << s.ProcessUs << "us, lock wait " << s.LockWaitUs << "us");
+	}
+}
+
+ptr<CoinMessage> CoinMessage::ReadFromStream(Link& link, const BinaryReader& rd, bool bDeferParse) {
 	CoinEng& eng = Eng();
 
 	ptr<CoinMessage> r;
@@ -236,21 +294,43 @@ ptr<CoinMessage> CoinMessage::ReadFromStream(Link& link, const BinaryReader& rd)
 		if (letoh(*(uint32_t*)h.data()) != checksum)
 			Throw(ExtErr::Protocol_Violation);
 	}
-	CMemReadStream ms(payload);
 	if (r) {
 		r->LinkPtr = &link;
-		try {
-			DBG_LOCAL_IGNORE_CONDITION(CoinErr::Misbehaving);
-			ProtocolReader prd(ms, link.HasWitness);
-			r->Read(prd);
-		} catch (RCExc ex) {
-			link.Send(new RejectMessage(RejectReason::Malformed, r->Cmd, "error parsing message"));
-			throw ex;		//!!!T
-		}
-	}
+		if (bDeferParse) {
+			r->m_payload = payload;
+			r->m_bDeferredPayload = true;
+		} else
+			r->ReadPayload(link, payload);
+	} else
+		eng.NetStats.Of("").OnReceived(sizeof(SMessageHeader) + payload.size(), 0);
 	return r;
 }
 
+void CoinMessage::ParsePayload() {
+	if (m_bDeferredPayload) {
+		m_bDeferredPayload = false;
+		Blob payload = m_payload;
+		m_payload = Blob(nullptr);
+		ReadPayload(static_cast<Link&>(*LinkPtr), payload);
+	}
+}
+
+void CoinMessage::ReadPayload(Link& link, RCSpan payload) {
+	CoinEng& eng = Eng();
+	CMemReadStream ms(payload);
+	auto t0 = std::chrono::steady_clock::now();
+	try {
+		DBG_LOCAL_IGNORE_CONDITION(CoinErr::Misbehaving);
+		ProtocolReader prd(ms, link.HasWitness);
+		Read(prd);
+	} catch (RCExc ex) {
+		link.Send(new RejectMessage(RejectReason::Malformed, Cmd, "error parsing message"));
+		throw ex;		//!!!T
+	}
+	eng.NetStats.Of(Cmd).OnReceived(sizeof(SMessageHeader) + payload.size(), std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count());
+	TRC(6, eng.ChainParams.Symbol << " " << link.Peer->get_EndPoint() << " " << _self);
+}
+
 void CoinMessage::Write(ProtocolWriter& wr) const {
 }
 
@@ -281,6 +361,8 @@ VersionMessage::VersionMessage()
 		RelayTxes = !eng.Filter;
 	else
 		Services |= NodeServices::NODE_NETWORK;
+	if (eng.BlockFilterIndexComplete)
+		Services |= NodeServices::NODE_COMPACT_FILTERS;
 }
 
 void VersionMessage::Write(ProtocolWriter& wr) const {
@@ -619,8 +701,67 @@ LAB_VERIFIED:
 	}
 }
 
+InventoryRollingBloom::InventoryRollingBloom(unsigned nElements, double fpRate)
+	: m_nEntriesPerGeneration((nElements + 1) / 2)
+	, m_nEntriesThisGeneration(0)
+	, m_generation(1)
+{
+	double logFpRate = log(fpRate);
+	m_nHashFuncs = std::max(1, std::min((int)round(logFpRate / log(0.5)), 50));
+	unsigned nMaxElements = m_nEntriesPerGeneration * 3;
+	uint64_t nFilterBits = (uint64_t)ceil(-1.0 * m_nHashFuncs * nMaxElements / log(1.0 - exp(logFpRate / m_nHashFuncs)));
+	m_data.resize(size_t((nFilterBits + 63) / 64) * 2);
+	GetSystemURandomReader() >> m_k0 >> m_k1;
+}
+
+uint64_t InventoryRollingBloom::HashInv(const Inventory& inv) const {
+	hashval hv = SipHash2_4(m_k0 ^ uint64_t(inv.Type), m_k1).ComputeHash(inv.HashValue.ToSpan());
+	return letoh(*(const uint64_t*)hv.data());
+}
+
+void InventoryRollingBloom::insert(const Inventory& inv) {
+	if (m_nEntriesThisGeneration == m_nEntriesPerGeneration) {
+		m_nEntriesThisGeneration = 0;
+		if (++m_generation == 4)
+			m_generation = 1;
+		uint64_t mask1 = 0 - uint64_t(m_generation & 1),			// wipe the cells of the generation being reused
+			mask2 = 0 - uint64_t(m_generation >> 1);
+		for (size_t p = 0; p < m_data.size(); p += 2) {
+			uint64_t p1 = m_data[p], p2 = m_data[p + 1],
+				mask = (p1 ^ mask1) | (p2 ^ mask2);
+			m_data[p] = p1 & mask;
+			m_data[p + 1] = p2 & mask;
+		}
+	}
+	++m_nEntriesThisGeneration;
+
+	uint64_t h = HashInv(inv);
+	uint32_t h1 = uint32_t(h), h2 = uint32_t(h >> 32);
+	for (unsigned i = 0; i < m_nHashFuncs; ++i, h1 += h2) {
+		int bit = h1 & 0x3F;
+		size_t pos = size_t((uint64_t(h1) * m_data.size()) >> 32);
+		uint64_t& w1 = m_data[pos & ~size_t(1)];
+		uint64_t& w2 = m_data[pos | 1];
+		w1 = (w1 & ~(1ULL << bit)) | (uint64_t(m_generation & 1) << bit);
+		w2 = (w2 & ~(1ULL << bit)) | (uint64_t(m_generation >> 1) << bit);
+	}
+}
+
+bool InventoryRollingBloom::count(const Inventory& inv) const {
+	uint64_t h = HashInv(inv);
+	uint32_t h1 = uint32_t(h), h2 = uint32_t(h >> 32);
+	for (unsigned i = 0; i < m_nHashFuncs; ++i, h1 += h2) {
+		int bit = h1 & 0x3F;
+		size_t pos = size_t((uint64_t(h1) * m_data.size()) >> 32);
+		if (!(((m_data[pos & ~size_t(1)] | m_data[pos | 1]) >> bit) & 1))
+			return false;
+	}
+	return true;
+}
+
 Link::Link(P2P::NetManager& netManager, thread_group& tr)
 	: base(&netManager, &tr)
+	, KnownInvertorySet(ProtocolParam::KNOWN_INVENTORY_ELEMENTS, 0.000001)
 	, LastReceivedBlock(-1)
 	, m_curMerkleBlock(nullptr)
 	, MinFeeRate(0)
@@ -642,13 +783,12 @@ void Link::OnPeriodic(const DateTime& now) {
 	EXT_LOCK (Mtx) {
 		for (CInvertorySetToSend::iterator it = InvertorySetToSend.begin(), e = InvertorySetToSend.end(), tit; it != e && m->Invs.size() < ProtocolParam::MAX_INV_SZ;) {
 			const Inventory& inv = *(tit = it++);
-			if (inv.Type != InventoryType::MSG_TX || bTrickled) {
-				m->Invs.push_back(inv);
-				KnownInvertorySet.insert(inv);
-				InvertorySetToSend.erase(tit);
-			}
+			m->Invs.push_back(inv);
+			KnownInvertorySet.insert(inv);
+			InvertorySetToSend.erase(tit);
 		}
 	}
+	TrickleTxInvs(*m, now);
 	if (!m->Invs.empty()) {
 		TRC(2, "Sending " << m->Invs.size() << " Invs");
 		Send(m);
@@ -680,7 +820,13 @@ void Link::OnPeriodic(const DateTime& now) {
 		RequestBlocks();
 }
 
+static const int64_t FEE_RATE_UNKNOWN = -1;		// not filtered by feefilter, trickled after known feerates
+
 void Link::Push(const Inventory& inv) {
+	if (inv.Type == InventoryType::MSG_TX) {
+		PushTx(inv.HashValue, FEE_RATE_UNKNOWN);		// callers hold MtxPeers, which is taken after TxPool.Mtx, so the pool is not consulted here
+		return;
+	}
 	EXT_LOCK (Mtx) {
 		if (!KnownInvertorySet.count(inv)) {
 #ifdef _DEBUG//!!!D
@@ -693,6 +839,50 @@ void Link::Push(const Inventory& inv) {
 	}
 }
 
+void Link::PushTx(const HashValue& hashTx, int64_t feeRatePerKB) {
+	EXT_LOCK (Mtx) {
+		if (!KnownInvertorySet.count(Inventory(InventoryType::MSG_TX, hashTx)))
+			TxInvToSend[hashTx] = feeRatePerKB;
+	}
+}
+
+// Poisson-timed batches, highest feerate first, at most INVENTORY_BROADCAST_MAX per batch.
+// Sorting is done outside of Mtx, which is held only to move the queue out and the remainder back
+void Link::TrickleTxInvs(InvMessage& m, const DateTime& now) {
+	if (now < NextTxInvSend)
+		return;
+	uint64_t r;
+	GetSystemURandomReader() >> r;
+	double meanMs = Incoming ? ProtocolParam::INVENTORY_BROADCAST_INTERVAL_MS : ProtocolParam::INVENTORY_BROADCAST_INTERVAL_MS / 2;
+	NextTxInvSend = now + milliseconds(int64_t(-log1p(-double(r >> 11) / double(1ULL << 53)) * meanMs));
+
+	vector<pair<int64_t, HashValue>> txInvs;
+	EXT_LOCK (Mtx) {
+		if (TxInvToSend.empty())
+			return;
+		txInvs.reserve(TxInvToSend.size());
+		for (auto& kv : TxInvToSend)
+			txInvs.push_back(make_pair(kv.second, kv.first));
+		TxInvToSend.clear();
+	}
+
+	int64_t minFeeRate = MinFeeRate.load();			// feefilter may have been raised since the txes were queued
+	txInvs.erase(std::remove_if(txInvs.begin(), txInvs.end(), [minFeeRate](const pair<int64_t, HashValue>& p) { return p.first != FEE_RATE_UNKNOWN && p.first < minFeeRate; }), txInvs.end());
+	size_t n = std::min(txInvs.size(), (size_t)ProtocolParam::INVENTORY_BROADCAST_MAX);
+	std::partial_sort(txInvs.begin(), txInvs.begin() + n, txInvs.end(), [](const pair<int64_t, HashValue>& a, const pair<int64_t, HashValue>& b) { return a.first > b.first; });
+
+	EXT_LOCK (Mtx) {
+		for (size_t i = 0; i < txInvs.size(); ++i) {
+			Inventory inv(InventoryType::MSG_TX, txInvs[i].second);
+			if (i < n) {
+				m.Invs.push_back(inv);
+				KnownInvertorySet.insert(inv);
+			} else
+				TxInvToSend.insert(make_pair(txInvs[i].second, txInvs[i].first));
+		}
+	}
+}
+
 void Link::Send(ptr<P2P::Message> msg) {
 	CoinMessage& m = *static_cast<CoinMessage*>(msg.get());
 	CoinEng& eng = static_cast<CoinEng&>(*Net);
@@ -714,6 +904,7 @@ void Link::Send(ptr<P2P::Message> msg) {
 	MemoryStream stmMessage(sizeof header + s.size());
 	BinaryWriter(stmMessage).WriteStruct(header);
 	stmMessage.Write(s);
+	eng.NetStats.Of(m.Cmd).OnSent(sizeof header + s.size());
 	SendBinary(stmMessage);
 }
 
@@ -878,11 +1069,86 @@ void TxMessage::Print(ostream& os) const {
 	os << Hash(Tx);
 }
 
+// Raw bytes come from our own bootstrap file, so only bounds are checked
+static void SkipRaw(const uint8_t *&p, const uint8_t *e, uint64_t n) {
+	if (uint64_t(e - p) < n)
+		Throw(CoinErr::InconsistentDatabase);
+	p += n;
+}
+
+static uint64_t ReadRawCompactSize(const uint8_t *&p, const uint8_t *e) {
+	const uint8_t *q = p;
+	SkipRaw(p, e, 1);
+	int n = *q < 0xFD ? 0 : *q == 0xFD ? 2 : *q == 0xFE ? 4 : 8;
+	if (!n)
+		return *q;
+	SkipRaw(p, e, n);
+	uint64_t r = 0;
+	for (int i = 0; i < n; ++i)
+		r |= uint64_t(q[1 + i]) << (8 * i);
+	return r;
+}
+
+static uint64_t SkipRawTxInsOuts(const uint8_t *&p, const uint8_t *e) {
+	uint64_t nIn = ReadRawCompactSize(p, e);
+	for (uint64_t i = 0; i < nIn; ++i) {
+		SkipRaw(p, e, 36);								// OutPoint
+		SkipRaw(p, e, ReadRawCompactSize(p, e));		// scriptSig
+		SkipRaw(p, e, 4);								// Sequence
+	}
+	uint64_t nOut = ReadRawCompactSize(p, e);
+	for (uint64_t i = 0; i < nOut; ++i) {
+		SkipRaw(p, e, 8);								// Value
+		SkipRaw(p, e, ReadRawCompactSize(p, e));		// scriptPubKey
+	}
+	return nIn;
+}
+
+// Legacy serialization of a raw witness-serialized block of the Bitcoin layout without deserializing it: segwit marker/flag and witness stacks are cut out,
+// all other bytes are written in as few contiguous runs as possible
+static void WriteRawBlockWithoutWitness(RCSpan raw, Stream& stm) {
+	const uint8_t *p = raw.data(), *e = p + raw.size(), *run = p;
+	SkipRaw(p, e, 80);							// header, AuxPow chains are never served raw
+	uint64_t nTx = ReadRawCompactSize(p, e);
+	for (uint64_t i = 0; i < nTx; ++i) {
+		SkipRaw(p, e, 4);						// Ver
+		if (e - p >= 2 && p[0] == 0 && p[1] != 0) {
+			stm.WriteBuffer(run, p - run);
+			run = (p += 2);
+			uint64_t nIn = SkipRawTxInsOuts(p, e);
+			stm.WriteBuffer(run, p - run);
+			for (uint64_t j = 0; j < nIn; ++j)
+				for (uint64_t nItems = ReadRawCompactSize(p, e); nItems--;)
+					SkipRaw(p, e, ReadRawCompactSize(p, e));
+			run = p;
+		} else
+			SkipRawTxInsOuts(p, e);
+		SkipRaw(p, e, 4);						// LockBlock
+	}
+	stm.WriteBuffer(run, p - run);
+}
+
+// SegwitHeight is 0 in chains without SegWit, their Txes may have other layouts (PoS Time field, block signature) which must not be parsed as Bitcoin ones
+static bool RawBlocksMayHaveWitness(CoinEng& eng) {
+	return eng.ChainParams.SegwitHeight > 0 && eng.BestBlockHeight() >= eng.ChainParams.SegwitHeight;
+}
+
 void BlockMessage::Write(ProtocolWriter& wr) const {
+	CoinEng& eng = Eng();
 	if (Block)
 		Block.Write(wr);
-	else
-		Eng().Db->CopyTo(Offset, Size, wr.BaseStream);
+	else if (WitnessAware || !RawBlocksMayHaveWitness(eng))
+		eng.Db->CopyTo(Offset, Size, wr.BaseStream);
+	else {
+		IBlockChainDb& db = *eng.Db;
+		Span raw = db.MappedSpan(Offset, Size);
+		Blob blob;
+		if (!raw.data()) {
+			blob = db.ReadBlob(Offset, Size);
+			raw = Span(blob.constData(), blob.size());
+		}
+		WriteRawBlockWithoutWitness(raw, wr.BaseStream);
+	}
 }
 
 void BlockMessage::Read(const ProtocolReader& rd) {
@@ -22,6 +22,7 @@ void PruneDbThread::Execute() {
 		for (size_t i = 1; i < txes.size(); ++i)
 			for (auto& txIn : txes[i].TxIns())
 				db.PruneTxo(txIn.PrevOutPoint, h);
+		db.PruneBlockUndo(h);				// pruned blocks can't be disconnected
 		db.SetLastPrunedHeight(h);
 	}
 	TRC(1, "Pruned spent TXOs upto Block " << To)
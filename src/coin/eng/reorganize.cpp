@@ -23,14 +23,16 @@ void Block::Disconnect() const {
 	txids.reserve(txes.size());
 
 	if (eng.Mode != EngMode::Lite && eng.Mode != EngMode::BlockParser) {
+		bool bRestored = eng.Db->RestoreSpentCoins(Height);		// one read of the undo record instead of UpdateCoins() per input
 		for (size_t i = txes.size(); i--;) {		// reverse order is important
 			const Tx& tx = txes[i];
 			Coin::HashValue txhash = Coin::Hash(tx);
 			txids.push_back(letoh(*(int64_t*)txhash.data()));
 
 			eng.OnDisconnectInputs(tx);
+			eng.Db->DeleteAddressIndex(tx, (uint32_t)i, Height);
 
-			if (!tx->IsCoinBase()) {
+			if (!bRestored && !tx->IsCoinBase()) {
 				EXT_FOR(const TxIn& txIn, tx.TxIns()) {
 					eng.Db->UpdateCoins(txIn.PrevOutPoint, false, Height);
 				}
@@ -69,7 +71,7 @@ void CoinEng::Reorganize(const BlockHeader& header) {
 		b.LoadToMemory();
 		Tree.Add(b);
 		vDisconnect.push_back(b.m_pimpl);
-		if (Mode == EngMode::Bootstrap || UCFG_COIN_TXES_IN_BLOCKTABLE) {
+		if ((Mode == EngMode::Bootstrap || UCFG_COIN_TXES_IN_BLOCKTABLE) && !Db->HaveBlockUndo(h)) {		// blocks connected before the undo journal
 			EXT_FOR(const Tx& tx, b.get_Txes()) {
 				if (!tx->IsCoinBase()) {
 					EXT_FOR(const TxIn& txIn, tx.TxIns()) {
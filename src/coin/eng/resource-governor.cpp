@@ -0,0 +1,194 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#include "eng.h"
+
+namespace Coin {
+
+const char * const ResourceGovernor::CacheNames[GOVERNED_CACHES] = { "blocks", "txes", "pubkeys" };
+
+template <class F> static void WithGovernedCache(CoinEng& eng, int idx, F f) {
+	switch (idx) {
+	case GOVERNED_CACHE_BLOCKS: f(eng.Caches.HashToBlockCache); break;
+	case GOVERNED_CACHE_TXES: f(eng.Caches.HashToTxCache); break;
+	case GOVERNED_CACHE_PUBKEYS: f(eng.Caches.m_cachePkIdToPubKey); break;
+	}
+}
+
+ResourceGovernor::ResourceGovernor()
+	: m_workers(std::max(1U, thread::hardware_concurrency()))
+	, m_workersInUse(0)
+	, m_totalWeight(0)
+{
+}
+
+ResourceGovernor::Entry *ResourceGovernor::Find(CoinEng *eng) {
+	for (auto& e : m_entries)
+		if (e.Eng == eng)
+			return &e;
+	return nullptr;
+}
+
+void ResourceGovernor::Register(CoinEng& eng) {
+	Entry e = { &eng, true, GOVERNOR_WEIGHT_IBD, 0, 0, 0 };
+	for (int i = 0; i < GOVERNED_CACHES; ++i)
+		WithGovernedCache(eng, i, [&e, i](auto& cache) {
+			e.BaseCacheSize[i] = e.CacheBudget[i] = cache.MaxSize;		// the configured size is the engine's contribution to the common budget
+			e.PrevMisses[i] = cache.Stats.aMisses;
+		});
+	EXT_LOCK(m_mtx) {
+		if (!Find(&eng)) {
+			m_entries.push_back(e);
+			m_totalWeight += e.Weight;
+		}
+	}
+}
+
+void ResourceGovernor::Unregister(CoinEng& eng) {
+	EXT_LOCK(m_mtx) {
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+			if (it->Eng == &eng) {
+				m_totalWeight -= it->Weight;
+				m_workersInUse -= it->WorkersInUse;				// grants outstanding are released as not governed
+				for (int i = 0; i < GOVERNED_CACHES; ++i)
+					WithGovernedCache(eng, i, [&it, i](auto& cache) { cache.SetMaxSize(it->BaseCacheSize[i]); });
+				m_entries.erase(it);
+				break;
+			}
+		}
+	}
+}
+
+size_t ResourceGovernor::WorkersShare(const Entry& e) const {
+	return m_totalWeight ? std::max(size_t(1), m_workers * e.Weight / m_totalWeight) : m_workers;
+}
+
+size_t ResourceGovernor::AcquireWorkers(CoinEng& eng, size_t wanted) {
+	if (wanted <= 1)
+		return 1;
+	unique_lock<mutex> lk(m_mtx);
+	Entry *e = Find(&eng);
+	if (!e)
+		return std::min(wanted, m_workers);			// not started engines, e.g. tools, are not governed
+	size_t share = WorkersShare(*e),
+		own = share > e->WorkersInUse ? share - e->WorkersInUse : 0,
+		idle = m_workers > m_workersInUse ? m_workers - m_workersInUse : 0;
+	if (e->InitialDownload) {
+		for (auto& other : m_entries)		// unused shares of tip-following engines are not lent to engines in IBD
+			if (!other.InitialDownload) {
+				size_t shareOther = WorkersShare(other);
+				idle -= std::min(idle, shareOther > other.WorkersInUse ? shareOther - other.WorkersInUse : 0);
+			}
+	}
+	size_t n = std::min(wanted - 1, std::max(own, idle));
+	e->WorkersInUse += n;
+	e->WorkersGranted += n;
+	e->WorkersBorrowed += n > own ? n - own : 0;
+	m_workersInUse += n;
+	return n + 1;
+}
+
+void ResourceGovernor::ReleaseWorkers(CoinEng& eng, size_t n) {
+	if (!n)
+		return;
+	EXT_LOCK(m_mtx) {
+		if (Entry *e = Find(&eng)) {
+			n = std::min(n, e->WorkersInUse);				// the engine may have been registered after the grant
+			e->WorkersInUse -= n;
+			m_workersInUse -= n;
+		}
+	}
+}
+
+// Engines which had no misses since the previous pass give their unused entries to the others, proportionally to weights
+void ResourceGovernor::RebalanceCache(int idx) {
+	size_t total = 0, spare = 0;
+	int busyWeight = 0;
+	vector<pair<size_t, bool>> sizeIdle(m_entries.size());
+	for (size_t j = 0; j < m_entries.size(); ++j) {
+		Entry& e = m_entries[j];
+		total += e.BaseCacheSize[idx];
+		WithGovernedCache(*e.Eng, idx, [&e, &sizeIdle, idx, j](auto& cache) {
+			uint64_t misses = cache.Stats.aMisses;
+			sizeIdle[j] = make_pair(cache.size(), misses == e.PrevMisses[idx]);
+			e.PrevMisses[idx] = misses;
+		});
+		if (!sizeIdle[j].second)
+			busyWeight += e.Weight;
+	}
+	for (size_t j = 0; j < m_entries.size(); ++j) {
+		Entry& e = m_entries[j];
+		size_t share = total * e.Weight / m_totalWeight;
+		if (sizeIdle[j].second && busyWeight) {
+			e.CacheBudget[idx] = std::max(std::min(sizeIdle[j].first, share), e.BaseCacheSize[idx] / 8);		// keeps a small floor to restart quickly
+			spare += share > e.CacheBudget[idx] ? share - e.CacheBudget[idx] : 0;
+		} else
+			e.CacheBudget[idx] = share;
+	}
+	for (size_t j = 0; j < m_entries.size(); ++j) {
+		Entry& e = m_entries[j];
+		if (!sizeIdle[j].second && busyWeight)
+			e.CacheBudget[idx] += spare * e.Weight / busyWeight;
+		size_t budget = e.CacheBudget[idx];
+		WithGovernedCache(*e.Eng, idx, [budget](auto& cache) { cache.SetMaxSize(budget); });
+	}
+}
+
+void ResourceGovernor::Rebalance() {
+	vector<CoinEng*> engs;
+	EXT_LOCK(m_mtx) {
+		for (auto& e : m_entries)
+			engs.push_back(e.Eng);
+	}
+	vector<bool> ibd;
+	for (auto eng : engs) {			// locks of the engine are not taken under m_mtx
+		CCoinEngThreadKeeper engKeeper(eng);
+		ibd.push_back(eng->IsInitialBlockDownload());
+	}
+
+	EXT_LOCK(m_mtx) {
+		m_totalWeight = 0;
+		for (size_t j = 0; j < engs.size(); ++j) {
+			if (Entry *e = Find(engs[j])) {
+				e->InitialDownload = ibd[j];
+				e->Weight = ibd[j] ? GOVERNOR_WEIGHT_IBD : GOVERNOR_WEIGHT_TIP;
+			}
+		}
+		for (auto& e : m_entries)
+			m_totalWeight += e.Weight;
+		if (m_totalWeight)
+			for (int i = 0; i < GOVERNED_CACHES; ++i)
+				RebalanceCache(i);
+	}
+}
+
+vector<EngineResourceUsage> ResourceGovernor::Usage() {
+	vector<EngineResourceUsage> r;
+	EXT_LOCK(m_mtx) {
+		for (auto& e : m_entries) {
+			EngineResourceUsage u = { e.Eng->ChainParams.Name, e.InitialDownload, e.Weight, WorkersShare(e), e.WorkersInUse, e.WorkersGranted, e.WorkersBorrowed };
+			for (int i = 0; i < GOVERNED_CACHES; ++i) {
+				u.CacheBudget[i] = e.CacheBudget[i];
+				WithGovernedCache(*e.Eng, i, [&u, i](auto& cache) { u.CacheSize[i] = cache.size(); });
+			}
+			r.push_back(u);
+		}
+	}
+	return r;
+}
+
+WorkerGrant::WorkerGrant(CoinEng& eng, size_t wanted)
+	: m_eng(eng)
+	, m_n(eng.m_cdb.Governor.AcquireWorkers(eng, wanted))
+{
+}
+
+WorkerGrant::~WorkerGrant() {
+	m_eng.m_cdb.Governor.ReleaseWorkers(m_eng, m_n - 1);
+}
+
+} // Coin::
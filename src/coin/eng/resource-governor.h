@@ -0,0 +1,83 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Budgets shared by all running engines of one CoinDb: worker threads of parallel batches and entries of the LRU caches.
+// Engines get shares by weight, tip-following engines weigh more than those in initial block download.
+// An engine may borrow capacity which the others don't use
+
+#pragma once
+
+namespace Coin {
+
+class CoinEng;
+
+const int GOVERNOR_WEIGHT_TIP = 4,
+	GOVERNOR_WEIGHT_IBD = 1;
+
+enum GovernedCache {
+	GOVERNED_CACHE_BLOCKS,
+	GOVERNED_CACHE_TXES,
+	GOVERNED_CACHE_PUBKEYS,
+	GOVERNED_CACHES
+};
+
+struct EngineResourceUsage {
+	String Name;
+	bool InitialDownload;
+	int Weight;
+	size_t WorkersShare, WorkersInUse;			// threads besides the calling one
+	uint64_t WorkersGranted, WorkersBorrowed;	// cumulative, Borrowed are granted above the share
+	size_t CacheBudget[GOVERNED_CACHES], CacheSize[GOVERNED_CACHES];		// entries
+};
+
+class ResourceGovernor : noncopyable {
+public:
+	static const char * const CacheNames[GOVERNED_CACHES];
+
+	ResourceGovernor();
+	void Register(CoinEng& eng);				// under NetManager::MtxNets
+	void Unregister(CoinEng& eng);				// under NetManager::MtxNets
+	void Rebalance();							// periodically, under NetManager::MtxNets
+
+	size_t AcquireWorkers(CoinEng& eng, size_t wanted);		// >= 1, the calling thread is always granted
+	void ReleaseWorkers(CoinEng& eng, size_t n);
+
+	size_t get_Workers() const { return m_workers; }
+	DEFPROP_GET(size_t, Workers);
+
+	vector<EngineResourceUsage> Usage();
+private:
+	struct Entry {
+		CoinEng *Eng;
+		bool InitialDownload;
+		int Weight;
+		size_t WorkersInUse;
+		uint64_t WorkersGranted, WorkersBorrowed;
+		size_t BaseCacheSize[GOVERNED_CACHES], CacheBudget[GOVERNED_CACHES];
+		uint64_t PrevMisses[GOVERNED_CACHES];
+	};
+
+	mutex m_mtx;
+	vector<Entry> m_entries;
+	const size_t m_workers;
+	size_t m_workersInUse;
+	int m_totalWeight;
+
+	Entry *Find(CoinEng *eng);
+	size_t WorkersShare(const Entry& e) const;
+	void RebalanceCache(int idx);
+};
+
+// Extra threads for a parallel batch, returned to the governor in the destructor
+class WorkerGrant : noncopyable {
+	CoinEng& m_eng;
+	size_t m_n;
+public:
+	WorkerGrant(CoinEng& eng, size_t wanted);
+	~WorkerGrant();
+	size_t size() const { return m_n; }
+};
+
+} // Coin::
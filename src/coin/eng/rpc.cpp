@@ -9,6 +9,10 @@
 #include "wallet.h"
 #include "coin-rpc.h"
 
+#if UCFG_COIN_COINCHAIN_BACKEND == COIN_BACKEND_DBLITE
+#	include "backend-dblite.h"
+#endif
+
 namespace Coin {
 
 Rpc::CMap Rpc::s_map;
@@ -34,16 +38,190 @@ void Rpc::Register(RCString name, Rpc::MF1 mf) {
 	s_map.insert(make_pair(name.ToLower(), memfun));
 }
 
+void Rpc::Register(RCString name, Rpc::MF2 mf) {
+	MemFun memfun;
+	memfun.MF2 = mf;
+	memfun.Sig = FunSig::Arg2;
+	s_map.insert(make_pair(name.ToLower(), memfun));
+}
+
+void Rpc::RegisterMany(RCString name, Rpc::MFN mf) {
+	MemFun memfun;
+	memfun.MFN = mf;
+	memfun.Sig = FunSig::Many;
+	s_map.insert(make_pair(name.ToLower(), memfun));
+}
+
 #define COIN_RPC_REGISTER(fun) Rpc::Register(#fun, &Rpc::fun)
+#define COIN_RPC_REGISTER_MANY(fun) Rpc::RegisterMany(#fun, &Rpc::fun)
 
 bool Rpc::RegisterRpcHandlers() {
 	COIN_RPC_REGISTER(GetBlockchainInfo);
 	COIN_RPC_REGISTER(GetBlockHash);
+	COIN_RPC_REGISTER(GetNetStats);
+	COIN_RPC_REGISTER(GetResourceUsage);
+	COIN_RPC_REGISTER_MANY(GetBlock);
+	COIN_RPC_REGISTER_MANY(GetBlockHeader);
+	COIN_RPC_REGISTER_MANY(GetRawTransaction);
+	COIN_RPC_REGISTER_MANY(GetTxOut);
+	COIN_RPC_REGISTER_MANY(GetRawMempool);
+	COIN_RPC_REGISTER_MANY(EstimateSmartFee);
+	COIN_RPC_REGISTER_MANY(GetBlockTemplate);
+	COIN_RPC_REGISTER(GetAddressTxIds);
+	COIN_RPC_REGISTER(GetAddressUtxos);
+	COIN_RPC_REGISTER(GetAddressBalance);
 	return true;
 }
 
 static bool s_bRegisteredRpcHandlers = Rpc::RegisterRpcHandlers();
 
+// All reads of one call see the same DB snapshot and don't wait for MtxDb. Methods called in it must not write the chain DB
+class RpcReadScope : noncopyable {
+#if UCFG_COIN_COINCHAIN_BACKEND == COIN_BACKEND_DBLITE
+	DbReadTxRef m_dbt;
+public:
+	RpcReadScope(CoinEng& eng)
+		: m_dbt(*(DbStorage*)eng.Db->GetDbObject())
+	{}
+#else
+public:
+	RpcReadScope(CoinEng& eng) {}
+#endif
+};
+
+// These methods take CoinEng::Mtx or TxPool::Mtx, which Block::Connect() holds while writing the DB, so a read transaction must not be open around them.
+// They open RpcReadScope themselves after the locked part
+static bool ReadsSnapshot(RCString name) {
+	static const unordered_set<String> s_lockingMethods = { "getblocktemplate", "getrawtransaction", "gettxout", "getrawmempool" };
+	return !s_lockingMethods.count(name);
+}
+
+static VarValue OptionalParam(const VarValue& params, size_t i) {
+	return params.type() == VarType::Array && i < params.size() ? params[i] : VarValue();
+}
+
+static HashValue HashParam(const VarValue& params, size_t i) {
+	VarValue v = OptionalParam(params, i);
+	if (v.type() != VarType::String)
+		Throw(CoinErr::RPC_INVALID_PARAMETER);
+	return HashValue(v.ToString());
+}
+
+static String ToHex(RCSpan s) {
+	return EXT_STR(Blob(s));
+}
+
+template <class T> static String SerializedHex(const T& ob) {
+	MemoryStream ms;
+	ProtocolWriter wr(ms);
+	ob.Write(wr);
+	return ToHex(ms.AsSpan());
+}
+
+static double ToCoins(CoinEng& eng, int64_t v) {
+	return double(v) / eng.ChainParams.CoinValue;
+}
+
+static const char *ScriptTypeName(AddressType typ) {
+	switch (typ) {
+	case AddressType::P2PKH: return "pubkeyhash";
+	case AddressType::P2SH: return "scripthash";
+	case AddressType::PubKey: return "pubkey";
+	case AddressType::MultiSig: return "multisig";
+	case AddressType::NullData: return "nulldata";
+	case AddressType::WitnessV0ScriptHash: return "witness_v0_scripthash";
+	case AddressType::WitnessV0KeyHash: return "witness_v0_keyhash";
+	case AddressType::WitnessUnknown: return "witness_unknown";
+	default: return "nonstandard";
+	}
+}
+
+static VarValue ScriptPubKeyToJson(RCSpan script) {
+	VarValue r;
+	r.Set("hex", ToHex(script));
+	Address a = TxOut::CheckStandardType(script);
+	r.Set("type", ScriptTypeName(a.Type));
+	switch (a.Type) {
+	case AddressType::P2PKH:
+	case AddressType::P2SH:
+	case AddressType::WitnessV0ScriptHash:
+	case AddressType::WitnessV0KeyHash:
+	case AddressType::WitnessUnknown:
+		r.Set("address", a.ToString());
+		break;
+	}
+	return r;
+}
+
+static VarValue TxToJson(CoinEng& eng, const Tx& tx) {
+	VarValue r, vin, vout;
+	r.Set("txid", Hash(tx).ToString());
+	r.Set("hash", eng.WitnessHashFromTx(tx).ToString());
+	r.Set("version", int64_t(tx->Ver));
+	r.Set("size", int64_t(tx.GetSerializeSize(true)));
+	r.Set("vsize", int64_t((tx.Weight + 3) / 4));
+	r.Set("weight", int64_t(tx.Weight));
+	r.Set("locktime", int64_t(tx.LockBlock));
+	int n = 0;
+	for (auto& txIn : tx.TxIns()) {
+		VarValue v;
+		if (tx->IsCoinBase())
+			v.Set("coinbase", ToHex(txIn.Script()));
+		else {
+			VarValue scriptSig;
+			scriptSig.Set("hex", ToHex(txIn.Script()));
+			v.Set("txid", txIn.PrevOutPoint.TxHash.ToString());
+			v.Set("vout", int64_t(txIn.PrevOutPoint.Index));
+			v.Set("scriptSig", scriptSig);
+		}
+		if (!txIn.Witness.empty()) {
+			VarValue witness;
+			for (size_t i = 0; i < txIn.Witness.size(); ++i)
+				witness.Set(i, ToHex(Span(txIn.Witness[i].data(), txIn.Witness[i].size())));
+			v.Set("txinwitness", witness);
+		}
+		v.Set("sequence", int64_t(txIn.Sequence));
+		vin.Set(n++, v);
+	}
+	n = 0;
+	for (auto& txOut : tx.TxOuts()) {
+		VarValue v;
+		v.Set("value", ToCoins(eng, txOut.Value));
+		v.Set("n", n);
+		v.Set("scriptPubKey", ScriptPubKeyToJson(txOut.get_ScriptPubKey()));
+		vout.Set(n++, v);
+	}
+	r.Set("vin", vin);
+	r.Set("vout", vout);
+	r.Set("hex", SerializedHex(tx));
+	return r;
+}
+
+static int Confirmations(CoinEng& eng, const BlockHeader& header) {
+	return header.IsInTrunk() && header.Height <= eng.BestBlockHeight() ? eng.BestBlockHeight() - header.Height + 1 : -1;
+}
+
+static VarValue HeaderToJson(CoinEng& eng, const BlockHeader& header) {
+	VarValue r;
+	int confirmations = Confirmations(eng, header);
+	r.Set("hash", Hash(header).ToString());
+	r.Set("confirmations", confirmations);
+	r.Set("height", header.Height);
+	r.Set("version", int64_t(header->Ver));
+	r.Set("merkleroot", header.MerkleRoot.ToString());
+	r.Set("time", int64_t(to_time_t(header.Timestamp)));
+	r.Set("mediantime", int64_t(to_time_t(header.GetMedianTimePast())));
+	r.Set("nonce", int64_t(header->Nonce));
+	r.Set("bits", EXT_STR(hex << setw(8) << setfill('0') << header->DifficultyTargetBits));
+	r.Set("difficulty", eng.ToDifficulty(header->get_DifficultyTarget()));
+	if (header.Height > 0)
+		r.Set("previousblockhash", header.PrevBlockHash.ToString());
+	if (confirmations > 1)
+		if (BlockHeader next = eng.Db->FindHeader(header.Height + 1))
+			r.Set("nextblockhash", Hash(next).ToString());
+	return r;
+}
+
 
 VarValue Rpc::GetBlockchainInfo() {
 	VarValue r;
@@ -61,8 +239,408 @@ VarValue Rpc::GetBlockHash(const VarValue& varHeight) {
 	return Hash(Eng->GetBlockByHeight((uint32_t)height)).ToString();
 }
 
+// { command: { "recv", "sent", "bytesrecv", "bytessent", "deserialize_us", "process_us", "lockwait_us", "process_hist": [count per log2(us) bucket] } }
+VarValue Rpc::GetNetStats() {
+	VarValue r;
+	for (auto& kv : Eng->NetStats.Snapshot()) {
+		const MessageStatsSnapshot& s = kv.second;
+		VarValue v, hist;
+		v.Set("recv", int64_t(s.Received));
+		v.Set("sent", int64_t(s.Sent));
+		v.Set("bytesrecv", int64_t(s.BytesIn));
+		v.Set("bytessent", int64_t(s.BytesOut));
+		v.Set("deserialize_us", int64_t(s.DeserializeUs));
+		v.Set("process_us", int64_t(s.ProcessUs));
+		v.Set("lockwait_us", int64_t(s.LockWaitUs));
+		for (int i = 0; i < NETSTATS_HIST_BUCKETS; ++i)
+			hist.Set(i, int64_t(s.ProcessHist[i]));
+		v.Set("process_hist", hist);
+		r.Set(kv.first, v);
+	}
+	return r;
+}
+
+VarValue Rpc::GetResourceUsage() {
+	ResourceGovernor& governor = Eng->m_cdb.Governor;
+	VarValue r, engs;
+	r.Set("workers", int64_t(governor.Workers));
+	for (auto& u : governor.Usage()) {
+		VarValue v, caches;
+		v.Set("initialblockdownload", u.InitialDownload);
+		v.Set("weight", u.Weight);
+		v.Set("workers_share", int64_t(u.WorkersShare));
+		v.Set("workers_in_use", int64_t(u.WorkersInUse));
+		v.Set("workers_granted", int64_t(u.WorkersGranted));
+		v.Set("workers_borrowed", int64_t(u.WorkersBorrowed));
+		for (int i = 0; i < GOVERNED_CACHES; ++i) {
+			VarValue c;
+			c.Set("budget", int64_t(u.CacheBudget[i]));
+			c.Set("size", int64_t(u.CacheSize[i]));
+			caches.Set(ResourceGovernor::CacheNames[i], c);
+		}
+		v.Set("caches", caches);
+		engs.Set(u.Name, v);
+	}
+	r.Set("chains", engs);
+	return r;
+}
+
+const size_t DEFAULT_ADDRESS_QUERY_LIMIT = 1000,
+	ADDRESS_INDEX_READ_BATCH = 256;
+
+// Query is an address string, array of addresses or { "addresses": [...], "start": height, "end": height, "limit": n, "cursor": c }
+// Cursor is returned when the result is truncated by the limit and continues from the next entry in the same query.
+struct AddressQuery {
+	vector<String> Addresses;
+	vector<HashValue> ScriptHashes;
+	int HeightStart, HeightEnd;
+	size_t Limit;
+	size_t CursorAddress;
+	uint32_t CursorOrdinal;
+};
+
+static AddressQuery ParseAddressQuery(CoinEng& eng, const VarValue& v) {
+	if (eng.Mode != EngMode::BlockExplorer)
+		Throw(CoinErr::RPC_MISC_ERROR);				// address index is maintained only in BlockExplorer mode
+	AddressQuery q = { vector<String>(), vector<HashValue>(), 0, INT_MAX, DEFAULT_ADDRESS_QUERY_LIMIT, 0, 0 };
+	VarValue vAddresses = v;
+	if (v.type() == VarType::Map) {
+		vAddresses = v["addresses"];
+		if (v.HasKey("start"))
+			q.HeightStart = (int)v["start"].ToInt64();
+		if (v.HasKey("end"))
+			q.HeightEnd = (int)v["end"].ToInt64();
+		if (v.HasKey("limit")) {
+			int64_t limit = v["limit"].ToInt64();
+			if (limit <= 0)
+				Throw(CoinErr::RPC_INVALID_PARAMETER);
+			q.Limit = (size_t)limit;
+		}
+		if (v.HasKey("cursor")) {
+			int64_t cursor = v["cursor"].ToInt64();
+			q.CursorAddress = size_t(uint64_t(cursor) >> 32);
+			q.CursorOrdinal = uint32_t(cursor);
+		}
+	}
+	if (vAddresses.type() == VarType::String)
+		q.Addresses.push_back(vAddresses.ToString());
+	else {
+		for (size_t i = 0; i < vAddresses.size(); ++i)
+			q.Addresses.push_back(vAddresses[i].ToString());
+	}
+	if (q.Addresses.empty() || q.HeightStart > q.HeightEnd)
+		Throw(CoinErr::RPC_INVALID_PARAMETER);
+	for (auto& s : q.Addresses)
+		q.ScriptHashes.push_back(AddressIndexScriptHash(Address(eng, s)->ToScriptPubKey()));
+	return q;
+}
+
+// Visits entries of the query in (address, height) order while onEntry() returns true. Returns the cursor of the first unvisited entry
+template <class F>
+static optional<int64_t> ScanAddressIndex(IBlockChainDb& db, const AddressQuery& q, F onEntry) {
+	for (size_t i = q.CursorAddress; i < q.ScriptHashes.size(); ++i) {
+		const HashValue& scriptHash = q.ScriptHashes[i];
+		uint32_t ordinal = i == q.CursorAddress && q.CursorOrdinal ? q.CursorOrdinal : db.FindAddressIndexOrdinal(scriptHash, q.HeightStart);
+		for (vector<AddressIndexEntry> entries; !(entries = db.ReadAddressIndex(scriptHash, ordinal, ADDRESS_INDEX_READ_BATCH)).empty();) {
+			for (auto& e : entries) {
+				if (e.Height > q.HeightEnd)
+					goto LAB_NEXT_ADDRESS;
+				if (!onEntry(i, e))
+					return int64_t(uint64_t(i) << 32 | ordinal);
+				++ordinal;
+			}
+		}
+LAB_NEXT_ADDRESS:
+		;
+	}
+	return nullopt;
+}
+
+VarValue Rpc::GetAddressTxIds(const VarValue& query) {
+	AddressQuery q = ParseAddressQuery(*Eng, query);
+	VarValue txids;
+	int n = 0;
+	unordered_set<HashValue> seen;
+	optional<int64_t> cursor = ScanAddressIndex(*Eng->Db, q, [&](size_t idxAddress, const AddressIndexEntry& e) {
+		if (seen.count(e.HashTx))
+			return true;
+		if (size_t(n) == q.Limit)							// page ends on the Tx boundary
+			return false;
+		seen.insert(e.HashTx);
+		txids.Set(n++, e.HashTx.ToString());
+		return true;
+	});
+	VarValue r;
+	r.Set("txids", txids);
+	if (cursor)
+		r.Set("cursor", cursor.value());
+	return r;
+}
+
+VarValue Rpc::GetAddressUtxos(const VarValue& query) {
+	AddressQuery q = ParseAddressQuery(*Eng, query);
+	VarValue utxos;
+	int n = 0;
+	optional<int64_t> cursor = ScanAddressIndex(*Eng->Db, q, [&](size_t idxAddress, const AddressIndexEntry& e) {
+		if (e.IsInput || e.SpentHeight >= 0)
+			return true;
+		if (size_t(n) == q.Limit)
+			return false;
+		VarValue u;
+		u.Set("address", q.Addresses[idxAddress]);
+		u.Set("txid", e.HashTx.ToString());
+		u.Set("outputIndex", int64_t(e.Index));
+		u.Set("satoshis", e.Value);
+		u.Set("height", e.Height);
+		utxos.Set(n++, u);
+		return true;
+	});
+	VarValue r;
+	r.Set("utxos", utxos);
+	if (cursor)
+		r.Set("cursor", cursor.value());
+	return r;
+}
+
+// Totals of the whole history are kept by the index, only height ranges and scripts indexed before the totals are scanned
+VarValue Rpc::GetAddressBalance(const VarValue& query) {
+	AddressQuery q = ParseAddressQuery(*Eng, query);
+	int64_t balance = 0, received = 0;
+	bool bWholeHistory = q.HeightStart <= 0 && q.HeightEnd == INT_MAX;
+	AddressQuery qScan = q;
+	qScan.ScriptHashes.clear();
+	qScan.CursorAddress = qScan.CursorOrdinal = 0;
+	for (auto& scriptHash : q.ScriptHashes) {
+		optional<AddressIndexTotals> totals = bWholeHistory ? Eng->Db->GetAddressIndexTotals(scriptHash) : nullopt;
+		if (totals) {
+			balance += totals->Balance;
+			received += totals->Received;
+		} else
+			qScan.ScriptHashes.push_back(scriptHash);
+	}
+	ScanAddressIndex(*Eng->Db, qScan, [&](size_t idxAddress, const AddressIndexEntry& e) {
+		if (!e.IsInput) {
+			received += e.Value;
+			if (e.SpentHeight < 0)
+				balance += e.Value;
+		}
+		return true;
+	});
+	VarValue r;
+	r.Set("balance", balance);
+	r.Set("received", received);
+	return r;
+}
+
+// [hash, verbosity = 1]: 0 - serialized hex, 1 - header and txids, 2 - header and decoded txes
+VarValue Rpc::GetBlock(const VarValue& params) {
+	HashValue hash = HashParam(params, 0);
+	VarValue vVerbosity = OptionalParam(params, 1);
+	int verbosity = vVerbosity.type() == VarType::Null ? 1
+		: vVerbosity.type() == VarType::Bool ? int(vVerbosity.ToBool())
+		: int(vVerbosity.ToInt64());
+	Block block = Eng->LookupBlock(hash);
+	if (!block || block.IsHeaderOnly())
+		Throw(CoinErr::RPC_INVALID_ADDRESS_OR_KEY);
+	if (verbosity <= 0)
+		return SerializedHex(block);
+	VarValue r = HeaderToJson(*Eng, block), txes;
+	const CTxes& blockTxes = block.Txes;
+	r.Set("size", int64_t(block.GetSerializeSize(true)));
+	r.Set("strippedsize", int64_t(block.GetSerializeSize(false)));
+	r.Set("nTx", int64_t(blockTxes.size()));
+	for (size_t i = 0; i < blockTxes.size(); ++i)
+		txes.Set(i, verbosity == 1 ? VarValue(Hash(blockTxes[i]).ToString()) : TxToJson(*Eng, blockTxes[i]));
+	r.Set("tx", txes);
+	return r;
+}
+
+// [hash, verbose = true]
+VarValue Rpc::GetBlockHeader(const VarValue& params) {
+	HashValue hash = HashParam(params, 0);
+	VarValue vVerbose = OptionalParam(params, 1);
+	BlockHeader header = Eng->FindHeader(hash);
+	if (!header)
+		Throw(CoinErr::RPC_INVALID_ADDRESS_OR_KEY);
+	if (vVerbose.type() != VarType::Null && !vVerbose.ToBool()) {
+		MemoryStream ms;
+		ProtocolWriter wr(ms);
+		header.WriteHeader(wr);
+		return ToHex(ms.AsSpan());
+	}
+	return HeaderToJson(*Eng, header);
+}
+
+// [txid, verbose = false], the pool is searched first
+VarValue Rpc::GetRawTransaction(const VarValue& params) {
+	HashValue hash = HashParam(params, 0);
+	VarValue vVerbose = OptionalParam(params, 1);
+	Tx tx;
+	bool bInPool = false;
+	EXT_LOCK (Eng->TxPool.Mtx) {
+		auto it = Eng->TxPool.m_hashToTxInfo.find(hash);
+		if (bInPool = it != Eng->TxPool.m_hashToTxInfo.end())
+			tx = it->second.Tx;
+	}
+	RpcReadScope readScope(*Eng);
+	if (!bInPool && !Tx::TryFromDb(hash, &tx))
+		Throw(CoinErr::RPC_INVALID_ADDRESS_OR_KEY);
+	if (vVerbose.type() == VarType::Null || !vVerbose.ToBool())
+		return SerializedHex(tx);
+	VarValue r = TxToJson(*Eng, tx);
+	if (!bInPool) {
+		BlockHeader header = Eng->Db->FindHeader(tx.Height);
+		r.Set("blockhash", Hash(header).ToString());
+		r.Set("confirmations", Eng->BestBlockHeight() - tx.Height + 1);
+		r.Set("time", int64_t(to_time_t(header.Timestamp)));
+		r.Set("blocktime", int64_t(to_time_t(header.Timestamp)));
+	}
+	return r;
+}
+
+// [txid, n, include_mempool = true], null if the output is spent or doesn't exist
+VarValue Rpc::GetTxOut(const VarValue& params) {
+	HashValue hash = HashParam(params, 0);
+	VarValue vN = OptionalParam(params, 1), vIncludeMempool = OptionalParam(params, 2);
+	if (vN.type() == VarType::Null)
+		Throw(CoinErr::RPC_INVALID_PARAMETER);
+	int64_t n = vN.ToInt64();
+	bool bIncludeMempool = vIncludeMempool.type() == VarType::Null || vIncludeMempool.ToBool();
+	Tx tx;
+	bool bInPool = false;
+	if (bIncludeMempool) {
+		EXT_LOCK (Eng->TxPool.Mtx) {
+			if (Eng->TxPool.m_outPointToNextTx.count(OutPoint(hash, int32_t(n))))
+				return VarValue();
+			auto it = Eng->TxPool.m_hashToTxInfo.find(hash);
+			if (bInPool = it != Eng->TxPool.m_hashToTxInfo.end())
+				tx = it->second.Tx;
+		}
+	}
+	RpcReadScope readScope(*Eng);
+	if (!bInPool) {
+		if (!Tx::TryFromDb(hash, &tx))
+			return VarValue();
+		vector<bool> unspent = Eng->Db->GetCoinsByTxHash(hash);
+		if (n < 0 || size_t(n) >= unspent.size() || !unspent[n])
+			return VarValue();
+	}
+	if (n < 0 || size_t(n) >= tx.TxOuts().size())
+		return VarValue();
+	const TxOut& txOut = tx.TxOuts()[n];
+	VarValue r;
+	r.Set("bestblock", Hash(Eng->BestBlock()).ToString());
+	r.Set("confirmations", bInPool ? 0 : Eng->BestBlockHeight() - tx.Height + 1);
+	r.Set("value", ToCoins(*Eng, txOut.Value));
+	r.Set("scriptPubKey", ScriptPubKeyToJson(txOut.get_ScriptPubKey()));
+	r.Set("coinbase", tx->IsCoinBase());
+	return r;
+}
+
+// [verbose = false]: array of txids or { txid: { "vsize", "weight", "fee", "feerate" } }
+VarValue Rpc::GetRawMempool(const VarValue& params) {
+	VarValue vVerbose = OptionalParam(params, 0);
+	bool bVerbose = vVerbose.type() != VarType::Null && vVerbose.ToBool();
+	vector<TxInfo> txInfos;
+	EXT_LOCK (Eng->TxPool.Mtx) {
+		txInfos.reserve(Eng->TxPool.m_hashToTxInfo.size());
+		for (auto& kv : Eng->TxPool.m_hashToTxInfo)
+			txInfos.push_back(kv.second);
+	}
+	RpcReadScope readScope(*Eng);
+	VarValue r;
+	int n = 0;
+	for (auto& txInfo : txInfos) {						// serialization of the pool is done out of its lock
+		String txid = Hash(txInfo.Tx).ToString();
+		if (!bVerbose)
+			r.Set(n++, txid);
+		else {
+			VarValue v;
+			v.Set("vsize", int64_t((txInfo.Tx.Weight + 3) / 4));
+			v.Set("weight", int64_t(txInfo.Tx.Weight));
+			v.Set("fee", ToCoins(*Eng, txInfo.Tx.Fee));
+			v.Set("feerate", ToCoins(*Eng, int64_t(txInfo.FeeRatePerKB)));
+			r.Set(txid, v);
+		}
+	}
+	return r;
+}
+
+// [conf_target]: { "feerate": coins per kB, "blocks" }, "blocks" may exceed conf_target when it has not enough data
+VarValue Rpc::EstimateSmartFee(const VarValue& params) {
+	VarValue vTarget = OptionalParam(params, 0);
+	if (vTarget.type() == VarType::Null || vTarget.ToInt64() < 1 || vTarget.ToInt64() > FEE_ESTIMATE_MAX_TARGET)
+		Throw(CoinErr::RPC_INVALID_PARAMETER);
+	VarValue r;
+	int blocks;
+	if (optional<int64_t> feeRate = Eng->FeeEstimator.EstimateSmart((int)vTarget.ToInt64(), blocks))
+		r.Set("feerate", ToCoins(*Eng, std::max(feeRate.value(), g_conf.MinRelayTxFee)));
+	else {
+		VarValue errors;
+		errors.Set(0, "Insufficient data or no feerate found");
+		r.Set("errors", errors);
+	}
+	r.Set("blocks", blocks);
+	return r;
+}
+
+// [template_request], BIP22 subset; the coinbase pays to the key of the wallet of this chain
+VarValue Rpc::GetBlockTemplate(const VarValue& params) {
+	if (Eng->IsInitialBlockDownload())
+		Throw(CoinErr::RPC_CLIENT_IN_INITIAL_DOWNLOAD);
+	Coin::Wallet *wallet = nullptr;
+	for (auto& w : WalletEng.Wallets)
+		if (&w->Eng == Eng) {
+			wallet = w.get();
+			break;
+		}
+	if (!wallet)
+		Throw(CoinErr::RPC_WALLET_ERROR);
+	Block block = wallet->CreateNewBlock();
+	if (!block)
+		Throw(CoinErr::RPC_CLIENT_IN_INITIAL_DOWNLOAD);
+	RpcReadScope readScope(*Eng);
+	const CTxes& blockTxes = block.Txes;
+	VarValue r, txes;
+	r.Set("version", int64_t(block->Ver));
+	r.Set("previousblockhash", block.PrevBlockHash.ToString());
+	r.Set("height", block.Height);
+	r.Set("curtime", int64_t(to_time_t(block.Timestamp)));
+	r.Set("mintime", int64_t(to_time_t(Eng->BestBlock().GetMedianTimePast())) + 1);
+	r.Set("bits", EXT_STR(hex << setw(8) << setfill('0') << block->DifficultyTargetBits));
+	r.Set("target", HashValue::FromDifficultyBits(block->DifficultyTargetBits).ToString());
+	r.Set("coinbasevalue", blockTxes[0].TxOuts()[0].Value);
+	for (size_t i = 1; i < blockTxes.size(); ++i) {
+		const Tx& tx = blockTxes[i];
+		VarValue v;
+		v.Set("data", SerializedHex(tx));
+		v.Set("txid", Hash(tx).ToString());
+		v.Set("hash", Eng->WitnessHashFromTx(tx).ToString());
+		v.Set("weight", int64_t(tx.Weight));
+		txes.Set(i - 1, v);
+	}
+	r.Set("transactions", txes);
+
+	const Coin::ChainParams& cp = Eng->ChainParams;
+	bool bSegwit = cp.SegwitHeight > 0 && block.Height >= cp.SegwitHeight;		// SegwitHeight is 0 in chains without SegWit
+	VarValue rules;
+	int nRules = 0;
+	if (block.Height >= cp.BIP68Height)
+		rules.Set(nRules++, "csv");
+	if (bSegwit) {
+		rules.Set(nRules++, "segwit");
+		r.Set("default_witness_commitment", ToHex(block.DefaultWitnessCommitmentScript()));
+	}
+	r.Set("rules", rules);
+	return r;
+}
+
 VarValue Rpc::CallMethod(RCString name, const VarValue& params) {
 	MemFun memFun = s_map.at(name);
+	CCoinEngThreadKeeper engKeeper(Eng);
+	optional<RpcReadScope> readScope;
+	if (ReadsSnapshot(name))
+		readScope.emplace(*Eng);
 	switch (memFun.Sig) {
 	case FunSig::Void:
 		return (this->*memFun.MF0)();
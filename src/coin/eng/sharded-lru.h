@@ -0,0 +1,120 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// LRU cache split into independently locked shards, so that P2P threads and the block connecting thread don't serialize on one mutex.
+// Recency is tracked per shard, the size limit is divided evenly between shards
+
+#pragma once
+
+namespace Coin {
+
+struct CacheStats {
+	atomic<uint64_t> aHits, aMisses, aEvictions;
+
+	CacheStats()
+		: aHits(0)
+		, aMisses(0)
+		, aEvictions(0)
+	{}
+};
+
+template <class K, class V>
+class ShardedLruCache : noncopyable {
+	static const int SHARD_BITS = 4, SHARDS = 1 << SHARD_BITS;
+
+	struct Shard {
+		mutable mutex Mtx;
+		typedef list<pair<K, V>> CList;
+		CList Lru;								// most recently used first
+		unordered_map<K, typename CList::iterator> Map;
+	};
+
+	Shard m_shards[SHARDS];
+	atomic<size_t> m_aMaxPerShard;
+public:
+	CacheStats Stats;
+
+	explicit ShardedLruCache(size_t maxSize)
+		: m_aMaxPerShard(PerShard(maxSize))
+	{}
+
+	size_t get_MaxSize() const { return m_aMaxPerShard * SHARDS; }
+	DEFPROP_GET(size_t, MaxSize);
+	void SetMaxSize(size_t maxSize) { m_aMaxPerShard = PerShard(maxSize); }
+
+	size_t size() const {
+		size_t r = 0;
+		for (auto& shard : m_shards)
+			r += EXT_LOCKED(shard.Mtx, shard.Map.size());
+		return r;
+	}
+
+	optional<V> Lookup(const K& key) {
+		Shard& shard = ShardOf(key);
+		EXT_LOCK(shard.Mtx) {
+			auto it = shard.Map.find(key);
+			if (it != shard.Map.end()) {
+				shard.Lru.splice(shard.Lru.begin(), shard.Lru, it->second);
+				++Stats.aHits;
+				return it->second->second;
+			}
+		}
+		++Stats.aMisses;
+		return nullopt;
+	}
+
+	bool Contains(const K& key) {			// doesn't touch recency and counters
+		Shard& shard = ShardOf(key);
+		return EXT_LOCKED(shard.Mtx, shard.Map.count(key));
+	}
+
+	void Insert(const K& key, const V& value) {
+		Shard& shard = ShardOf(key);
+		size_t nEvicted = 0;
+		EXT_LOCK(shard.Mtx) {
+			auto it = shard.Map.find(key);
+			if (it != shard.Map.end()) {
+				it->second->second = value;
+				shard.Lru.splice(shard.Lru.begin(), shard.Lru, it->second);
+			} else {
+				shard.Lru.push_front(make_pair(key, value));
+				shard.Map.insert(make_pair(key, shard.Lru.begin()));
+				for (size_t maxSize = m_aMaxPerShard; shard.Lru.size() > maxSize; ++nEvicted) {
+					shard.Map.erase(shard.Lru.back().first);
+					shard.Lru.pop_back();
+				}
+			}
+		}
+		Stats.aEvictions += nEvicted;
+	}
+
+	void Erase(const K& key) {
+		Shard& shard = ShardOf(key);
+		EXT_LOCK(shard.Mtx) {
+			auto it = shard.Map.find(key);
+			if (it != shard.Map.end()) {
+				shard.Lru.erase(it->second);
+				shard.Map.erase(it);
+			}
+		}
+	}
+
+	void clear() {
+		for (auto& shard : m_shards) {
+			EXT_LOCK(shard.Mtx) {
+				shard.Map.clear();
+				shard.Lru.clear();
+			}
+		}
+	}
+private:
+	static size_t PerShard(size_t maxSize) { return std::max(size_t(1), (maxSize + SHARDS - 1) / SHARDS); }
+
+	Shard& ShardOf(const K& key) {			// multiplicative mixing, heights and ids are sequential
+		return m_shards[(uint64_t(hash<K>()(key)) * 0x9E3779B97F4A7C15ULL) >> (64 - SHARD_BITS)];
+	}
+};
+
+} // Coin::
@@ -0,0 +1,304 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Proof-of-stake minting. Wallet outputs are indexed once per tip together with the constant part of their kernel,
+// then every second the kernels of all of them are hashed for the seconds elapsed since the previous pass.
+// Hashing is batched through the multi-way SHA-256d kernel and takes no engine locks, so block connect doesn't wait for it
+
+#include <el/ext.h>
+
+#include "coin-protocol.h"
+#include "proof-of-stake.h"
+#include "wallet.h"
+#include "script.h"
+
+#if UCFG_COIN_GENERATE
+
+namespace Coin {
+
+const int STAKE_SEARCH_SECONDS = 60,				// timestamps tried back from now after the tip changes
+	STAKE_MINTER_PERIOD_MS = 1000,
+	STAKE_KERNEL_BATCH = 1024;						// kernels per Sha256dShortMessages() call
+const seconds STAKE_MAX_TIME_WEIGHT(90 * 24 * 60 * 60);
+
+struct StakeCandidate {
+	Penny Coin;
+	TxoOrigin Origin;
+	DateTime BlockTimestamp;				// of the block at Origin.Height
+	Blob KernelPrefix;						// empty while the stake modifier for the block is not selected yet
+};
+
+class StakeMinter : public Thread {
+	typedef Thread base;
+public:
+	StakeMinter(Wallet& wallet, PosEng& eng)
+		: base(&eng.m_tr)
+		, m_wallet(wallet)
+		, m_eng(eng)
+		, m_block(nullptr)
+	{}
+
+	void Stop() override {
+		m_bStop = true;
+		m_ev.Set();
+	}
+protected:
+	void Execute() override;
+private:
+	Wallet& m_wallet;
+	PosEng& m_eng;
+	AutoResetEvent m_ev;
+
+	unordered_map<OutPoint, StakeCandidate> m_candidates;
+	HashValue m_hashBest;
+	Block m_block;							// coinstake block for the current tip, gives the target and the kernel context
+	DateTime m_dtSearched;					// kernels are hashed up to this second
+
+	void UpdateCandidates();
+	bool PrepareKernel(StakeCandidate& cand);
+	vector<pair<const StakeCandidate*, DateTime>> Search(const DateTime& dtFrom, const DateTime& dtTo);
+	Block NewCoinStakeBlock(const StakeCandidate& cand, const DateTime& dt);
+	void SignCoinStakeBlock(Block& block, const StakeCandidate& cand);
+	void MintStep();
+};
+
+static double TargetToDouble(const Target& target) {
+	return ldexp(double(target.m_value & 0x7FFFFF), 8 * (int(target.m_value >> 24) - 3));
+}
+
+// The block is signed by the key of the coinstake output, so it must be P2PK
+static KeyInfo StakeKeyInfo(CoinDb& cdb, const Penny& coin) {
+	Address a = TxOut::CheckStandardType(coin.ScriptPubKey);
+	return cdb.GetMyKeyInfo(a.Type == AddressType::PubKey ? Hash160(a.Data()) : HashValue160(a));
+}
+
+void StakeMinter::UpdateCandidates() {
+	vector<Penny> coins;
+	EXT_LOCK (m_eng.m_cdb.MtxDb) {
+		SqliteCommand cmd(EXT_STR("SELECT hash, nout, value, pkscript FROM coins JOIN mytxes ON txid=mytxes.id WHERE netid=" << m_wallet.m_dbNetId), m_eng.m_cdb.m_dbWallet);
+		for (DbDataReader dr = cmd.ExecuteReader(); dr.Read();) {
+			Penny coin;
+			coin.OutPoint.TxHash = HashValue(dr.GetBytes(0));
+			coin.OutPoint.Index = dr.GetInt32(1);
+			coin.Value = dr.GetInt64(2);
+			coin.m_scriptPubKey = dr.GetBytes(3);
+			coins.push_back(coin);
+		}
+	}
+
+	int bestHeight = m_eng.BestBlockHeight();
+	unordered_map<OutPoint, StakeCandidate> candidates;
+	for (auto& coin : coins) {
+		auto it = m_candidates.find(coin.OutPoint);
+		if (it != m_candidates.end()) {
+			candidates.insert(*it);
+			continue;
+		}
+		AddressType typ = TxOut::CheckStandardType(coin.ScriptPubKey).Type;
+		if (typ != AddressType::PubKey && typ != AddressType::P2PKH)
+			continue;
+		Tx txPrev;
+		if (!Tx::TryFromDb(coin.OutPoint.TxHash, &txPrev) || txPrev.Height < 0)
+			continue;
+		if ((txPrev->IsCoinBase() || txPrev->IsCoinStake()) && bestHeight - txPrev.Height < m_eng.ChainParams.CoinbaseMaturity)
+			continue;											// reconsidered on the next tip
+		StakeCandidate cand;
+		cand.Coin = coin;
+		cand.Origin.TxTimestamp = txPrev->get_TxTimestamp();
+		cand.Origin.Height = txPrev.Height;
+		cand.BlockTimestamp = m_eng.GetBlockTimestamp(txPrev.Height);
+		candidates.insert(make_pair(coin.OutPoint, cand));
+	}
+	m_candidates.swap(candidates);
+}
+
+bool StakeMinter::PrepareKernel(StakeCandidate& cand) {
+	if (cand.KernelPrefix.size())
+		return true;
+	try {
+		DBG_LOCAL_IGNORE_CONDITION(CoinErr::CoinstakeCheckTargetFailed);
+
+		MemoryStream ms;
+		BinaryWriter wr(ms);
+		PosBlockObj::Of(m_block).WriteKernelPrefix(wr, m_eng.GetBlockByHeight(cand.Origin.Height), cand.Coin.OutPoint, cand.Origin.TxTimestamp);
+		cand.KernelPrefix = Span(ms);
+	} catch (RCExc ex) {
+		if (ex.code() != CoinErr::CoinstakeCheckTargetFailed)		// thrown until the selection interval after the block has passed
+			throw;
+		return false;
+	}
+	return true;
+}
+
+// Returns kernels which pass a floating-point comparison with the target; the exact check is done by CheckProofOfStake()
+vector<pair<const StakeCandidate*, DateTime>> StakeMinter::Search(const DateTime& dtFrom, const DateTime& dtTo) {
+	const PosBlockObj& context = PosBlockObj::Of(m_block);
+	const double target = TargetToDouble(m_block->get_DifficultyTarget()),
+		coinDay = 24 * 60 * 60 * double(m_eng.ChainParams.CoinValue);
+	const int64_t tTo = to_time_t(dtTo);
+
+	vector<pair<const StakeCandidate*, DateTime>> r;
+	vector<uint8_t> messages;
+	vector<pair<const StakeCandidate*, int64_t>> kernels;
+	vector<HashValue> hashes;
+	size_t cbMessage = 0;
+	auto flush = [&]() {
+		hashes.resize(kernels.size());
+		Sha256dShortMessages(messages.data(), cbMessage, kernels.size(), hashes.data());
+		for (size_t i = 0; i < kernels.size(); ++i) {
+			const StakeCandidate& cand = *kernels[i].first;
+			int64_t weight = std::min(kernels[i].second - int64_t(to_time_t(cand.Origin.TxTimestamp)), int64_t(STAKE_MAX_TIME_WEIGHT.count()));
+			double hash = ldexp(double(letoh(*(const uint64_t*)(hashes[i].data() + 24))), 192);		// the kernel hash is a little-endian number
+			if (hash <= target * (double(cand.Coin.Value) * weight / coinDay) * (1 + 1e-9))
+				r.push_back(make_pair(&cand, DateTime::from_time_t(kernels[i].second)));
+		}
+		messages.clear();
+		kernels.clear();
+	};
+
+	for (auto& kv : m_candidates) {
+		StakeCandidate& cand = kv.second;
+		DateTime dtMin = std::max(std::max(dtFrom, cand.BlockTimestamp + context.STAKE_MIN_AGE), cand.Origin.TxTimestamp);
+		if (dtMin > dtTo || double(cand.Coin.Value) * std::min(duration_cast<seconds>(dtTo - cand.Origin.TxTimestamp).count(), STAKE_MAX_TIME_WEIGHT.count()) < coinDay
+			|| !PrepareKernel(cand))					// less than one coin-day never meets the target
+			continue;
+		if (cand.KernelPrefix.size() + 4 != cbMessage) {
+			if (!kernels.empty())
+				flush();
+			cbMessage = cand.KernelPrefix.size() + 4;
+		}
+		for (int64_t t = to_time_t(dtMin); t <= tTo; ++t) {
+			uint32_t le = htole(uint32_t(t));
+			messages.insert(messages.end(), cand.KernelPrefix.constData(), cand.KernelPrefix.constData() + cand.KernelPrefix.size());
+			messages.insert(messages.end(), (const uint8_t*)&le, (const uint8_t*)&le + 4);
+			kernels.push_back(make_pair(&cand, t));
+			if (kernels.size() == STAKE_KERNEL_BATCH)
+				flush();
+		}
+	}
+	if (!kernels.empty())
+		flush();
+	sort(r.begin(), r.end(), [](const pair<const StakeCandidate*, DateTime>& a, const pair<const StakeCandidate*, DateTime>& b) { return a.second < b.second; });
+	return r;
+}
+
+Block StakeMinter::NewCoinStakeBlock(const StakeCandidate& cand, const DateTime& dt) {
+	Block block = m_wallet.CreateNewBlock();				// coinbase and txes from the pool
+	if (!block)
+		return block;
+
+	Tx& txCoinbase = block.GetFirstTxRef();
+	txCoinbase.TxOuts()[0] = TxOut(0, Blob());					// fees are not paid in PoS blocks
+	((PosTxObj*)txCoinbase.m_pimpl.get())->Timestamp = dt;
+	MemoryStream msCoinbase;
+	ScriptWriter wr(msCoinbase);
+	if (block->Ver >= 2)
+		wr << int64_t(block.Height);
+	wr << BigInteger(to_time_t(dt));
+	txCoinbase->m_txIns.at(0).put_Script(msCoinbase);
+	txCoinbase->m_nBytesOfHash = 0;
+
+	Tx txStake;
+	txStake.EnsureCreate(m_eng);
+	txStake->m_txIns.resize(1);
+	txStake->m_txIns[0].PrevOutPoint = cand.Coin.OutPoint;
+	txStake->m_bLoadedIns = true;
+	((PosTxObj*)txStake.m_pimpl.get())->Timestamp = dt;
+	Blob scriptStake = cand.Coin.ScriptPubKey;
+	if (TxOut::CheckStandardType(scriptStake).Type != AddressType::PubKey) {
+		MemoryStream ms;
+		ScriptWriter(ms) << Span(StakeKeyInfo(m_eng.m_cdb, cand.Coin).PubKey.Data) << Opcode::OP_CHECKSIG;
+		scriptStake = Span(ms);
+	}
+	txStake.TxOuts().push_back(TxOut(0, Blob()));				// marks the coinstake
+	txStake.TxOuts().push_back(TxOut(cand.Coin.Value, scriptStake));
+	block->m_txes.insert(block->m_txes.begin() + 1, txStake);
+
+	block->Timestamp = dt;
+	block->DifficultyTargetBits = m_eng.GetNextTarget(m_eng.BestBlock(), block).m_value;
+	block->m_merkleRoot.reset();
+	block->m_bHashCalculated = false;
+	return block;
+}
+
+void StakeMinter::SignCoinStakeBlock(Block& block, const StakeCandidate& cand) {
+	Tx& txStake = block->m_txes.at(1);
+	txStake->CalcCoinAge(vector<pair<TxOut, TxoOrigin>>(1, make_pair(TxOut(cand.Coin.Value), cand.Origin)));
+	int64_t posReward = m_eng.GetProofOfStakeReward(txStake->GetCoinAge(), block->get_DifficultyTarget(), block.Timestamp);
+	for (int64_t minFee = 0;;) {									// the fee depends on the size of the signed tx
+		txStake.TxOuts()[1].Value = cand.Coin.Value + posReward - minFee;
+		WalletSigner signer(m_wallet, txStake);
+		signer.Sign(KeyInfo(nullptr), cand.Coin, 0);
+		txStake->m_nBytesOfHash = 0;
+		int64_t fee = txStake.GetMinFee(1, false);
+		if (fee <= minFee)
+			break;
+		minFee = fee;
+	}
+	block->m_merkleRoot.reset();
+	block->m_bHashCalculated = false;
+	PosBlockObj::Of(block).Signature = StakeKeyInfo(m_eng.m_cdb, cand.Coin)->SignHash(Hash(block).ToSpan());
+}
+
+void StakeMinter::MintStep() {
+	if (m_eng.IsInitialBlockDownload())
+		return;
+	BlockHeader bestBlock = m_eng.BestBlock();
+	HashValue hashBest = Hash(bestBlock);
+	DateTime dtTo = DateTime::from_time_t(to_time_t(Clock::now()));
+	if (hashBest != m_hashBest) {
+		UpdateCandidates();
+		m_hashBest = hashBest;
+		m_block = m_candidates.empty() ? Block(nullptr) : NewCoinStakeBlock(m_candidates.begin()->second, dtTo);
+		m_dtSearched = dtTo - seconds(STAKE_SEARCH_SECONDS);		// the target has changed
+	}
+	DateTime dtFrom = std::max(m_dtSearched, bestBlock.Timestamp) + seconds(1);
+	if (!m_block || dtFrom > dtTo)
+		return;
+	vector<pair<const StakeCandidate*, DateTime>> hits = Search(dtFrom, dtTo);
+	m_dtSearched = dtTo;
+
+	for (auto& hit : hits) {
+		Block block = NewCoinStakeBlock(*hit.first, hit.second);
+		if (!block)
+			return;
+		SignCoinStakeBlock(block, *hit.first);
+		try {
+			DBG_LOCAL_IGNORE_CONDITION(CoinErr::CoinstakeCheckTargetFailed);
+			PosBlockObj::Of(block).CheckProofOfStake();
+		} catch (RCExc) {
+			continue;
+		}
+		TRC(1, "Minted PoS block " << Hash(block) << " at height " << block.Height);
+		ptr<BlockMessage> m = new BlockMessage(block);
+		EXT_LOCK (m_eng.Mtx) {
+			m_eng.Broadcast(m.get());
+			block.Process();
+		}
+		break;
+	}
+}
+
+void StakeMinter::Execute() {
+	Name = "StakeMinter";
+
+	CCoinEngThreadKeeper engKeeper(&m_eng);
+	while (!m_bStop) {
+		try {
+			MintStep();
+		} catch (RCExc ex) {
+			TRC(2, ex.what());
+		}
+		m_ev.lock(STAKE_MINTER_PERIOD_MS);
+	}
+}
+
+Thread *PosEng::CreateStakeMinter(WalletBase& wallet) {
+	return new StakeMinter(static_cast<Wallet&>(wallet), *this);
+}
+
+} // Coin::
+
+#endif // UCFG_COIN_GENERATE
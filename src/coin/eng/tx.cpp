@@ -65,9 +65,43 @@ void TxIn::Write(ProtocolWriter& wr, bool writeForSigHash) const {
 	wr << (!wr.HashTypeSingle && !wr.HashTypeNone || writeForSigHash ? Sequence : 0);
 }
 
+EXT_THREAD_PTR(BlockArena) t_pBlockArena;
+
+uint8_t *BlockArena::Allocate(size_t size) {
+	if (size > m_cbFree) {
+		if (size > CHUNK_SIZE / 4) {							// don't waste the rest of the current chunk
+			m_chunks.emplace_back(new uint8_t[size]);
+			return m_chunks.back().get();
+		}
+		m_chunks.emplace_back(new uint8_t[CHUNK_SIZE]);
+		m_p = m_chunks.back().get();
+		m_cbFree = CHUNK_SIZE;
+	}
+	uint8_t *r = m_p;
+	m_p += size;
+	m_cbFree -= size;
+	return r;
+}
+
+BlockArena::Keeper::Keeper(BlockArena *arena)
+	: m_prev(t_pBlockArena)
+{
+	t_pBlockArena = arena;
+}
+
+BlockArena::Keeper::~Keeper() {
+	t_pBlockArena = m_prev;
+}
+
 void TxIn::Read(const BinaryReader& rd) {
 	PrevOutPoint.Read(rd);
-	m_script = CoinSerialized::ReadBlob(rd);
+	if (BlockArena *arena = t_pBlockArena) {
+		m_cbArenaScript = CoinSerialized::ReadCompactSize(rd);
+		uint8_t *p = arena->Allocate(m_cbArenaScript);
+		rd.Read(p, m_cbArenaScript);
+		m_pArenaScript = p;
+	} else
+		m_script = CoinSerialized::ReadBlob(rd);
 	rd >> Sequence;
 }
 
@@ -156,13 +190,124 @@ void CFutureTxMap::Ensure(const HashValue& hash) {
 	}
 }
 
-static Txo LoadTxoFromDbAsync(CoinEng* eng, OutPoint op, int height) {
+uint64_t CompressAmount(uint64_t n) {			// same as Bitcoin Core's, amounts are mostly round numbers
+	if (n == 0)
+		return 0;
+	int e = 0;
+	for (; n % 10 == 0 && e < 9; ++e)
+		n /= 10;
+	if (e < 9) {
+		int d = int(n % 10);
+		n /= 10;
+		return 1 + (n * 9 + d - 1) * 10 + e;
+	}
+	return 1 + (n - 1) * 10 + 9;
+}
+
+uint64_t DecompressAmount(uint64_t x) {
+	if (x == 0)
+		return 0;
+	--x;
+	int e = int(x % 10);
+	x /= 10;
+	uint64_t n;
+	if (e < 9) {
+		int d = int(x % 9) + 1;
+		x /= 9;
+		n = x * 10 + d;
+	} else
+		n = x + 1;
+	for (; e; --e)
+		n *= 10;
+	return n;
+}
+
+static const uint8_t
+	s_p2pkhPrefix[] = { 0x76, 0xA9, 20 }, s_p2pkhSuffix[] = { 0x88, 0xAC },
+	s_p2shPrefix[] = { 0xA9, 20 }, s_p2shSuffix[] = { 0x87 },
+	s_p2wpkhPrefix[] = { 0, 20 },
+	s_p2wshPrefix[] = { 0, 32 };
+
+struct ScriptTemplate {
+	const uint8_t *Prefix, *Suffix;
+	uint8_t PrefixSize, HashSize, SuffixSize;
+
+	size_t Size() const { return PrefixSize + HashSize + SuffixSize; }
+
+	bool Match(RCSpan s) const {
+		return s.size() == Size() && !memcmp(s.data(), Prefix, PrefixSize) && !memcmp(s.data() + PrefixSize + HashSize, Suffix, SuffixSize);
+	}
+};
+
+static const ScriptTemplate s_scriptTemplates[] = {				// indexed by CompactTxo::P2PKH - 1 ...
+	{ s_p2pkhPrefix, s_p2pkhSuffix, 3, 20, 2 },
+	{ s_p2shPrefix, s_p2shSuffix, 2, 20, 1 },
+	{ s_p2wpkhPrefix, nullptr, 2, 20, 0 },
+	{ s_p2wshPrefix, nullptr, 2, 32, 0 },
+};
+
+CompactTxo::CompactTxo(const TxOut& txOut) {
+	Span script = txOut.get_ScriptPubKey();
+	uint8_t buf[10 + 1 + 32];
+	size_t n = 0;
+	for (uint64_t v = CompressAmount(txOut.Value); ; v >>= 7) {		// LEB128
+		buf[n++] = uint8_t(v & 0x7F) | (v >= 0x80 ? 0x80 : 0);
+		if (v < 0x80)
+			break;
+	}
+	uint8_t typ = RAW;
+	for (int i = 0; i < size(s_scriptTemplates); ++i)
+		if (s_scriptTemplates[i].Match(script)) {
+			typ = uint8_t(i + 1);
+			break;
+		}
+	buf[n++] = typ;
+	if (typ == RAW) {
+		m_data.resize(n + script.size(), false);
+		memcpy(m_data.data(), buf, n);
+		memcpy(m_data.data() + n, script.data(), script.size());
+	} else {
+		const ScriptTemplate& t = s_scriptTemplates[typ - 1];
+		memcpy(buf + n, script.data() + t.PrefixSize, t.HashSize);
+		m_data = Span(buf, n + t.HashSize);
+	}
+}
+
+TxOut CompactTxo::ToTxOut() const {
+	const uint8_t *p = m_data.data(), *e = p + m_data.size();
+	uint64_t v = 0;
+	for (int shift = 0; ; shift += 7) {
+		v |= uint64_t(*p & 0x7F) << shift;
+		if (!(*p++ & 0x80))
+			break;
+	}
+	TxOut r((int64_t)DecompressAmount(v));
+	uint8_t typ = *p++;
+	if (typ == RAW)
+		r.m_scriptPubKey = Span(p, e - p);
+	else {
+		const ScriptTemplate& t = s_scriptTemplates[typ - 1];
+		r.m_scriptPubKey.resize(t.Size(), false);
+		uint8_t *q = r.m_scriptPubKey.data();
+		memcpy(q, t.Prefix, t.PrefixSize);
+		memcpy(q + t.PrefixSize, p, t.HashSize);
+		if (t.SuffixSize)
+			memcpy(q + t.PrefixSize + t.HashSize, t.Suffix, t.SuffixSize);
+	}
+	return r;
+}
+
+static TxoMap::LoadedTxo LoadTxoFromDbAsync(CoinEng* eng, OutPoint op, int height) {
 	Tx tx;
 	if (eng->Db->FindTx(op.TxHash, &tx)) {		// Don't use the cache as it is usually one-time operation
 		if (tx->IsCoinBase())
 			eng->CheckCoinbasedTxPrev(height, tx.Height);
 		try {
-			return tx.TxOuts().at(op.Index);
+			TxoMap::LoadedTxo r;
+			r.Txo = CompactTxo(tx.TxOuts().at(op.Index));
+			r.Origin.TxTimestamp = tx->get_TxTimestamp();
+			r.Origin.Height = tx.Height;
+			return r;
 		} catch (out_of_range&) {
 		}
 	}
@@ -170,10 +315,16 @@ static Txo LoadTxoFromDbAsync(CoinEng* eng, OutPoint op, int height) {
 	throw TxNotFoundException(CoinErr::TxMissingInputs, op.TxHash);	//!!!TODO throw OutPointNotFoundException
 }
 
+void TxoMap::Reserve(size_t n) {
+	EXT_LOCK(m_mtx) {
+		m_map.reserve(n);
+	}
+}
+
 void TxoMap::Add(const OutPoint& op, int height) {
 	auto launchType = UCFG_COIN_TX_CONNECT_FUTURES ? launch::async : launch::deferred;
 	EXT_LOCK(m_mtx) {
-		auto pp = m_map.insert(make_pair(op, Entry()));
+		auto pp = m_map.emplace(op);
 		Entry& entry = pp.first->second;
 		if (pp.second)
 			entry.Ft = std::async(launchType, LoadTxoFromDbAsync, &m_eng, op, height);
@@ -186,27 +337,39 @@ void TxoMap::Add(const OutPoint& op, int height) {
 
 void TxoMap::AddAllOuts(const HashValue& hashTx, const Tx& tx) {
 	auto& txOuts = tx.TxOuts();
-	OutPoint op(hashTx);
+	DateTime dtTx = tx->get_TxTimestamp();
 	EXT_LOCK(m_mtx) {
 		for (int i = 0; i < txOuts.size(); ++i) {
-			Txo toh = { txOuts[op.Index = i] };
-			promise<Txo> pr;
-			pr.set_value(toh);
-			if (!m_map.insert(make_pair(op, Entry(pr.get_future(), true))).second)
+			auto pp = m_map.emplace(OutPoint(hashTx, i));
+			if (!pp.second)
 				Throw(E_FAIL);
+			pp.first->second.Txo = CompactTxo(txOuts[i]);
+			pp.first->second.Origin.TxTimestamp = dtTx;
+			pp.first->second.InCurrentBlock = true;
 		}
 	}
 }
 
-Txo TxoMap::Get(const OutPoint& op) const {
-	shared_future<Txo> *pft;
+Txo TxoMap::Get(const OutPoint& op, TxoOrigin& origin) const {
+	shared_future<LoadedTxo> ft;
 	EXT_LOCK(m_mtx) {
 		auto it = m_map.find(op);
 		if (it == m_map.end())
 			Throw(CoinErr::TxMissingInputs);
-		pft = &it->second.Ft;
+		if (!it->second.Ft.valid()) {
+			origin = it->second.Origin;
+			return it->second.Txo.ToTxOut();
+		}
+		ft = it->second.Ft;				// copied, entries move on rehash
 	}
-	return pft->get();
+	const LoadedTxo& loaded = ft.get();
+	origin = loaded.Origin;
+	return loaded.Txo.ToTxOut();
+}
+
+Txo TxoMap::Get(const OutPoint& op) const {
+	TxoOrigin origin;
+	return Get(op, origin);
 }
 
 bool CoinsView::HasInput(const OutPoint& op) const {
@@ -472,6 +635,7 @@ void TxObj::Read(const ProtocolReader& rd) {
 	ASSERT(!m_bLoadedIns);
 	DBG_LOCAL_IGNORE_CONDITION(CoinErr::Misbehaving);
 
+	m_arena = t_pBlockArena;
 	Ver = rd.ReadUInt32();
 	ReadPrefix(rd);
 	CoinSerialized::Read(rd, m_txIns);
@@ -533,24 +697,32 @@ bool Tx::AllowFree(double priority) {
 bool Tx::TryFromDb(const HashValue& hash, Tx* ptx) {
 	CoinEng& eng = Eng();
 
-	EXT_LOCK(eng.Caches.Mtx) {
-		ChainCaches::CHashToTxCache::iterator it = eng.Caches.HashToTxCache.find(hash);
-		if (it != eng.Caches.HashToTxCache.end()) {
-			if (ptx)
-				*ptx = it->second.first;
-			return true;
-		}
+	if (auto otx = eng.Caches.HashToTxCache.Lookup(hash)) {
+		if (ptx)
+			*ptx = otx.value();
+		return true;
 	}
 	if (!eng.Db->FindTx(hash, ptx))
 		return false;
 	if (ptx) {
 		// ASSERT(ReducedHashValue(Hash(*ptx)) == ReducedHashValue(hash));
 
-		EXT_LOCKED(eng.Caches.Mtx, eng.Caches.HashToTxCache.insert(make_pair(hash, *ptx)));
+		*ptx = ptx->DetachedFromArena();
+		eng.Caches.HashToTxCache.Insert(hash, *ptx);
 	}
 	return true;
 }
 
+// A single Tx must not keep the whole BlockArena of its Block allocated. The Tx may be already shared, so it is not modified:
+// the copy owns the scripts, because TxIn copies do
+Tx Tx::DetachedFromArena() const {
+	if (!m_pimpl->m_arena)
+		return _self;
+	Tx r(m_pimpl->Clone());
+	r->m_arena = nullptr;
+	return r;
+}
+
 Tx Tx::FromDb(const HashValue& hash) {
 	Coin::Tx r;
 	if (TryFromDb(hash, &r))
@@ -598,11 +770,8 @@ PubKeyHash160 DbPubKeyToHashValue160(RCSpan mb) {
 }
 
 HashValue160 CoinEng::GetHash160ById(int64_t id) {
-	EXT_LOCK(Caches.Mtx) {
-		ChainCaches::CCachePkIdToPubKey::iterator it = Caches.m_cachePkIdToPubKey.find(id);
-		if (it != Caches.m_cachePkIdToPubKey.end())
-			return it->second.first.Hash160;
-	}
+	if (auto opkh = Caches.m_cachePkIdToPubKey.Lookup(id))
+		return opkh.value().Hash160;
 	Blob pk = Db->FindPubkey(id);
 	if (!!pk) {
 		PubKeyHash160 pkh = DbPubKeyToHashValue160(pk);
@@ -610,10 +779,8 @@ HashValue160 CoinEng::GetHash160ById(int64_t id) {
 		CIdPk idpk(pkh.Hash160);
 		ASSERT(idpk == id);
 #endif
-		EXT_LOCK(Caches.Mtx) {
-			if (Caches.PubkeyCacheEnabled)
-				Caches.m_cachePkIdToPubKey.insert(make_pair(id, pkh));
-		}
+		if (Caches.PubkeyCacheEnabled)
+			Caches.m_cachePkIdToPubKey.Insert(id, pkh);
 		return pkh.Hash160;
 	} else
 		Throw(ExtErr::DB_NoRecord);
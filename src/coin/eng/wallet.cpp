@@ -7,6 +7,7 @@
 
 #include "wallet.h"
 #include "script.h"
+#include "block-filter.h"
 
 namespace Coin {
 
@@ -40,6 +41,7 @@ Wallet::Wallet(CoinDb& cdb, RCString name)
 void Wallet::Init() {
 	Progress = 1;
 	CurrentHeight = -1;
+	m_bRescanDbBatch = false;
 	m_eng->Events.Subscribers.push_back(this);
 }
 
@@ -127,6 +129,16 @@ bool Wallet::IsToMe(const Tx& tx) {
 	return false;
 }
 
+bool Wallet::SpendsMyTx(const Tx& tx) {
+	EXT_LOCK(m_mtxMyTxHashes) {
+		EXT_FOR (const TxIn& txIn, tx.TxIns()) {
+			if (m_myTxHashes.count(txIn.PrevOutPoint.TxHash))
+				return true;
+		}
+	}
+	return false;
+}
+
 bool Wallet::IsFromMe(const Tx& tx) {
 	EXT_LOCK(m_mtxMyTxHashes) {
 		EXT_FOR (const TxIn& txIn, tx.TxIns()) {
@@ -207,7 +219,9 @@ bool Wallet::InsertUserTx(int64_t txid, int nout, int64_t value) {
 void Wallet::ProcessMyTx(WalletTx& wtx, bool bPending) {
 	CoinDb& cdb = m_eng->m_cdb;
 	EXT_LOCK (cdb.MtxDb) {
-		TransactionScope dbtx(cdb.m_dbWallet);
+		optional<TransactionScope> dbtx;
+		if (!m_bRescanDbBatch)
+			dbtx.emplace(cdb.m_dbWallet);
 
 		int64_t txid = Add(wtx, bPending);
 		HashValue txHash = Hash(wtx);
@@ -278,10 +292,10 @@ void Wallet::OnProcessTx(const Tx& tx) {
 		ProcessTx(tx);
 }
 
-void Wallet::SetBestBlockHash(const HashValue& hash) {
+void Wallet::SetBestBlockHash(const HashValue& hash, bool bNotify) {
 	BestBlockHash = hash;
 	EXT_LOCKED(m_eng->m_cdb.MtxDb, m_eng->m_cdb.CmdSetBestBlockHash.Bind(1, (BestBlockHash = hash).ToSpan()).Bind(2, m_dbNetId).ExecuteNonQuery());
-	if (m_iiWalletEvents)
+	if (bNotify && m_iiWalletEvents)
 		m_iiWalletEvents->OnStateChanged();
 }
 
@@ -428,6 +442,103 @@ RescanThread::RescanThread(Coin::Wallet& wallet, const HashValue& hashFrom)
 {
 }
 
+const int RESCAN_DB_BATCH_BLOCKS = 128;		// Blocks per one wallet DB transaction
+const size_t RESCAN_MAX_READ_AHEAD = 8;		// loading threads wanted from the ResourceGovernor
+
+struct RescanBlock {
+	Coin::Block Block;
+	vector<int> Candidates;			// indices of Txes having outputs matched by the key filter
+	bool Skipped;					// BIP158 filter proves the block neither pays to nor spends from our scripts
+};
+
+static RescanBlock LoadRescanBlock(CoinEng *peng, int height, const CoinFilter *filter, const vector<Blob> *myScripts) {
+	CCoinEngThreadKeeper engKeeper(peng);
+	RescanBlock r = { peng->GetBlockByHeight(height), vector<int>(), false };
+	if (myScripts) {
+		if (optional<Blob> encoded = peng->Db->FindBlockFilter(height)) {
+			r.Skipped = !GolombCodedSet(Hash(r.Block), encoded.value()).MatchAny(*myScripts);
+			if (r.Skipped)
+				return r;
+		}
+	}
+	if (peng->Mode != EngMode::Lite)
+		r.Block.LoadToMemory();
+	const auto& txes = r.Block.get_Txes();
+	for (int i = 0; i < txes.size(); ++i) {
+		for (auto& txOut : txes[i].TxOuts()) {
+			if (filter->MatchesScript(txOut.get_ScriptPubKey())) {
+				r.Candidates.push_back(i);
+				break;
+			}
+		}
+	}
+	return r;
+}
+
+// Blocks are read and prefiltered ahead by worker threads, then confirmed with FindMine() in order.
+// Txes are processed sequentially because spending detection depends on the earlier ones.
+// Locks are taken in the order of OnBlockchainChanged(): MtxCurrentHeight, then MtxDb, and never held while waiting for the workers or notifying.
+// Block h is processed only if CurrentHeight is still h-1, otherwise blocks connected meanwhile have moved it and the scan restarts
+void RescanThread::ScanBlocks() {
+	CoinEng& eng = *Wallet.m_eng;
+	CoinDb& cdb = eng.m_cdb;
+	ptr<CoinFilter> filter = cdb.CreateKeyFilter(0.0001, 0, CoinFilter::BLOOM_UPDATE_NONE);
+	vector<Blob> myScripts;
+	if (eng.BlockFilterIndexEnabled)
+		myScripts = cdb.GetMyScriptPubKeys();
+	WorkerGrant workers(eng, RESCAN_MAX_READ_AHEAD);
+	size_t nReadAhead = workers.size();
+
+	int bestHeight = eng.BestBlock().SafeHeight,
+		heightNext = EXT_LOCKED(Wallet.MtxCurrentHeight, Wallet.CurrentHeight) + 1;
+	deque<future<RescanBlock>> queue;
+	auto fillQueue = [&] {
+		while (queue.size() < nReadAhead && heightNext <= bestHeight)
+			queue.push_back(std::async(launch::async, LoadRescanBlock, &eng, heightNext++, filter.get(), myScripts.empty() ? nullptr : &myScripts));
+	};
+	for (bool bStale = false; !bStale && !m_bStop && (fillQueue(), !queue.empty());) {
+		vector<RescanBlock> batch;
+		do {
+			batch.push_back(queue.front().get());			// without locks
+			queue.pop_front();
+		} while (batch.size() < RESCAN_DB_BATCH_BLOCKS && !queue.empty() && queue.front().wait_for(seconds(0)) == future_status::ready);
+		fillQueue();										// workers read the next blocks while this batch is processed
+
+		bool bNotify = false;
+		EXT_LOCK(Wallet.MtxCurrentHeight) {
+			EXT_LOCK(cdb.MtxDb) {
+				TransactionScope dbtx(cdb.m_dbWallet);
+				CBoolKeeper keeperBatch(Wallet.m_bRescanDbBatch, true);
+				for (auto& rb : batch) {
+					if (m_bStop || (bStale = Wallet.CurrentHeight != rb.Block.Height - 1))
+						break;
+					bool bUpdateWallet = false;
+					if (!rb.Skipped) {
+						const auto& txes = rb.Block.get_Txes();
+						for (int j = 0, k = 0; j < txes.size(); ++j) {
+							bool bCandidate = k < rb.Candidates.size() && rb.Candidates[k] == j;
+							k += bCandidate;
+							if (bCandidate || Wallet.SpendsMyTx(txes[j]))
+								bUpdateWallet |= Wallet.ProcessTx(txes[j]);
+						}
+					}
+					Wallet.CurrentHeight = rb.Block.Height;
+					Wallet.BestBlockHash = Hash(rb.Block);
+					++m_i;
+					if (bUpdateWallet || !(rb.Block.Height & 0xFF))
+						Wallet.SetBestBlockHash(Wallet.BestBlockHash, false);
+					bNotify = true;
+				}
+				Wallet.SetBestBlockHash(Wallet.BestBlockHash, false);
+			}
+		}
+		if (bNotify && Wallet.m_iiWalletEvents)					// once per batch, out of the locks: handlers may read the wallet
+			Wallet.m_iiWalletEvents->OnStateChanged();
+	}
+	for (auto& ft : queue)		// don't leave workers running after Stop
+		ft.wait();
+}
+
 void RescanThread::Execute() {
 	Name = "RescanThread";
 
@@ -454,7 +565,10 @@ CONTINUE_SCAN_LAB:
 	while (Wallet.CurrentHeight < eng.BestBlockHeight()) {
 		if (m_bStop)
 			goto LAB_STOP;
-		Wallet.OnBlockchainChanged();
+		if (EXT_LOCKED(Wallet.MtxCurrentHeight, Wallet.CurrentHeight) == -1 && Wallet.BestBlockHash)
+			Wallet.OnBlockchainChanged();
+		else
+			ScanBlocks();
 //!!!		Wallet.OnSetProgress(float(m_i) / m_count);
 	}
 	if (BlockHeader bestBlock = eng.BestBlock()) {
@@ -907,6 +1021,9 @@ pair<WalletTx, decimal64> Wallet::CreateTransaction(const KeyInfo& randomKey, co
 
 //!!!?			int64_t minFee = tx.GetMinFee(1, Tx::AllowFree(priority));
 			int64_t minFee = tx.GetMinFee(1, false);
+			int confirmBlocks;
+			if (optional<int64_t> feeRate = m_eng->FeeEstimator.EstimateSmart(g_conf.TxConfirmTarget, confirmBlocks))
+				minFee = std::max(minFee, Tx::CalcMinFee(size, feeRate.value()));
 			if (fee >= minFee) {
 				decimal64 dfee = make_decimal64((long long)fee, -m_eng->ChainParams.Log10CoinValue());
 				TRC(3, make_decimal64((long long)nVal, -m_eng->ChainParams.Log10CoinValue()) << " " << Eng.ChainParams.Symbol << ",  Fee: " << dfee << " " << Eng.ChainParams.Symbol);
@@ -73,6 +73,8 @@ public:
 	RescanThread(Coin::Wallet& wallet, const HashValue& hashFrom);
 protected:
 	void Execute() override;
+private:
+	void ScanBlocks();
 };
 
 class CompactThread : public Thread {
@@ -115,6 +117,7 @@ public:
 
 	int32_t m_dbNetId;
 	float Progress;
+	bool m_bRescanDbBatch;			// wallet DB transaction is opened by RescanThread for several blocks
 	CBool m_bLoaded;
 	CBool m_bMiningEnabled;
 
@@ -192,7 +195,8 @@ private:
 	bool SelectCoins(uint64_t amount, uint64_t fee, int nConfMine, int nConfTheirs, pair<unordered_set<Penny>, uint64_t>& pp);
 	pair<vector<Penny>, uint64_t> SelectCoins(uint64_t amount, uint64_t fee);			// <returns Pennies, RequiredFee>
 	bool ProcessTx(const Tx& tx);
-	void SetBestBlockHash(const HashValue& hash);
+	bool SpendsMyTx(const Tx& tx);
+	void SetBestBlockHash(const HashValue& hash, bool bNotify = true);
 	void ReacceptWalletTxes();
 
 	void OnSetProgress(float v) override {
@@ -20,20 +20,44 @@ public:
 		return HashValue(ConstBuf(res.data(), 32));
 	}
 
-#if UCFG_PLATFORM_X64 && UCFG_BITCOIN_ASM
 	void MineNparNonces(BitcoinMiner& miner, BitcoinWorkData& wd, uint32_t *buf, uint32_t nonce) override {
-		for (int i=0; i<UCFG_BITCOIN_NPAR; i+=3, nonce+=3) {
-			SetNonce(buf, nonce);
-			array<array<uint32_t, 8>, 3> res3 = CalcSCryptHash_80_3way(buf);
-			for (int j=0; j<3; ++j) {
-				if (HashValue(ConstBuf(res3[j].data(), 32)) <= wd.HashTarget) {
+		const int nLanes = ScryptLanes();
+#if UCFG_PLATFORM_X64 && UCFG_BITCOIN_ASM
+		if (nLanes < 8) {
+			for (int i=0; i<UCFG_BITCOIN_NPAR; i+=3, nonce+=3) {
+				SetNonce(buf, nonce);
+				array<array<uint32_t, 8>, 3> res3 = CalcSCryptHash_80_3way(buf);
+				for (int j=0; j<3; ++j) {
+					if (HashValue(ConstBuf(res3[j].data(), 32)) <= wd.HashTarget) {
+						if (!miner.TestAndSubmit(&wd, htobe(nonce+j)))
+							*miner.m_pTraceStream << "Found NONCE not accepted by Target" << endl;
+					}
+				}
+			}
+			return;
+		}
+#endif // UCFG_PLATFORM_X64 && UCFG_BITCOIN_ASM
+		if (nLanes == 1) {
+			Hasher::MineNparNonces(miner, wd, buf, nonce);
+			return;
+		}
+		uint8_t data[16 * 80];
+		HashValue hashes[16];
+		for (int i=0; i<UCFG_BITCOIN_NPAR; i+=nLanes, nonce+=nLanes) {
+			int n = std::min(nLanes, UCFG_BITCOIN_NPAR - i);
+			for (int j=0; j<n; ++j) {
+				SetNonce(buf, nonce+j);
+				memcpy(data + j*80, buf, 80);
+			}
+			ScryptHashes(data, n, hashes);
+			for (int j=0; j<n; ++j) {
+				if (hashes[j] <= wd.HashTarget) {
 					if (!miner.TestAndSubmit(&wd, htobe(nonce+j)))
 						*miner.m_pTraceStream << "Found NONCE not accepted by Target" << endl;
 				}
 			}
 		}
 	}
-#endif // UCFG_PLATFORM_X64 && UCFG_BITCOIN_ASM
 
 } g_scryptHasher;
 
@@ -0,0 +1,60 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#if UCFG_CPU_X86_X64
+#	include <immintrin.h>
+#endif
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC push_options
+#	pragma GCC target("avx2")
+#endif
+
+#include "scrypt-nway.h"
+#include "sha256-nway.h"
+
+namespace Coin {
+
+#if UCFG_CPU_X86_X64
+
+struct Avx2Lanes {
+	static const int LANES = 8;
+	typedef __m256i Vec;
+	typedef __m256i Idx;
+
+	static __forceinline Vec Load(const uint32_t *p) { return _mm256_load_si256((const __m256i*)p); }
+	static __forceinline void Store(uint32_t *p, Vec v) { _mm256_store_si256((__m256i*)p, v); }
+	static __forceinline Vec Add(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+	static __forceinline Vec Xor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+	static __forceinline Vec And(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+	static __forceinline Vec Or(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+	static __forceinline Vec Set1(uint32_t v) { return _mm256_set1_epi32(int(v)); }
+	template <int n> static __forceinline Vec Shr(Vec a) { return _mm256_srli_epi32(a, n); }
+	template <int n> static __forceinline Vec Rotl(Vec a) { return _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - n)); }
+	static __forceinline Idx MakeIdx(const uint32_t *offsets) { return Load(offsets); }
+	static __forceinline Vec Gather(const uint32_t *base, Idx idx) { return _mm256_i32gather_epi32((const int*)base, idx, 4); }
+};
+
+void ScryptCore_Avx2(uint32_t *X, uint32_t *V) {
+	ScryptCoreNway<Avx2Lanes>(X, V);
+}
+
+void Sha256d64_Avx2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256d64Nway<Avx2Lanes>(out, in, c);
+}
+
+void Sha256dBlock_Avx2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256dBlockNway<Avx2Lanes>(out, in, c);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+} // Coin::
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC pop_options
+#endif
@@ -0,0 +1,60 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#if UCFG_CPU_X86_X64
+#	include <immintrin.h>
+#endif
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC push_options
+#	pragma GCC target("avx512f")
+#endif
+
+#include "scrypt-nway.h"
+#include "sha256-nway.h"
+
+namespace Coin {
+
+#if UCFG_CPU_X86_X64
+
+struct Avx512Lanes {
+	static const int LANES = 16;
+	typedef __m512i Vec;
+	typedef __m512i Idx;
+
+	static __forceinline Vec Load(const uint32_t *p) { return _mm512_load_si512(p); }
+	static __forceinline void Store(uint32_t *p, Vec v) { _mm512_store_si512(p, v); }
+	static __forceinline Vec Add(Vec a, Vec b) { return _mm512_add_epi32(a, b); }
+	static __forceinline Vec Xor(Vec a, Vec b) { return _mm512_xor_si512(a, b); }
+	static __forceinline Vec And(Vec a, Vec b) { return _mm512_and_si512(a, b); }
+	static __forceinline Vec Or(Vec a, Vec b) { return _mm512_or_si512(a, b); }
+	static __forceinline Vec Set1(uint32_t v) { return _mm512_set1_epi32(int(v)); }
+	template <int n> static __forceinline Vec Shr(Vec a) { return _mm512_srli_epi32(a, n); }
+	template <int n> static __forceinline Vec Rotl(Vec a) { return _mm512_rol_epi32(a, n); }
+	static __forceinline Idx MakeIdx(const uint32_t *offsets) { return Load(offsets); }
+	static __forceinline Vec Gather(const uint32_t *base, Idx idx) { return _mm512_i32gather_epi32(idx, base, 4); }
+};
+
+void ScryptCore_Avx512(uint32_t *X, uint32_t *V) {
+	ScryptCoreNway<Avx512Lanes>(X, V);
+}
+
+void Sha256d64_Avx512(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256d64Nway<Avx512Lanes>(out, in, c);
+}
+
+void Sha256dBlock_Avx512(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256dBlockNway<Avx512Lanes>(out, in, c);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+} // Coin::
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC pop_options
+#endif
@@ -0,0 +1,362 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+#include <el/ext.h>
+
+#include "util.h"
+
+#if UCFG_CPU_X86_X64
+#	include <immintrin.h>
+#	if !UCFG_GNUC
+#		include <intrin.h>
+#	endif
+#endif
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC push_options
+#	pragma GCC target("sse2")
+#endif
+
+#include "scrypt-nway.h"
+#include "sha256-nway.h"
+
+namespace Coin {
+
+#if UCFG_CPU_X86_X64
+
+struct Sse2Lanes {
+	static const int LANES = 4;
+	typedef __m128i Vec;
+	typedef const uint32_t *Idx;
+
+	static __forceinline Vec Load(const uint32_t *p) { return _mm_load_si128((const __m128i*)p); }
+	static __forceinline void Store(uint32_t *p, Vec v) { _mm_store_si128((__m128i*)p, v); }
+	static __forceinline Vec Add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+	static __forceinline Vec Xor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+	static __forceinline Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+	static __forceinline Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+	static __forceinline Vec Set1(uint32_t v) { return _mm_set1_epi32(int(v)); }
+	template <int n> static __forceinline Vec Shr(Vec a) { return _mm_srli_epi32(a, n); }
+	template <int n> static __forceinline Vec Rotl(Vec a) { return _mm_or_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - n)); }
+	static __forceinline Idx MakeIdx(const uint32_t *offsets) { return offsets; }
+
+	static __forceinline Vec Gather(const uint32_t *base, Idx idx) {		// SSE2 has no gather
+		return _mm_set_epi32(base[idx[3]], base[idx[2]], base[idx[1]], base[idx[0]]);
+	}
+};
+
+void ScryptCore_Sse2(uint32_t *X, uint32_t *V) {
+	ScryptCoreNway<Sse2Lanes>(X, V);
+}
+
+void Sha256d64_Sse2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256d64Nway<Sse2Lanes>(out, in, c);
+}
+
+void Sha256dBlock_Sse2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	Sha256dBlockNway<Sse2Lanes>(out, in, c);
+}
+
+#endif // UCFG_CPU_X86_X64
+
+} // Coin::
+
+#if UCFG_CPU_X86_X64 && UCFG_GNUC
+#	pragma GCC pop_options
+#endif
+
+namespace Coin {
+
+const int MAX_SCRYPT_LANES = 16;
+
+struct ScryptKernel {					// SIMD kernels of the widest ISA supported by the CPU
+	int Lanes;
+	void (*Core)(uint32_t *X, uint32_t *V);
+	void (*Sha256d64)(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);
+	void (*Sha256dBlock)(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);
+};
+
+static ScryptKernel DetectScryptKernel() {
+	ScryptKernel r = { 1, nullptr, nullptr, nullptr };
+#if UCFG_CPU_X86_X64
+	bool bSse2, bAvx2, bAvx512;
+#	if UCFG_GNUC
+	__builtin_cpu_init();
+	bSse2 = __builtin_cpu_supports("sse2");
+	bAvx2 = __builtin_cpu_supports("avx2");
+	bAvx512 = __builtin_cpu_supports("avx512f");
+#	else
+	int regs[4];
+	__cpuid(regs, 0);
+	int maxLeaf = regs[0];
+	__cpuid(regs, 1);
+	bSse2 = regs[3] & (1 << 26);
+	bool bOsXsave = regs[2] & (1 << 27);
+	uint64_t xcr0 = bOsXsave ? _xgetbv(0) : 0;
+	bAvx2 = bAvx512 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(regs, 7, 0);
+		bAvx2 = (regs[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;			// YMM state enabled by OS
+		bAvx512 = (regs[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;		// opmask and ZMM state enabled by OS
+	}
+#	endif
+	if (bAvx512) {
+		r.Lanes = 16;
+		r.Core = &ScryptCore_Avx512;
+		r.Sha256d64 = &Sha256d64_Avx512;
+		r.Sha256dBlock = &Sha256dBlock_Avx512;
+	} else if (bAvx2) {
+		r.Lanes = 8;
+		r.Core = &ScryptCore_Avx2;
+		r.Sha256d64 = &Sha256d64_Avx2;
+		r.Sha256dBlock = &Sha256dBlock_Avx2;
+	} else if (bSse2) {
+		r.Lanes = 4;
+		r.Core = &ScryptCore_Sse2;
+		r.Sha256d64 = &Sha256d64_Sse2;
+		r.Sha256dBlock = &Sha256dBlock_Sse2;
+	}
+#endif // UCFG_CPU_X86_X64
+	return r;
+}
+
+static const ScryptKernel& GetScryptKernel() {
+	static const ScryptKernel s_kernel = DetectScryptKernel();
+	return s_kernel;
+}
+
+int ScryptLanes() {
+	return GetScryptKernel().Lanes;
+}
+
+static __forceinline uint32_t Rotr(uint32_t v, int n) {
+	return (v >> n) | (v << (32 - n));
+}
+
+// Compression of one block given as big-endian words
+static void Sha256Transform(uint32_t state[8], const uint32_t block[16]) {
+	const uint32_t *k = GetShaConstants().pg_sha256_k;
+	uint32_t w[64];
+	memcpy(w, block, 16 * sizeof(uint32_t));
+	for (int i = 16; i < 64; ++i)
+		w[i] = w[i - 16] + (Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7] + (Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; ++i) {
+		uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+		uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e;
+		e = d + t1;
+		d = c; c = b; b = a;
+		a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+struct ScryptHmacState {
+	uint32_t Inner[8], Outer[8];		// SHA-256 states after the ipad/opad blocks
+};
+
+static __forceinline uint32_t Bswap32(uint32_t v) {		// unconditional on any host byte order
+	return betoh(htole(v));
+}
+
+// HMAC-SHA256 keyed by the 80-byte input, then PBKDF2(input, salt = input, c = 1, dkLen = 128) into X
+static void ScryptPrologue(const uint8_t *data, ScryptHmacState& hmac, uint32_t X[SCRYPT_WORDS]) {
+	const uint32_t *hinit = GetShaConstants().pg_sha256_hinit;
+	uint32_t w[20];
+	for (int i = 0; i < 20; ++i)
+		w[i] = betoh(((const uint32_t*)data)[i]);
+
+	uint32_t key[8], pad[16] = { w[16], w[17], w[18], w[19], 0x80000000 };
+	pad[15] = 80 * 8;
+	memcpy(key, hinit, sizeof key);
+	Sha256Transform(key, w);
+	Sha256Transform(key, pad);			// password is longer than the SHA-256 block, so the HMAC key is its hash
+
+	for (int i = 0; i < 16; ++i)
+		pad[i] = (i < 8 ? key[i] : 0) ^ 0x36363636;
+	memcpy(hmac.Inner, hinit, sizeof hmac.Inner);
+	Sha256Transform(hmac.Inner, pad);
+	for (int i = 0; i < 16; ++i)
+		pad[i] = (i < 8 ? key[i] : 0) ^ 0x5C5C5C5C;
+	memcpy(hmac.Outer, hinit, sizeof hmac.Outer);
+	Sha256Transform(hmac.Outer, pad);
+
+	uint32_t salted[8];
+	memcpy(salted, hmac.Inner, sizeof salted);
+	Sha256Transform(salted, w);
+
+	uint32_t tail[16] = { w[16], w[17], w[18], w[19], 0, 0x80000000 };
+	tail[15] = (64 + 80 + 4) * 8;
+	uint32_t outer[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0x80000000 };
+	outer[15] = (64 + 32) * 8;
+	for (uint32_t i = 0; i < 4; ++i) {
+		uint32_t st[8];
+		memcpy(st, salted, sizeof st);
+		tail[4] = i + 1;
+		Sha256Transform(st, tail);
+		memcpy(outer, st, sizeof st);
+		memcpy(st, hmac.Outer, sizeof st);
+		Sha256Transform(st, outer);
+		for (int k = 0; k < 8; ++k)
+			X[i * 8 + k] = Bswap32(st[k]);		// output bytes are big-endian, Salsa works on little-endian words
+	}
+}
+
+// PBKDF2(input, salt = X, c = 1, dkLen = 32)
+static HashValue ScryptEpilogue(const ScryptHmacState& hmac, const uint32_t X[SCRYPT_WORDS]) {
+	uint32_t st[8], w[16];
+	memcpy(st, hmac.Inner, sizeof st);
+	for (int half = 0; half < 2; ++half) {
+		for (int k = 0; k < 16; ++k)
+			w[k] = Bswap32(X[half * 16 + k]);
+		Sha256Transform(st, w);
+	}
+	uint32_t tail[16] = { 1, 0x80000000 };
+	tail[15] = (64 + 128 + 4) * 8;
+	Sha256Transform(st, tail);
+
+	uint32_t outer[16] = { st[0], st[1], st[2], st[3], st[4], st[5], st[6], st[7], 0x80000000 };
+	outer[15] = (64 + 32) * 8;
+	memcpy(st, hmac.Outer, sizeof st);
+	Sha256Transform(st, outer);
+	for (int k = 0; k < 8; ++k)
+		st[k] = htobe(st[k]);
+	return HashValue(Span((const uint8_t*)st, 32));
+}
+
+static thread_local vector<uint32_t> t_scryptScratchpad;
+
+void ScryptHashes(const uint8_t *data, size_t n, HashValue *hashes) {
+	const ScryptKernel& kernel = GetScryptKernel();
+	if (kernel.Lanes == 1) {
+		for (size_t i = 0; i < n; ++i)
+			hashes[i] = ScryptHash(Span(data + i * 80, 80));
+		return;
+	}
+
+	const int L = kernel.Lanes;
+	size_t nWords = size_t(SCRYPT_N) * SCRYPT_WORDS * L + 16;
+	if (t_scryptScratchpad.size() < nWords)
+		t_scryptScratchpad.resize(nWords);
+	uint32_t *V = (uint32_t*)(((uintptr_t)t_scryptScratchpad.data() + 63) & ~uintptr_t(63));
+
+	DECLSPEC_ALIGN(64) uint32_t X[SCRYPT_WORDS * MAX_SCRYPT_LANES];
+	uint32_t x[SCRYPT_WORDS];
+	ScryptHmacState hmac[MAX_SCRYPT_LANES];
+	for (size_t i = 0; i < n; i += L) {
+		int nLanes = int(std::min(size_t(L), n - i));
+		for (int l = 0; l < L; ++l) {
+			ScryptPrologue(data + (i + std::min(l, nLanes - 1)) * 80, hmac[l], x);		// idle lanes repeat the last input
+			for (int k = 0; k < SCRYPT_WORDS; ++k)
+				X[k * L + l] = x[k];
+		}
+		kernel.Core(X, V);
+		for (int l = 0; l < nLanes; ++l) {
+			for (int k = 0; k < SCRYPT_WORDS; ++k)
+				x[k] = X[k * L + l];
+			hashes[i + l] = ScryptEpilogue(hmac[l], x);
+		}
+	}
+}
+
+static Sha256d64Consts CalcSha256d64Consts() {
+	Sha256d64Consts r;
+	memcpy(r.K, GetShaConstants().pg_sha256_k, sizeof r.K);
+	memcpy(r.HInit, GetShaConstants().pg_sha256_hinit, sizeof r.HInit);
+	uint32_t w[64] = { 0x80000000 };
+	w[15] = 64 * 8;
+	for (int i = 16; i < 64; ++i)
+		w[i] = w[i - 16] + (Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7] + (Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	for (int i = 0; i < 64; ++i)
+		r.KPad[i] = r.K[i] + w[i];
+	return r;
+}
+
+static const Sha256d64Consts& GetSha256d64Consts() {
+	static const Sha256d64Consts s_consts = CalcSha256d64Consts();
+	return s_consts;
+}
+
+void MerkleCombinePairs(const HashValue *in, size_t nPairs, HashValue *out) {
+	const ScryptKernel& kernel = GetScryptKernel();
+	if (kernel.Lanes == 1) {
+		for (size_t i = 0; i < nPairs; ++i)
+			out[i] = HashValue::Combine(in[2 * i], in[2 * i + 1]);
+		return;
+	}
+
+	const Sha256d64Consts& s_consts = GetSha256d64Consts();
+	const int L = kernel.Lanes;
+	DECLSPEC_ALIGN(64) uint32_t X[16 * MAX_SCRYPT_LANES], Y[8 * MAX_SCRYPT_LANES];
+	for (size_t i = 0; i < nPairs; i += L) {
+		int nLanes = int(std::min(size_t(L), nPairs - i));
+		for (int l = 0; l < L; ++l) {
+			size_t j = 2 * (i + std::min(l, nLanes - 1));				// idle lanes repeat the last pair
+			uint32_t w[16];
+			memcpy(w, in[j].data(), 32);
+			memcpy(w + 8, in[j + 1].data(), 32);
+			for (int k = 0; k < 16; ++k)
+				X[k * L + l] = betoh(w[k]);
+		}
+		kernel.Sha256d64(Y, X, s_consts);
+		for (int l = 0; l < nLanes; ++l) {				// in-place is safe: pairs of this and later chunks lie at >= 2 * i
+			uint32_t st[8];
+			for (int k = 0; k < 8; ++k)
+				st[k] = htobe(Y[k * L + l]);
+			out[i + l] = HashValue(Span((const uint8_t*)st, 32));
+		}
+	}
+}
+
+void Sha256dShortMessages(const uint8_t *data, size_t cbMessage, size_t n, HashValue *hashes) {
+	if (cbMessage > 55)
+		Throw(errc::invalid_argument);
+	const ScryptKernel& kernel = GetScryptKernel();
+	if (kernel.Lanes == 1) {
+		for (size_t i = 0; i < n; ++i)
+			hashes[i] = Hash(Span(data + i * cbMessage, cbMessage));
+		return;
+	}
+
+	const int L = kernel.Lanes;
+	DECLSPEC_ALIGN(64) uint32_t X[16 * MAX_SCRYPT_LANES], Y[8 * MAX_SCRYPT_LANES];
+	uint32_t block[16] = { 0 };
+	uint8_t *p = (uint8_t*)block;
+	p[cbMessage] = 0x80;
+	p[62] = uint8_t(cbMessage >> 5);				// big-endian bit length
+	p[63] = uint8_t(cbMessage << 3);
+	for (size_t i = 0; i < n; i += L) {
+		int nLanes = int(std::min(size_t(L), n - i));
+		for (int l = 0; l < L; ++l) {
+			memcpy(p, data + (i + std::min(l, nLanes - 1)) * cbMessage, cbMessage);		// idle lanes repeat the last message
+			for (int k = 0; k < 16; ++k)
+				X[k * L + l] = betoh(block[k]);
+		}
+		kernel.Sha256dBlock(Y, X, GetSha256d64Consts());
+		for (int l = 0; l < nLanes; ++l) {
+			uint32_t st[8];
+			for (int k = 0; k < 8; ++k)
+				st[k] = htobe(Y[k * L + l]);
+			hashes[i + l] = HashValue(Span((const uint8_t*)st, 32));
+		}
+	}
+}
+
+HashValue CalcMerkleRoot(vector<HashValue> hashes) {
+	if (hashes.empty())
+		return HashValue::Null();
+	while (hashes.size() > 1) {
+		if (hashes.size() & 1)
+			hashes.push_back(hashes.back());
+		size_t n = hashes.size() / 2;
+		MerkleCombinePairs(hashes.data(), n, hashes.data());
+		hashes.resize(n);
+	}
+	return hashes[0];
+}
+
+
+} // Coin::
@@ -0,0 +1,84 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Lane-interleaved scrypt(N=1024, r=1) ROMix core.
+// Word k of lane l is stored at X[k * LANES + l], the scratchpad V keeps the same layout for each of N steps (128 KiB per lane).
+// Include this header only after the target ISA is enabled (#pragma GCC target), so the template bodies are compiled for it.
+
+#pragma once
+
+namespace Coin {
+
+const int SCRYPT_N = 1024;
+const int SCRYPT_WORDS = 32;		// 128 bytes for r=1
+
+// T provides: LANES, Vec, Idx, Load(p), Store(p, v), Add(a, b), Xor(a, b), Rotl<n>(a), MakeIdx(offsets), Gather(base, idx)
+template <class T>
+__forceinline void XorSalsa8Nway(typename T::Vec b[16], const typename T::Vec bx[16]) {
+	typedef typename T::Vec V;
+	V x[16];
+	for (int i = 0; i < 16; ++i)
+		x[i] = b[i] = T::Xor(b[i], bx[i]);
+	for (int i = 0; i < 8; i += 2) {
+		x[4] = T::Xor(x[4], T::template Rotl<7>(T::Add(x[0], x[12])));		x[9] = T::Xor(x[9], T::template Rotl<7>(T::Add(x[5], x[1])));
+		x[14] = T::Xor(x[14], T::template Rotl<7>(T::Add(x[10], x[6])));	x[3] = T::Xor(x[3], T::template Rotl<7>(T::Add(x[15], x[11])));
+		x[8] = T::Xor(x[8], T::template Rotl<9>(T::Add(x[4], x[0])));		x[13] = T::Xor(x[13], T::template Rotl<9>(T::Add(x[9], x[5])));
+		x[2] = T::Xor(x[2], T::template Rotl<9>(T::Add(x[14], x[10])));		x[7] = T::Xor(x[7], T::template Rotl<9>(T::Add(x[3], x[15])));
+		x[12] = T::Xor(x[12], T::template Rotl<13>(T::Add(x[8], x[4])));	x[1] = T::Xor(x[1], T::template Rotl<13>(T::Add(x[13], x[9])));
+		x[6] = T::Xor(x[6], T::template Rotl<13>(T::Add(x[2], x[14])));		x[11] = T::Xor(x[11], T::template Rotl<13>(T::Add(x[7], x[3])));
+		x[0] = T::Xor(x[0], T::template Rotl<18>(T::Add(x[12], x[8])));		x[5] = T::Xor(x[5], T::template Rotl<18>(T::Add(x[1], x[13])));
+		x[10] = T::Xor(x[10], T::template Rotl<18>(T::Add(x[6], x[2])));	x[15] = T::Xor(x[15], T::template Rotl<18>(T::Add(x[11], x[7])));
+
+		x[1] = T::Xor(x[1], T::template Rotl<7>(T::Add(x[0], x[3])));		x[6] = T::Xor(x[6], T::template Rotl<7>(T::Add(x[5], x[4])));
+		x[11] = T::Xor(x[11], T::template Rotl<7>(T::Add(x[10], x[9])));	x[12] = T::Xor(x[12], T::template Rotl<7>(T::Add(x[15], x[14])));
+		x[2] = T::Xor(x[2], T::template Rotl<9>(T::Add(x[1], x[0])));		x[7] = T::Xor(x[7], T::template Rotl<9>(T::Add(x[6], x[5])));
+		x[8] = T::Xor(x[8], T::template Rotl<9>(T::Add(x[11], x[10])));		x[13] = T::Xor(x[13], T::template Rotl<9>(T::Add(x[12], x[15])));
+		x[3] = T::Xor(x[3], T::template Rotl<13>(T::Add(x[2], x[1])));		x[4] = T::Xor(x[4], T::template Rotl<13>(T::Add(x[7], x[6])));
+		x[9] = T::Xor(x[9], T::template Rotl<13>(T::Add(x[8], x[11])));		x[14] = T::Xor(x[14], T::template Rotl<13>(T::Add(x[13], x[12])));
+		x[0] = T::Xor(x[0], T::template Rotl<18>(T::Add(x[3], x[2])));		x[5] = T::Xor(x[5], T::template Rotl<18>(T::Add(x[4], x[7])));
+		x[10] = T::Xor(x[10], T::template Rotl<18>(T::Add(x[9], x[8])));	x[15] = T::Xor(x[15], T::template Rotl<18>(T::Add(x[14], x[13])));
+	}
+	for (int i = 0; i < 16; ++i)
+		b[i] = T::Add(b[i], x[i]);
+}
+
+template <class T>
+void ScryptCoreNway(uint32_t *X, uint32_t *V) {
+	typedef typename T::Vec Vec;
+	const int L = T::LANES;
+
+	Vec x[SCRYPT_WORDS];
+	for (int k = 0; k < SCRYPT_WORDS; ++k)
+		x[k] = T::Load(X + k * L);
+
+	for (int i = 0; i < SCRYPT_N; ++i) {
+		uint32_t *v = V + i * SCRYPT_WORDS * L;
+		for (int k = 0; k < SCRYPT_WORDS; ++k)
+			T::Store(v + k * L, x[k]);
+		XorSalsa8Nway<T>(x, x + 16);
+		XorSalsa8Nway<T>(x + 16, x);
+	}
+
+	DECLSPEC_ALIGN(64) uint32_t j[L], offsets[L];
+	for (int i = 0; i < SCRYPT_N; ++i) {
+		T::Store(j, x[16]);
+		for (int l = 0; l < L; ++l)
+			offsets[l] = (j[l] & (SCRYPT_N - 1)) * SCRYPT_WORDS * L + l;
+		typename T::Idx idx = T::MakeIdx(offsets);
+		for (int k = 0; k < SCRYPT_WORDS; ++k)
+			x[k] = T::Xor(x[k], T::Gather(V + k * L, idx));
+		XorSalsa8Nway<T>(x, x + 16);
+		XorSalsa8Nway<T>(x + 16, x);
+	}
+
+	for (int k = 0; k < SCRYPT_WORDS; ++k)
+		T::Store(X + k * L, x[k]);
+}
+
+void ScryptCore_Sse2(uint32_t *X, uint32_t *V);			// 4 lanes
+void ScryptCore_Avx2(uint32_t *X, uint32_t *V);			// 8 lanes
+void ScryptCore_Avx512(uint32_t *X, uint32_t *V);		// 16 lanes
+
+} // Coin::
@@ -0,0 +1,114 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// Lane-interleaved SHA-256d of 64-byte messages: the Merkle tree node hash Combine(left, right),
+// and of messages short enough to fit one padded block: PoS kernels.
+// Word k of lane l is stored at in[k * LANES + l] (big-endian words of the message) and out[k * LANES + l] (state words of the result).
+// Include this header only after the target ISA is enabled (#pragma GCC target), so the template bodies are compiled for it.
+
+#pragma once
+
+namespace Coin {
+
+struct Sha256d64Consts {
+	uint32_t K[64],
+		KPad[64],				// K[i] + expanded schedule of the constant padding block of a 64-byte message
+		HInit[8];
+};
+
+// T provides, besides the scrypt lane ops: And(a, b), Or(a, b), Shr<n>(a), Set1(v)
+template <class T, int n>
+__forceinline typename T::Vec RotrNway(typename T::Vec a) {
+	return T::template Rotl<32 - n>(a);
+}
+
+// w == nullptr: the message schedule is already added to k
+template <class T>
+__forceinline void Sha256RoundsNway(typename T::Vec s[8], const typename T::Vec *w, const uint32_t *k) {
+	typedef typename T::Vec V;
+	V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+	for (int i = 0; i < 64; ++i) {
+		V t1 = T::Add(T::Add(h, T::Xor(T::Xor(RotrNway<T, 6>(e), RotrNway<T, 11>(e)), RotrNway<T, 25>(e))),
+			T::Add(T::Xor(g, T::And(e, T::Xor(f, g))), T::Set1(k[i])));
+		if (w)
+			t1 = T::Add(t1, w[i]);
+		V t2 = T::Add(T::Xor(T::Xor(RotrNway<T, 2>(a), RotrNway<T, 13>(a)), RotrNway<T, 22>(a)), T::Or(T::And(a, b), T::And(c, T::Or(a, b))));
+		h = g; g = f; f = e;
+		e = T::Add(d, t1);
+		d = c; c = b; b = a;
+		a = T::Add(t1, t2);
+	}
+	s[0] = T::Add(s[0], a); s[1] = T::Add(s[1], b); s[2] = T::Add(s[2], c); s[3] = T::Add(s[3], d);
+	s[4] = T::Add(s[4], e); s[5] = T::Add(s[5], f); s[6] = T::Add(s[6], g); s[7] = T::Add(s[7], h);
+}
+
+template <class T>
+__forceinline void Sha256ExpandNway(typename T::Vec w[64]) {
+	for (int i = 16; i < 64; ++i) {
+		typename T::Vec w15 = w[i - 15], w2 = w[i - 2];
+		w[i] = T::Add(T::Add(w[i - 16], T::Xor(T::Xor(RotrNway<T, 7>(w15), RotrNway<T, 18>(w15)), T::template Shr<3>(w15))),
+			T::Add(w[i - 7], T::Xor(T::Xor(RotrNway<T, 17>(w2), RotrNway<T, 19>(w2)), T::template Shr<10>(w2))));
+	}
+}
+
+// First SHA-256 of the message: the state s is finished with the second SHA-256 over its 32-byte digest
+template <class T>
+__forceinline void Sha256OfDigestNway(uint32_t *out, typename T::Vec s[8], const Sha256d64Consts& c) {
+	typename T::Vec w[64];
+	for (int k = 0; k < 8; ++k) {
+		w[k] = s[k];
+		s[k] = T::Set1(c.HInit[k]);
+	}
+	w[8] = T::Set1(0x80000000);
+	for (int k = 9; k < 15; ++k)
+		w[k] = T::Set1(0);
+	w[15] = T::Set1(32 * 8);
+	Sha256ExpandNway<T>(w);
+	Sha256RoundsNway<T>(s, w, c.K);
+
+	for (int k = 0; k < 8; ++k)
+		T::Store(out + k * T::LANES, s[k]);
+}
+
+template <class T>
+void Sha256d64Nway(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	typedef typename T::Vec V;
+	const int L = T::LANES;
+
+	V w[64], s[8];
+	for (int k = 0; k < 16; ++k)
+		w[k] = T::Load(in + k * L);
+	Sha256ExpandNway<T>(w);
+	for (int k = 0; k < 8; ++k)
+		s[k] = T::Set1(c.HInit[k]);
+	Sha256RoundsNway<T>(s, w, c.K);
+	Sha256RoundsNway<T>(s, nullptr, c.KPad);		// the second block is the same for all 64-byte messages
+	Sha256OfDigestNway<T>(out, s, c);
+}
+
+// in: messages of up to 55 bytes, each already padded to one 64-byte block
+template <class T>
+void Sha256dBlockNway(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c) {
+	typedef typename T::Vec V;
+	const int L = T::LANES;
+
+	V w[64], s[8];
+	for (int k = 0; k < 16; ++k)
+		w[k] = T::Load(in + k * L);
+	Sha256ExpandNway<T>(w);
+	for (int k = 0; k < 8; ++k)
+		s[k] = T::Set1(c.HInit[k]);
+	Sha256RoundsNway<T>(s, w, c.K);
+	Sha256OfDigestNway<T>(out, s, c);
+}
+
+void Sha256d64_Sse2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);		// 4 lanes
+void Sha256d64_Avx2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);		// 8 lanes
+void Sha256d64_Avx512(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);	// 16 lanes
+void Sha256dBlock_Sse2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);
+void Sha256dBlock_Avx2(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);
+void Sha256dBlock_Avx512(uint32_t *out, const uint32_t *in, const Sha256d64Consts& c);
+
+} // Coin::
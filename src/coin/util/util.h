@@ -290,6 +290,16 @@ COIN_UTIL_EXPORT Blob CalcSha256Midstate(RCSpan mb);
 COIN_UTIL_EXPORT HashValue SHA256_SHA256(RCSpan cbuf);
 COIN_UTIL_EXPORT HashValue ScryptHash(RCSpan mb);
 COIN_UTIL_EXPORT HashValue NeoSCryptHash(RCSpan mb, int profile);
+
+// Multi-way scrypt(1024, 1, 1) of n consecutive 80-byte inputs. Kernel (SSE2/AVX2/AVX-512) is selected at runtime by CPU features
+COIN_UTIL_EXPORT int ScryptLanes();
+COIN_UTIL_EXPORT void ScryptHashes(const uint8_t *data, size_t n, HashValue *hashes);
+
+// out[i] = HashValue::Combine(in[2*i], in[2*i + 1]), up to 16 pairs per SHA-256d kernel call. out may be equal to in
+COIN_UTIL_EXPORT void MerkleCombinePairs(const HashValue *in, size_t nPairs, HashValue *out);
+COIN_UTIL_EXPORT void Sha256dShortMessages(const uint8_t *data, size_t cbMessage, size_t n, HashValue *hashes);		// n contiguous messages of cbMessage <= 55 bytes
+COIN_UTIL_EXPORT HashValue CalcMerkleRoot(vector<HashValue> hashes);		// odd levels duplicate the last hash, as BuildMerkleTree
+
 HashValue SolidcoinHash(RCSpan cbuf);
 HashValue MetisHash(RCSpan cbuf);
 COIN_UTIL_EXPORT HashValue GroestlHash(RCSpan mb);
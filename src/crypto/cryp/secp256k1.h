@@ -13,6 +13,8 @@
 
 #if UCFG_USE_MASM && UCFG_CPU_X86_X64
 #	define USE_ASM_X86_64
+#elif UCFG_PLATFORM_X64 && UCFG_GNUC && defined(__ELF__)
+#	define USE_ASM_X86_64					// 4x64 field from x64/field_4x64_x64_gnuc.cpp instead of the MASM files
 #endif
 
 #if UCFG_PLATFORM_X64 && defined USE_ASM_X86_64
@@ -0,0 +1,180 @@
+/*######   Copyright (c) 2019 Ufasoft  http://ufasoft.com  mailto:support@ufasoft.com,  Sergey Pavlov  mailto:dev@ufasoft.com ####
+#                                                                                                                                     #
+# 		See LICENSE for licensing information                                                                                         #
+#####################################################################################################################################*/
+
+// GCC/Clang port of field_4x64_x64.asm and field_4x64_x64_bmi.asm for builds without a MASM-compatible assembler.
+// Same exported procedures and semantics: 4 little-endian 64-bit limbs, results fully reduced mod p = 2^256 - 0x1000003D1.
+// The names without suffix are ELF ifuncs, resolved once at load time to the MULX/ADCX variant when the CPU has BMI2 and ADX
+
+#include <el/ext.h>
+
+#if UCFG_PLATFORM_X64 && UCFG_GNUC && !UCFG_USE_MASM && defined(__ELF__)		// keep in sync with secp256k1.h
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace {
+
+typedef unsigned __int128 uint128_t;
+
+const uint64_t MOD_0 = 0xFFFFFFFEFFFFFC2FULL,
+	MOD_1 = 0xFFFFFFFFFFFFFFFFULL,			// == MOD_2, MOD_3
+	MOD_RECIP = 0x1000003D1ULL;				// 2^256 mod p
+
+// r = [hi a3 a2 a1 a0] mod p, hi*MOD_RECIP must fit in 128 bits
+__forceinline void NormalizeAfterMulInt(uint64_t *r, uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t hi) {
+	uint128_t t = (uint128_t)hi * MOD_RECIP + a0;
+	r[0] = (uint64_t)t;
+	t = (t >> 64) + a1;
+	r[1] = (uint64_t)t;
+	t = (t >> 64) + a2;
+	r[2] = (uint64_t)t;
+	t = (t >> 64) + a3;
+	r[3] = (uint64_t)t;
+	if ((t >> 64) || (r[3] == MOD_1 && r[2] == MOD_1 && r[1] == MOD_1 && r[0] >= MOD_0)) {		// subtract p == add 2^256 - p and drop the carry
+		t = (uint128_t)r[0] + MOD_RECIP;
+		r[0] = (uint64_t)t;
+		t = (t >> 64) + r[1];
+		r[1] = (uint64_t)t;
+		t = (t >> 64) + r[2];
+		r[2] = (uint64_t)t;
+		r[3] += uint64_t(t >> 64);
+	}
+}
+
+// [hi t3 t2 t1 t0] = l[0..3] + l[4..7] * MOD_RECIP, then reduced
+__forceinline void ReduceProduct(uint64_t *r, const uint64_t l[8]) {
+	uint64_t t[4];
+	uint128_t acc = 0;
+	for (int i = 0; i < 4; ++i) {
+		acc += (uint128_t)l[4 + i] * MOD_RECIP + l[i];
+		t[i] = (uint64_t)acc;
+		acc >>= 64;
+	}
+	NormalizeAfterMulInt(r, t[0], t[1], t[2], t[3], (uint64_t)acc);
+}
+
+__forceinline void Add(uint64_t *r, const uint64_t *a) {
+	uint128_t t = (uint128_t)r[0] + a[0];
+	uint64_t t0 = (uint64_t)t;
+	t = (t >> 64) + r[1] + a[1];
+	uint64_t t1 = (uint64_t)t;
+	t = (t >> 64) + r[2] + a[2];
+	uint64_t t2 = (uint64_t)t;
+	t = (t >> 64) + r[3] + a[3];
+	NormalizeAfterMulInt(r, t0, t1, t2, (uint64_t)t, uint64_t(t >> 64));
+}
+
+__forceinline void Negate(uint64_t *r, const uint64_t *a) {
+	const uint64_t mod[4] = { MOD_0, MOD_1, MOD_1, MOD_1 };
+	uint64_t t[4], borrow = 0;
+	for (int i = 0; i < 4; ++i) {
+		uint128_t d = (uint128_t)mod[i] - a[i] - borrow;
+		t[i] = (uint64_t)d;
+		borrow = uint64_t(d >> 64) & 1;
+	}
+	NormalizeAfterMulInt(r, t[0], t[1], t[2], t[3], 0);
+}
+
+__forceinline void MulInt(uint64_t *r, uint64_t a) {
+	uint64_t t[4];
+	uint128_t acc = 0;
+	for (int i = 0; i < 4; ++i) {
+		acc += (uint128_t)r[i] * a;
+		t[i] = (uint64_t)acc;
+		acc >>= 64;
+	}
+	NormalizeAfterMulInt(r, t[0], t[1], t[2], t[3], (uint64_t)acc);
+}
+
+void Mul(uint64_t *r, const uint64_t *a, const uint64_t *b) {
+	uint64_t l[8] = { 0 };
+	for (int i = 0; i < 4; ++i) {
+		uint128_t c = 0;
+		for (int j = 0; j < 4; ++j) {
+			c += (uint128_t)a[i] * b[j] + l[i + j];
+			l[i + j] = (uint64_t)c;
+			c >>= 64;
+		}
+		l[i + 4] = (uint64_t)c;
+	}
+	ReduceProduct(r, l);
+}
+
+void Sqr(uint64_t *r, const uint64_t *a) {
+	Mul(r, a, a);
+}
+
+void AddPortable(uint64_t *r, const uint64_t *a) { Add(r, a); }
+void NegatePortable(uint64_t *r, const uint64_t *a) { Negate(r, a); }
+void MulIntPortable(uint64_t *r, uint64_t a) { MulInt(r, a); }
+
+// Each row of partial products goes through two independent carry chains, MULX doesn't touch the flags
+__attribute__((target("bmi2,adx"))) void MulBmi2(uint64_t *r, const uint64_t *a, const uint64_t *b) {
+	unsigned long long l[8] = { 0 };
+	for (int i = 0; i < 4; ++i) {
+		unsigned long long lo[4], hi[4];
+		for (int j = 0; j < 4; ++j)
+			lo[j] = _mulx_u64(a[i], b[j], &hi[j]);
+		unsigned char c = 0;
+		for (int j = 0; j < 4; ++j)
+			c = _addcarryx_u64(c, l[i + j], lo[j], &l[i + j]);
+		l[i + 4] = c;										// still zero before this row
+		c = 0;
+		for (int j = 0; j < 4; ++j)
+			c = _addcarryx_u64(c, l[i + j + 1], hi[j], &l[i + j + 1]);		// can't overflow: the partial sum is below 2^(64*(i+5))
+	}
+
+	unsigned long long lo[4], hi[4], t[4];
+	for (int i = 0; i < 4; ++i)
+		lo[i] = _mulx_u64(l[4 + i], MOD_RECIP, &hi[i]);
+	unsigned char c1 = 0, c2 = 0;
+	for (int i = 0; i < 4; ++i)
+		c1 = _addcarryx_u64(c1, l[i], lo[i], &t[i]);
+	for (int i = 1; i < 4; ++i)
+		c2 = _addcarryx_u64(c2, t[i], hi[i - 1], &t[i]);
+	NormalizeAfterMulInt(r, t[0], t[1], t[2], t[3], hi[3] + c1 + c2);
+}
+
+__attribute__((target("bmi2,adx"))) void SqrBmi2(uint64_t *r, const uint64_t *a) { MulBmi2(r, a, a); }
+__attribute__((target("bmi2,adx"))) void AddBmi2(uint64_t *r, const uint64_t *a) { Add(r, a); }
+__attribute__((target("bmi2,adx"))) void NegateBmi2(uint64_t *r, const uint64_t *a) { Negate(r, a); }
+__attribute__((target("bmi2,adx"))) void MulIntBmi2(uint64_t *r, uint64_t a) { MulInt(r, a); }
+
+bool HasBmi2Adx() {
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)
+		&& (ebx & (1 << 8))				// BMI2
+		&& (ebx & (1 << 19));			// ADX
+}
+
+} // namespace
+
+extern "C" {
+
+typedef void (*PFN_fe_mul)(uint64_t *r, const uint64_t *a, const uint64_t *b);
+typedef void (*PFN_fe_unary)(uint64_t *r, const uint64_t *a);
+typedef void (*PFN_fe_mul_int)(uint64_t *r, uint64_t a);
+
+static PFN_fe_mul ResolveFeMul() { return HasBmi2Adx() ? &MulBmi2 : &Mul; }
+static PFN_fe_unary ResolveFeSqr() { return HasBmi2Adx() ? &SqrBmi2 : &Sqr; }
+static PFN_fe_unary ResolveFeAdd() { return HasBmi2Adx() ? &AddBmi2 : &AddPortable; }
+static PFN_fe_unary ResolveFeNegate() { return HasBmi2Adx() ? &NegateBmi2 : &NegatePortable; }
+static PFN_fe_mul_int ResolveFeMulInt() { return HasBmi2Adx() ? &MulIntBmi2 : &MulIntPortable; }
+
+void secp256k1_fe_4x64_mul_inner(uint64_t *r, const uint64_t *a, const uint64_t *b) __attribute__((ifunc("ResolveFeMul")));
+void secp256k1_fe_4x64_sqr_inner(uint64_t *r, const uint64_t *a) __attribute__((ifunc("ResolveFeSqr")));
+void secp256k1_fe_4x64_add_inner(uint64_t *r, const uint64_t *a) __attribute__((ifunc("ResolveFeAdd")));
+void secp256k1_fe_4x64_negate_inner(uint64_t *r, const uint64_t *a) __attribute__((ifunc("ResolveFeNegate")));
+void secp256k1_fe_4x64_mul_int_inner(uint64_t *r, uint64_t a) __attribute__((ifunc("ResolveFeMulInt")));
+
+void secp256k1_fe_4x64_mul_inner_bmi2(uint64_t *r, const uint64_t *a, const uint64_t *b) { MulBmi2(r, a, b); }
+void secp256k1_fe_4x64_sqr_inner_bmi2(uint64_t *r, const uint64_t *a) { SqrBmi2(r, a); }
+void secp256k1_fe_4x64_add_inner_bmi2(uint64_t *r, const uint64_t *a) { AddBmi2(r, a); }
+void secp256k1_fe_4x64_negate_inner_bmi2(uint64_t *r, const uint64_t *a) { NegateBmi2(r, a); }
+void secp256k1_fe_4x64_mul_int_inner_bmi2(uint64_t *r, uint64_t a) { MulIntBmi2(r, a); }
+
+} // extern "C"
+
+#endif // UCFG_PLATFORM_X64 && UCFG_GNUC && !UCFG_USE_MASM && defined(__ELF__)